@@ -0,0 +1,84 @@
+/** \file
+    \brief Edge detection for button bits of input reports
+    \note Previous button mask is kept; XOR with new mask gives bits that changed, so actions
+    are dispatched once per press (or release), not for every report repeated while button
+    is held. Press time of each button is kept for press-and-hold handling.
+*/
+
+#ifndef ButtonTrackerH
+#define ButtonTrackerH
+
+#include <stdint.h>
+
+class ButtonTracker
+{
+public:
+    enum { MAX_BUTTONS = 8 };
+
+    ButtonTracker(void) {
+        Reset();
+    }
+
+    /** \brief Forget state: all buttons released */
+    void Reset(void) {
+        state = pressed = released = 0;
+        for (unsigned int i=0; i<MAX_BUTTONS; i++) {
+            pressUs[i] = 0;
+            durationUs[i] = 0;
+        }
+    }
+
+    /** \brief Take button mask from new report
+        \param timeUs report reception time
+        \return mask of buttons that changed
+    */
+    unsigned int Update(unsigned int mask, uint64_t timeUs) {
+        mask &= (1 << MAX_BUTTONS) - 1;
+        unsigned int changed = mask ^ state;
+        pressed = changed & mask;
+        released = changed & state;
+        for (unsigned int i=0; changed >> i; i++) {
+            if (pressed & (1 << i)) {
+                pressUs[i] = timeUs;
+            } else if (released & (1 << i)) {
+                durationUs[i] = timeUs - pressUs[i];
+            }
+        }
+        state = mask;
+        return changed;
+    }
+
+    /** \brief Buttons currently held */
+    unsigned int GetState(void) const {
+        return state;
+    }
+    /** \brief Buttons pressed in last Update() */
+    unsigned int GetPressed(void) const {
+        return pressed;
+    }
+    /** \brief Buttons released in last Update() */
+    unsigned int GetReleased(void) const {
+        return released;
+    }
+    /** \brief Time at which button was pressed (last time) */
+    uint64_t GetPressTime(unsigned int index) const {
+        return pressUs[index];
+    }
+    /** \brief Duration of last completed press of button */
+    uint64_t GetDuration(unsigned int index) const {
+        return durationUs[index];
+    }
+    /** \brief Time button is held for, 0 if it is not pressed */
+    uint64_t GetHeldTime(unsigned int index, uint64_t nowUs) const {
+        return (state & (1 << index)) ? nowUs - pressUs[index] : 0;
+    }
+
+private:
+    unsigned int state;
+    unsigned int pressed;
+    unsigned int released;
+    uint64_t pressUs[MAX_BUTTONS];
+    uint64_t durationUs[MAX_BUTTONS];
+};
+
+#endif // ButtonTrackerH
@@ -0,0 +1,33 @@
+/** \file
+    \brief Monotonic high resolution clock
+*/
+
+#ifndef ClockH
+#define ClockH
+
+#include <stdint.h>
+
+namespace Clock
+{
+    /** \brief Get monotonic time
+        \return time [us] since unspecified starting point
+    */
+    uint64_t GetTimeUs(void);
+
+    /** \brief Get wall clock time
+        \return time [us] since 1970-01-01 00:00 UTC (same epoch as time())
+    */
+    uint64_t GetWallTimeUs(void);
+
+    /** \brief Get CPU time consumed by calling thread
+        \return user + kernel time [us]
+    */
+    uint64_t GetThreadCpuTimeUs(void);
+
+    /** \brief Suspend calling thread
+        \param ms time [ms]
+    */
+    void SleepMs(unsigned int ms);
+}
+
+#endif // ClockH
@@ -1,7 +1,12 @@
 #include "CommThread.h"
 #include "Log.h"
 #include "PolycomCX300.h"
+#include "Event.h"
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <pthread.h>
+#endif
 #include <assert.h>
 #include <time.h>
 #include <vector>
@@ -9,41 +14,62 @@
 namespace {
 
 volatile bool connected = false;
-volatile bool exited = false;
+Event exitedEvent(true);
 
-}
-
-DWORD WINAPI CommThreadProc(LPVOID data) {
+void CommThreadLoop(void) {
     LOG("Running comm thread");
 
+    PolycomCX300::Start();
     while (connected) {
         PolycomCX300::Poll();
-        Sleep(50);
+        PolycomCX300::Wait();
     }
 
     PolycomCX300::Close();
-    exited = true;
+    exitedEvent.Set();
+}
+
+}
+
+#ifdef _WIN32
+DWORD WINAPI CommThreadProc(LPVOID data) {
+    CommThreadLoop();
     return 0;
 }
+#else
+void* CommThreadProc(void *data) {
+    CommThreadLoop();
+    return NULL;
+}
+#endif
 
 
 int CommThreadStart(void) {
-    DWORD dwtid;
-    exited = false;
+    exitedEvent.Reset();
     connected = true;
+#ifdef _WIN32
+    DWORD dwtid;
     HANDLE CommThread = CreateThread(NULL, 0, CommThreadProc, /*this*/NULL, 0, &dwtid);
     if (CommThread == NULL) {
         connected = false;
-        exited = true;
+        exitedEvent.Set();
     }
+#else
+    pthread_t CommThread;
+    if (pthread_create(&CommThread, NULL, CommThreadProc, NULL) != 0) {
+        connected = false;
+        exitedEvent.Set();
+    } else {
+        pthread_detach(CommThread);
+    }
+#endif
 
     return 0;
 }
 
 int CommThreadStop(void) {
     connected = false;
-    while (!exited) {
-        Sleep(50);
-    }
+    PolycomCX300::Wake();
+    exitedEvent.Wait(Event::INFINITE_TIMEOUT);
     return 0;
 }
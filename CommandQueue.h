@@ -0,0 +1,87 @@
+/** \file
+    \brief Multi-producer/single-consumer command queue that never drops commands
+    \note Fast path is lock-free MpscQueue. Commands that do not fit go to mutex-protected
+    overflow list; once it is used all producers post there until consumer drains it, so
+    commands posted by one thread are never reordered. Consumer drains ring before overflow
+    list taken with it: ring then holds only commands posted before those in list.
+*/
+
+#ifndef CommandQueueH
+#define CommandQueueH
+
+#include "MpscQueue.h"
+#include "Mutex.h"
+#include "ScopedLock.h"
+#include <deque>
+
+template <typename T, unsigned int N>
+class CommandQueue
+{
+public:
+    CommandQueue(void):
+        overflowPending(false)
+    {
+    }
+
+    /** \brief Add command (producer side, any thread, including consumer thread itself)
+        \return false if command went to overflow list (slow path), it is still delivered
+    */
+    bool Post(const T &item) {
+        if (!__atomic_load_n(&overflowPending, __ATOMIC_ACQUIRE) && ring.Push(item))
+            return true;
+        ScopedLock<Mutex> lock(overflowMutex);
+        overflow.push_back(item);
+        __atomic_store_n(&overflowPending, true, __ATOMIC_RELEASE);
+        return false;
+    }
+
+    /** \brief Pass posted commands to apply(item) in order (consumer side)
+        \note Commands posted to overflow list while draining are left for next call;
+        producer wakes consumer after Post() anyway.
+        \return number of commands passed
+    */
+    template <typename F>
+    unsigned int Drain(F &apply) {
+        unsigned int count = 0;
+        T item;
+        if (!__atomic_load_n(&overflowPending, __ATOMIC_ACQUIRE)) {
+            while (ring.Pop(item)) {
+                apply(item);
+                count++;
+            }
+            return count;
+        }
+
+        std::deque<T> pending;
+        {
+            ScopedLock<Mutex> lock(overflowMutex);
+            pending.swap(overflow);
+        }
+        // producers still post to overflow list: everything in ring precedes pending commands
+        while (ring.Pop(item)) {
+            apply(item);
+            count++;
+        }
+        for (typename std::deque<T>::const_iterator iter = pending.begin(); iter != pending.end(); ++iter) {
+            apply(*iter);
+            count++;
+        }
+        {
+            ScopedLock<Mutex> lock(overflowMutex);
+            if (overflow.empty())
+                __atomic_store_n(&overflowPending, false, __ATOMIC_RELEASE);
+        }
+        return count;
+    }
+
+private:
+    MpscQueue<T, N> ring;
+    Mutex overflowMutex;
+    std::deque<T> overflow;
+    bool overflowPending;
+
+    CommandQueue(const CommandQueue&);
+    CommandQueue& operator=(const CommandQueue&);
+};
+
+#endif // CommandQueueH
@@ -1,8 +1,45 @@
 #include "CustomConf.h"
 #include <json/json.h>
+#include <ctype.h>
 
 namespace {
     enum { RING_TYPE_MAX = 5 }; // 0...5
+    enum { MARQUEE_STEP_MIN = 100 };
+
+    bool EqualNoCase(const std::string &text, std::string::size_type begin, std::string::size_type len, const std::string &other)
+    {
+        if (len != other.size())
+            return false;
+        for (std::string::size_type i=0; i<len; i++)
+        {
+            if (tolower(static_cast<unsigned char>(text[begin + i])) != tolower(static_cast<unsigned char>(other[i])))
+                return false;
+        }
+        return true;
+    }
+
+    /** \brief Check if configured device matches whole USB device name (Linux) or, for Windows
+        instance ID (USB\VID_095D&PID_9201\5&1A2B3C4&0&2) or device path used in its place,
+        whole ID or one of its components separated by backslash or '#' (case-insensitive)
+    */
+    bool MatchDevice(const std::string &deviceId, const std::string &device)
+    {
+        const char *separators = "\\#";
+        if (deviceId.find_first_of(separators) == std::string::npos)
+            return deviceId == device;
+        std::string::size_type begin = 0;
+        for (;;)
+        {
+            std::string::size_type end = deviceId.find_first_of(separators, begin);
+            std::string::size_type len = (end == std::string::npos ? deviceId.size() : end) - begin;
+            if (EqualNoCase(deviceId, begin, len, device))
+                return true;
+            if (end == std::string::npos)
+                break;
+            begin = end + 1;
+        }
+        return EqualNoCase(deviceId, 0, deviceId.size(), device);
+    }
 }
 
 CustomConf customConf;
@@ -10,6 +47,8 @@ CustomConf customConf;
 CustomConf::CustomConf(void):
     detailedLogging(false),
     ringType(0),
+    ledSelfTest(true),
+    marqueeStepMs(400),
     dialKey("#")
 {
 
@@ -20,7 +59,64 @@ void CustomConf::toJson(Json::Value &jv) const
     jv = Json::Value(Json::objectValue);
     jv["detailedLogging"] = detailedLogging;
     jv["ringType"] = ringType;
+    jv["ledSelfTest"] = ledSelfTest;
+    jv["marqueeStepMs"] = marqueeStepMs;
     jv["dialKey"] = dialKey;
+    Json::Value &jphones = jv["phones"];
+    jphones = Json::Value(Json::arrayValue);
+    for (unsigned int i=0; i<phones.size(); i++)
+    {
+        Json::Value &jphone = jphones[i];
+        jphone["device"] = phones[i].device;
+        jphone["accountId"] = phones[i].accountId;
+    }
+    Json::Value &jkeymap = jv["keyMap"];
+    jkeymap = Json::Value(Json::arrayValue);
+    for (unsigned int i=0; i<keyMap.size(); i++)
+    {
+        Json::Value &jentry = jkeymap[i];
+        jentry["control"] = keyMap[i].control;
+        jentry["action"] = keyMap[i].action;
+        if (!keyMap[i].value.empty())
+            jentry["value"] = keyMap[i].value;
+        if (!keyMap[i].ringingValue.empty())
+            jentry["ringing"] = keyMap[i].ringingValue;
+    }
+    Json::Value &jmacros = jv["keyMacros"];
+    jmacros = Json::Value(Json::arrayValue);
+    for (unsigned int i=0; i<keyMacros.size(); i++)
+    {
+        const KeyMacroConf &macro = keyMacros[i];
+        Json::Value &jmacro = jmacros[i];
+        jmacro["key"] = macro.key;
+        jmacro["press"] = macro.longPress ? "long" : "short";
+        Json::Value &jsteps = jmacro["steps"];
+        jsteps = Json::Value(Json::arrayValue);
+        for (unsigned int j=0; j<macro.steps.size(); j++)
+        {
+            Json::Value &jstep = jsteps[j];
+            jstep["action"] = macro.steps[j].action;
+            if (!macro.steps[j].value.empty())
+                jstep["value"] = macro.steps[j].value;
+            if (macro.steps[j].delayMs)
+                jstep["delay"] = macro.steps[j].delayMs;
+        }
+    }
+    Json::Value &jscreens = jv["screens"];
+    jscreens = Json::Value(Json::arrayValue);
+    for (unsigned int i=0; i<screens.size(); i++)
+    {
+        const ScreenConf &screen = screens[i];
+        Json::Value &jscreen = jscreens[i];
+        jscreen["screen"] = screen.screen;
+        jscreen["mode"] = screen.mode;
+        jscreen["top"] = screen.top;
+        jscreen["bottom"] = screen.bottom;
+        if (!screen.topRight.empty())
+            jscreen["topRight"] = screen.topRight;
+        if (!screen.bottomRight.empty())
+            jscreen["bottomRight"] = screen.bottomRight;
+    }
 }
 
 void CustomConf::fromJson(const Json::Value &jv)
@@ -28,9 +124,109 @@ void CustomConf::fromJson(const Json::Value &jv)
     if (jv.type() != Json::objectValue)
         return;
     jv.getBool("detailedLogging", detailedLogging);
-    unsigned int tmp;
+    unsigned int tmp = ringType;
     jv.getUInt("ringType", tmp);
-    if (tmp < RING_TYPE_MAX)
+    if (tmp <= RING_TYPE_MAX)
         ringType = tmp;
+    jv.getBool("ledSelfTest", ledSelfTest);
+    tmp = marqueeStepMs;
+    jv.getUInt("marqueeStepMs", tmp);
+    if (tmp == 0 || tmp >= MARQUEE_STEP_MIN)
+        marqueeStepMs = tmp;
     jv.getString("dialKey", dialKey);
+    const Json::Value &jphones = jv["phones"];
+    if (jphones.type() == Json::arrayValue)
+    {
+        phones.clear();
+        for (unsigned int i=0; i<jphones.size(); i++)
+        {
+            const Json::Value &jphone = jphones[i];
+            if (jphone.type() != Json::objectValue)
+                continue;
+            PhoneBinding binding;
+            jphone.getString("device", binding.device);
+            jphone.getInt("accountId", binding.accountId);
+            if (binding.device.empty())
+                continue;
+            phones.push_back(binding);
+        }
+    }
+    const Json::Value &jkeymap = jv["keyMap"];
+    if (jkeymap.type() == Json::arrayValue)
+    {
+        keyMap.clear();
+        for (unsigned int i=0; i<jkeymap.size(); i++)
+        {
+            const Json::Value &jentry = jkeymap[i];
+            if (jentry.type() != Json::objectValue)
+                continue;
+            KeyMapEntry entry;
+            jentry.getString("control", entry.control);
+            jentry.getString("action", entry.action);
+            jentry.getString("value", entry.value);
+            jentry.getString("ringing", entry.ringingValue);
+            keyMap.push_back(entry);
+        }
+    }
+    const Json::Value &jmacros = jv["keyMacros"];
+    if (jmacros.type() == Json::arrayValue)
+    {
+        keyMacros.clear();
+        for (unsigned int i=0; i<jmacros.size(); i++)
+        {
+            const Json::Value &jmacro = jmacros[i];
+            if (jmacro.type() != Json::objectValue)
+                continue;
+            KeyMacroConf macro;
+            jmacro.getString("key", macro.key);
+            std::string press;
+            jmacro.getString("press", press);
+            macro.longPress = (press == "long");
+            const Json::Value &jsteps = jmacro["steps"];
+            if (jsteps.type() == Json::arrayValue)
+            {
+                for (unsigned int j=0; j<jsteps.size(); j++)
+                {
+                    const Json::Value &jstep = jsteps[j];
+                    if (jstep.type() != Json::objectValue)
+                        continue;
+                    KeyMacroConf::Step step;
+                    jstep.getString("action", step.action);
+                    jstep.getString("value", step.value);
+                    jstep.getUInt("delay", step.delayMs);
+                    macro.steps.push_back(step);
+                }
+            }
+            keyMacros.push_back(macro);
+        }
+    }
+    const Json::Value &jscreens = jv["screens"];
+    if (jscreens.type() == Json::arrayValue)
+    {
+        screens.clear();
+        for (unsigned int i=0; i<jscreens.size(); i++)
+        {
+            const Json::Value &jscreen = jscreens[i];
+            if (jscreen.type() != Json::objectValue)
+                continue;
+            ScreenConf screen;
+            jscreen.getString("screen", screen.screen);
+            jscreen.getString("mode", screen.mode);
+            jscreen.getString("top", screen.top);
+            jscreen.getString("bottom", screen.bottom);
+            jscreen.getString("topRight", screen.topRight);
+            jscreen.getString("bottomRight", screen.bottomRight);
+            screens.push_back(screen);
+        }
+    }
+}
+
+int CustomConf::GetPhoneAccount(const std::string &deviceId) const
+{
+    for (unsigned int i=0; i<phones.size(); i++)
+    {
+        if (MatchDevice(deviceId, phones[i].device))
+            return phones[i].accountId;
+    }
+    return -1;
 }
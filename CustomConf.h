@@ -2,6 +2,7 @@
 #define CustomConfH
 
 #include <string>
+#include <vector>
 
 namespace Json
 {
@@ -11,9 +12,71 @@ namespace Json
 struct CustomConf
 {
     bool detailedLogging;
-    unsigned int ringType;
+    unsigned int ringType;         ///< ring indication cadence, see RingCadence
+    bool ledSelfTest;              ///< cycle LED patterns after phone is connected
+    unsigned int marqueeStepMs;    ///< scroll step of caller text longer than display slot, 0 = cut text
     std::string dialKey;
+    /** \brief Assignment of phone to tSIP account
+    */
+    struct PhoneBinding
+    {
+        std::string device;     ///< component of USB device instance ID (Windows, e.g. "5&1A2B3C4&0&2") or whole USB device name (Linux, e.g. "1-2.4")
+        int accountId;          ///< account which MWI is shown on phone, -1 = all accounts
+        PhoneBinding(void):
+            accountId(-1)
+        {}
+    };
+    std::vector<PhoneBinding> phones;
+    /** \brief Sequence of actions run when phone keypad key is pressed, see KeyMacro
+    */
+    struct KeyMacroConf
+    {
+        std::string key;            ///< keypad key: "0"..."9", "*", "#"
+        bool longPress;             ///< run when key is held (after short press), otherwise run instead of key
+        struct Step
+        {
+            std::string action;     ///< "key" (press and release), "keyDown", "keyUp", "script", "redial"
+            std::string value;      ///< key name or script
+            unsigned int delayMs;   ///< pause after previous step
+            Step(void):
+                delayMs(0)
+            {}
+        };
+        std::vector<Step> steps;
+        KeyMacroConf(void):
+            longPress(false)
+        {}
+    };
+    std::vector<KeyMacroConf> keyMacros;
+    /** \brief Action assigned to key or button, see KeyMap
+    */
+    struct KeyMapEntry
+    {
+        std::string control;        ///< "0"..."9", "*", "#", "FLASH", "REDIAL", "HOLD", "MUTE"
+        std::string action;         ///< "key", "script", "redial", "none"
+        std::string value;          ///< key name or script
+        std::string ringingValue;   ///< key name used while phone is ringing, empty = same as value
+    };
+    std::vector<KeyMapEntry> keyMap;
+    /** \brief Display screen layout, see DisplayLayout
+    */
+    struct ScreenConf
+    {
+        std::string screen;         ///< "idle", "call", "ringing"
+        std::string mode;           ///< "lines" or "corners"
+        std::string top;            ///< region of top line (top left corner), e.g. "caller", "clock"
+        std::string bottom;         ///< region of bottom line (bottom left corner)
+        std::string topRight;       ///< corners mode only
+        std::string bottomRight;    ///< corners mode only
+    };
+    std::vector<ScreenConf> screens;
     CustomConf(void);
+    /** \brief Find account bound to phone with specified USB device ID
+        \note Binding matches whole ID or, on Windows, whole component of instance ID
+        (case-insensitive), so "1-2.4" does not bind phone 1-2.4.1 and "2" does not bind every phone
+        \return -1 if not bound (all accounts)
+    */
+    int GetPhoneAccount(const std::string &deviceId) const;
     void toJson(Json::Value &jv) const;
     void fromJson(const Json::Value &jv);
 };
@@ -0,0 +1,103 @@
+#include "DisplayCache.h"
+#include "DisplayText.h"
+#include "Stats.h"
+
+bool DisplayCache::Key::operator<(const Key &other) const
+{
+    if (mode != other.mode)
+        return mode < other.mode;
+    if (slot != other.slot)
+        return slot < other.slot;
+    return text < other.text;
+}
+
+DisplayCache::DisplayCache(unsigned int budget):
+    budget(budget),
+    bytes(0)
+{
+    stats.displayCacheBudget += budget;
+}
+
+DisplayCache::~DisplayCache(void)
+{
+    Clear();
+    stats.displayCacheBudget -= budget;
+}
+
+unsigned int DisplayCache::GetSize(const Entry &entry)
+{
+    // text is stored twice: in list entry and in index key
+    return 2 * entry.key.text.size() + entry.encoded.size() + ENTRY_OVERHEAD;
+}
+
+const std::vector<uint8_t>* DisplayCache::Find(enum DisplayLayout::Mode mode, unsigned int slot, const std::string &text)
+{
+    Key key;
+    key.mode = static_cast<uint8_t>(mode);
+    key.slot = static_cast<uint8_t>(slot);
+    key.text = text;
+    std::map<Key, EntryList::iterator>::iterator iter = index.find(key);
+    if (iter == index.end())
+    {
+        stats.displayCacheMisses++;
+        return NULL;
+    }
+    stats.displayCacheHits++;
+    // move to front; list iterators stay valid
+    entries.splice(entries.begin(), entries, iter->second);
+    return &iter->second->encoded;
+}
+
+const std::vector<uint8_t>* DisplayCache::Insert(enum DisplayLayout::Mode mode, unsigned int slot, const std::string &text,
+    const std::vector<uint8_t> &encoded)
+{
+    Entry entry;
+    entry.key.mode = static_cast<uint8_t>(mode);
+    entry.key.slot = static_cast<uint8_t>(slot);
+    entry.key.text = text;
+    std::map<Key, EntryList::iterator>::iterator iter = index.find(entry.key);
+    if (iter != index.end())
+    {
+        unsigned int size = GetSize(*iter->second);
+        bytes -= size;
+        stats.displayCacheBytes -= size;
+        entries.erase(iter->second);
+        index.erase(iter);
+    }
+
+    entries.push_front(entry);
+    entries.front().encoded = encoded;
+    index[entries.front().key] = entries.begin();
+    unsigned int size = GetSize(entries.front());
+    bytes += size;
+    stats.displayCacheBytes += size;
+
+    while (bytes > budget && entries.size() > MIN_ENTRIES)
+    {
+        size = GetSize(entries.back());
+        bytes -= size;
+        stats.displayCacheBytes -= size;
+        stats.displayCacheEvictions++;
+        index.erase(entries.back().key);
+        entries.pop_back();
+    }
+    return &entries.front().encoded;
+}
+
+const std::vector<uint8_t>* DisplayCache::Get(enum DisplayLayout::Mode mode, unsigned int slot, const std::string &text)
+{
+    const std::vector<uint8_t> *encoded = Find(mode, slot, text);
+    if (encoded)
+        return encoded;
+    std::vector<uint8_t> tmp;
+    DisplayText::EncodeLine(text, DisplayLayout::GetSlotCells(mode), tmp);
+    return Insert(mode, slot, text, tmp);
+}
+
+void DisplayCache::Clear(void)
+{
+    stats.displayCacheBytes -= bytes;
+    bytes = 0;
+    entries.clear();
+    index.clear();
+}
@@ -0,0 +1,77 @@
+/** \file
+    \brief LRU cache of encoded display text
+    \note Recurring screen texts (status, "Incoming call", "Softphone closed", caller names of repeated
+    calls) are encoded into 0x15 text reports once and then sent from cache. Memory is bounded by
+    budget; least recently used entries are dropped first. Slot select reports are constant
+    (PhoneSession tables) and are not stored.
+*/
+
+#ifndef DisplayCacheH
+#define DisplayCacheH
+
+#include "DisplayLayout.h"
+#include <stdint.h>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+class DisplayCache
+{
+public:
+    enum { DEFAULT_BUDGET = 16384 };    ///< [bytes]
+    enum { ENTRY_OVERHEAD = 96 };       ///< bytes counted for each entry besides text and reports (list/map nodes, key)
+    /** Entries used last are never dropped, so texts of all slots of one screen stay valid while written */
+    enum { MIN_ENTRIES = DisplayLayout::SLOT_COUNT };
+
+    explicit DisplayCache(unsigned int budget = DEFAULT_BUDGET);
+    ~DisplayCache(void);
+
+    /** \brief Look up encoded text; found entry becomes most recently used
+        \return NULL if not cached
+    */
+    const std::vector<uint8_t>* Find(enum DisplayLayout::Mode mode, unsigned int slot, const std::string &text);
+
+    /** \brief Store encoded text, dropping least recently used entries over budget
+        \return stored copy, valid until MIN_ENTRIES other entries are used
+    */
+    const std::vector<uint8_t>* Insert(enum DisplayLayout::Mode mode, unsigned int slot, const std::string &text,
+        const std::vector<uint8_t> &encoded);
+
+    /** \brief Find() or encode (cut to slot width) and Insert()
+    */
+    const std::vector<uint8_t>* Get(enum DisplayLayout::Mode mode, unsigned int slot, const std::string &text);
+
+    void Clear(void);
+
+    unsigned int GetBytes(void) const {
+        return bytes;
+    }
+
+private:
+    struct Key
+    {
+        uint8_t mode;
+        uint8_t slot;
+        std::string text;
+        bool operator<(const Key &other) const;
+    };
+    struct Entry
+    {
+        Key key;
+        std::vector<uint8_t> encoded;
+    };
+    typedef std::list<Entry> EntryList;
+
+    unsigned int budget;
+    unsigned int bytes;
+    EntryList entries;                              ///< most recently used first
+    std::map<Key, EntryList::iterator> index;
+
+    static unsigned int GetSize(const Entry &entry);
+
+    DisplayCache(const DisplayCache&);
+    DisplayCache& operator=(const DisplayCache&);
+};
+
+#endif // DisplayCacheH
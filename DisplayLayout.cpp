@@ -0,0 +1,111 @@
+#include "DisplayLayout.h"
+#include "DisplayText.h"
+#include "Log.h"
+
+namespace
+{
+
+const char* const REGION_NAMES[DisplayLayout::REGION_COUNT] = {
+    "none", "caller", "status", "date", "clock", "callTime", "account", "messages", "ring"
+};
+
+const char* const SCREEN_NAMES[DisplayLayout::SCREEN_COUNT] = {
+    "idle", "call", "ringing"
+};
+
+DisplayLayout::Screen MakeScreen(enum DisplayLayout::Mode mode, int top, int bottom, int topRight, int bottomRight)
+{
+    DisplayLayout::Screen screen;
+    screen.mode = mode;
+    screen.regions[DisplayLayout::TOP] = top;
+    screen.regions[DisplayLayout::BOTTOM] = bottom;
+    screen.regions[DisplayLayout::TOP_RIGHT] = topRight;
+    screen.regions[DisplayLayout::BOTTOM_RIGHT] = bottomRight;
+    return screen;
+}
+
+}   // namespace
+
+
+bool DisplayLayout::Screen::IsTimed(void) const
+{
+    for (unsigned int i=0; i<GetSlotCount(); i++)
+    {
+        if (regions[i] == REGION_CLOCK || regions[i] == REGION_CALL_TIME)
+            return true;
+    }
+    return false;
+}
+
+DisplayLayout::DisplayLayout(void)
+{
+    std::vector<CustomConf::ScreenConf> empty;
+    Compile(empty);
+}
+
+unsigned int DisplayLayout::GetSlotCells(enum Mode mode)
+{
+    return (mode == FOUR_CORNERS) ? static_cast<unsigned int>(CORNER_CELLS) : static_cast<unsigned int>(DisplayText::MAX_LINE_CELLS);
+}
+
+int DisplayLayout::GetRegion(const std::string &name)
+{
+    for (unsigned int i=0; i<REGION_COUNT; i++)
+    {
+        if (name == REGION_NAMES[i])
+            return i;
+    }
+    return -1;
+}
+
+void DisplayLayout::Compile(const std::vector<CustomConf::ScreenConf> &conf)
+{
+    screens[SCREEN_IDLE] = MakeScreen(TWO_LINES, REGION_DATE, REGION_CLOCK, REGION_NONE, REGION_NONE);
+    screens[SCREEN_CALL] = MakeScreen(TWO_LINES, REGION_CALLER, REGION_NONE, REGION_NONE, REGION_NONE);
+    screens[SCREEN_RINGING] = MakeScreen(TWO_LINES, REGION_CALLER, REGION_RING, REGION_NONE, REGION_NONE);
+
+    for (unsigned int i=0; i<conf.size(); i++)
+    {
+        const CustomConf::ScreenConf &entry = conf[i];
+        int id = -1;
+        for (unsigned int j=0; j<SCREEN_COUNT; j++)
+        {
+            if (entry.screen == SCREEN_NAMES[j])
+                id = j;
+        }
+        if (id < 0)
+        {
+            LOG("Screens: unknown screen \"%s\"", entry.screen.c_str());
+            continue;
+        }
+        Screen screen;
+        if (entry.mode == "lines")
+        {
+            screen.mode = TWO_LINES;
+        }
+        else if (entry.mode == "corners")
+        {
+            screen.mode = FOUR_CORNERS;
+        }
+        else
+        {
+            LOG("Screens: %s - unknown mode \"%s\"", entry.screen.c_str(), entry.mode.c_str());
+            continue;
+        }
+        const std::string *names[SLOT_COUNT] = { &entry.top, &entry.bottom, &entry.topRight, &entry.bottomRight };
+        bool valid = true;
+        for (unsigned int slot=0; slot<SLOT_COUNT; slot++)
+        {
+            int region = names[slot]->empty() ? static_cast<int>(REGION_NONE) : GetRegion(*names[slot]);
+            if (region < 0)
+            {
+                LOG("Screens: %s - unknown region \"%s\"", entry.screen.c_str(), names[slot]->c_str());
+                valid = false;
+                break;
+            }
+            screen.regions[slot] = (slot < screen.GetSlotCount()) ? region : static_cast<int>(REGION_NONE);
+        }
+        if (valid)
+            screens[id] = screen;
+    }
+}
@@ -0,0 +1,100 @@
+/** \file
+    \brief Display screens: text mode and regions shown in its slots
+    \note Compiled once from configuration (defaults, "screens"). Display has two text modes:
+    two lines or four corners (two lines, each split into left and right part). Each slot of
+    screen shows one region (caller, clock, ...); slots are written separately, so change of
+    one region costs only select report and text reports of its slot.
+*/
+
+#ifndef DisplayLayoutH
+#define DisplayLayoutH
+
+#include "CustomConf.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class DisplayLayout
+{
+public:
+    enum Mode
+    {
+        TWO_LINES = 0,
+        FOUR_CORNERS,
+        MODE_COUNT
+    };
+
+    /** \brief Slots: in two lines mode only TOP and BOTTOM (whole lines), in four corners mode
+        TOP and BOTTOM are left parts
+    */
+    enum Slot
+    {
+        TOP = 0,
+        BOTTOM,
+        TOP_RIGHT,
+        BOTTOM_RIGHT,
+        SLOT_COUNT
+    };
+
+    enum Region
+    {
+        REGION_NONE = 0,    ///< blank
+        REGION_CALLER,      ///< call display text (caller ID)
+        REGION_STATUS,      ///< registration state
+        REGION_DATE,        ///< weekday and date
+        REGION_CLOCK,       ///< hh:mm:ss
+        REGION_CALL_TIME,   ///< time since call started, m:ss
+        REGION_ACCOUNT,     ///< account assigned to phone
+        REGION_MESSAGES,    ///< number of new voicemail messages
+        REGION_RING,        ///< "Incoming call", blinking with ring cadence
+        REGION_COUNT
+    };
+
+    enum ScreenId
+    {
+        SCREEN_IDLE = 0,    ///< no call
+        SCREEN_CALL,        ///< call in progress (or call display text set)
+        SCREEN_RINGING,     ///< incoming call ringing
+        SCREEN_COUNT
+    };
+
+    /** Characters in four corners slot: half of line */
+    enum { CORNER_CELLS = 15 };
+
+    struct Screen
+    {
+        enum Mode mode;
+        uint8_t regions[SLOT_COUNT];    ///< Region of each slot; unused slots are REGION_NONE
+        unsigned int GetSlotCount(void) const {
+            return (mode == FOUR_CORNERS) ? 4 : 2;
+        }
+        /** \brief Screen shows region changing every second (clock timer is needed) */
+        bool IsTimed(void) const;
+    };
+
+    DisplayLayout(void);
+
+    /** \brief Build screens: defaults (idle: date/clock, call: caller, ringing: caller/ring),
+        then configured screens
+        \note Invalid entries are logged and skipped.
+    */
+    void Compile(const std::vector<CustomConf::ScreenConf> &conf);
+
+    const Screen& Get(enum ScreenId id) const {
+        return screens[id];
+    }
+
+    /** \brief Characters that fit into slot */
+    static unsigned int GetSlotCells(enum Mode mode);
+
+    /** \brief Translate region name used in configuration ("none", "caller", "status", "date",
+        "clock", "callTime", "account", "messages", "ring")
+        \return -1 if name is unknown
+    */
+    static int GetRegion(const std::string &name);
+
+private:
+    Screen screens[SCREEN_COUNT];
+};
+
+#endif // DisplayLayoutH
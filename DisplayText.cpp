@@ -0,0 +1,231 @@
+#include "DisplayText.h"
+
+namespace
+{
+
+/** UTF-8 byte classes */
+enum
+{
+    ASCII = 0,
+    CONTINUATION = 1,
+    LEAD2 = 2,          ///< lead byte of 2-byte sequence
+    LEAD3 = 3,
+    LEAD4 = 4,
+    INVALID = 5         ///< never valid in UTF-8 (overlong lead bytes C0/C1, F5...FF)
+};
+
+const uint8_t BYTE_CLASS[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     // 0x00
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,     // 0x80
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    5, 5, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,     // 0xC0
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,     // 0xE0
+    4, 4, 4, 4, 4, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5      // 0xF0
+};
+
+/** Payload bits of lead byte, by class */
+const uint8_t LEAD_MASK[] = { 0x7F, 0x00, 0x1F, 0x0F, 0x07 };
+/** Smallest code point that needs sequence of this class (shorter encoding is overlong) */
+const uint32_t MIN_CODE_POINT[] = { 0, 0, 0x80, 0x800, 0x10000 };
+
+/** Range of code points display font has: Latin-1 Supplement and Latin Extended-A
+    (Polish, Czech, Hungarian... letters); printable ASCII is checked first */
+const uint32_t FONT_FIRST = 0x00A1;
+const uint32_t FONT_LAST = 0x017F;
+
+struct Fallback
+{
+    uint32_t first;
+    uint32_t last;
+    uint16_t glyph;
+};
+
+/** \brief Replacement glyphs, sorted by code point
+*/
+const Fallback FALLBACKS[] = {
+    { 0x00A0, 0x00A0, ' ' },                        // no-break space
+    { 0x00AD, 0x00AD, DisplayText::NO_GLYPH },      // soft hyphen
+    { 0x0218, 0x0218, 0x015E },                     // Romanian S/T with comma below -> cedilla
+    { 0x0219, 0x0219, 0x015F },
+    { 0x021A, 0x021A, 0x0162 },
+    { 0x021B, 0x021B, 0x0163 },
+    { 0x02C6, 0x02C6, '^' },
+    { 0x02DC, 0x02DC, '~' },
+    { 0x0300, 0x036F, DisplayText::NO_GLYPH },      // combining diacritical marks
+    { 0x2000, 0x200A, ' ' },                        // spaces
+    { 0x200B, 0x200F, DisplayText::NO_GLYPH },      // zero width characters, direction marks
+    { 0x2010, 0x2015, '-' },                        // hyphens, dashes
+    { 0x2018, 0x2019, '\'' },
+    { 0x201A, 0x201A, ',' },
+    { 0x201B, 0x201B, '\'' },
+    { 0x201C, 0x201F, '"' },
+    { 0x2020, 0x2021, '+' },                        // daggers
+    { 0x2022, 0x2022, '*' },                        // bullet
+    { 0x2024, 0x2026, '.' },                        // leaders, ellipsis
+    { 0x202F, 0x202F, ' ' },
+    { 0x2032, 0x2032, '\'' },
+    { 0x2033, 0x2033, '"' },
+    { 0x2039, 0x2039, '<' },
+    { 0x203A, 0x203A, '>' },
+    { 0x2060, 0x2060, DisplayText::NO_GLYPH },      // word joiner
+    { 0x20AC, 0x20AC, 'E' },                        // euro sign
+    { 0x2190, 0x2190, '<' },
+    { 0x2192, 0x2192, '>' },
+    { 0x2212, 0x2212, '-' },                        // minus
+    { 0xFEFF, 0xFEFF, DisplayText::NO_GLYPH }       // byte order mark
+};
+
+}   // namespace
+
+
+uint16_t DisplayText::GetGlyph(uint32_t codePoint)
+{
+    if (codePoint >= 0x20 && codePoint < 0x7F)
+        return static_cast<uint16_t>(codePoint);
+    if (codePoint == 0)
+        return NO_GLYPH;
+    if (codePoint < 0x20 || (codePoint >= 0x7F && codePoint < 0xA0))
+        return ' ';         // control characters
+
+    unsigned int low = 0;
+    unsigned int high = sizeof(FALLBACKS) / sizeof(FALLBACKS[0]);
+    while (low < high)
+    {
+        unsigned int mid = (low + high) / 2;
+        if (codePoint > FALLBACKS[mid].last)
+            low = mid + 1;
+        else if (codePoint < FALLBACKS[mid].first)
+            high = mid;
+        else
+            return FALLBACKS[mid].glyph;
+    }
+
+    if (codePoint >= FONT_FIRST && codePoint <= FONT_LAST)
+        return static_cast<uint16_t>(codePoint);
+    return '?';
+}
+
+uint32_t DisplayText::Decode(const char *text, unsigned int length, unsigned int &pos)
+{
+    uint8_t lead = static_cast<uint8_t>(text[pos]);
+    unsigned int cls = BYTE_CLASS[lead];
+    if (cls == ASCII)
+    {
+        pos++;
+        return lead;
+    }
+    if (cls >= LEAD2 && cls <= LEAD4)
+    {
+        unsigned int count = cls - 1;   // continuation bytes
+        uint32_t codePoint = lead & LEAD_MASK[cls];
+        unsigned int i;
+        for (i = 1; i <= count && pos + i < length; i++)
+        {
+            uint8_t c = static_cast<uint8_t>(text[pos + i]);
+            if (BYTE_CLASS[c] != CONTINUATION)
+                break;
+            codePoint = (codePoint << 6) | (c & 0x3F);
+        }
+        if (i > count)
+        {
+            if (codePoint >= MIN_CODE_POINT[cls] && codePoint <= 0x10FFFF && (codePoint < 0xD800 || codePoint > 0xDFFF))
+            {
+                pos += i;
+                return codePoint;
+            }
+        }
+        else if (pos + i == length)
+        {
+            // sequence cut by end of text (e.g. by host command display buffer)
+            pos = length;
+            return NO_GLYPH;
+        }
+    }
+    // not UTF-8: single byte, Latin-1
+    pos++;
+    return lead;
+}
+
+void DisplayText::ToGlyphs(const char *text, unsigned int length, std::vector<uint16_t> &glyphs)
+{
+    glyphs.clear();
+    glyphs.reserve(length);
+    unsigned int pos = 0;
+    while (pos < length)
+    {
+        uint16_t glyph = GetGlyph(Decode(text, length, pos));
+        if (glyph != NO_GLYPH)
+            glyphs.push_back(glyph);
+    }
+}
+
+void DisplayText::EncodeGlyphs(const uint16_t *glyphs, unsigned int count, std::vector<uint8_t> &encoded)
+{
+    unsigned int reports = (count + CHUNK_LENGTH - 1) / CHUNK_LENGTH;
+    encoded.assign(reports * REPORT_SIZE, 0);
+    for (unsigned int i=0; i<count; i++)
+    {
+        unsigned int reportPos = (i / CHUNK_LENGTH) * REPORT_SIZE;
+        if (i % CHUNK_LENGTH == 0)
+            encoded[reportPos] = REPORT_ID;
+        uint8_t *p = &encoded[reportPos + REPORT_HEADER + 2 * (i % CHUNK_LENGTH)];
+        p[0] = static_cast<uint8_t>(glyphs[i]);
+        p[1] = static_cast<uint8_t>(glyphs[i] >> 8);
+    }
+    if (reports)
+        encoded[(reports - 1) * REPORT_SIZE + 1] = LAST_CHUNK;
+}
+
+unsigned int DisplayText::EncodeLine(const char *text, unsigned int length, unsigned int maxCells, std::vector<uint8_t> &encoded)
+{
+    encoded.clear();
+    unsigned int reports = (((length < maxCells) ? length : maxCells) + CHUNK_LENGTH - 1) / CHUNK_LENGTH;
+    encoded.reserve(reports * REPORT_SIZE);
+
+    unsigned int cells = 0;
+    unsigned int reportPos = 0;
+    unsigned int pos = 0;
+    while (pos < length && cells < maxCells)
+    {
+        uint16_t glyph;
+        uint8_t c = static_cast<uint8_t>(text[pos]);
+        if (c >= 0x20 && c < 0x7F)
+        {
+            glyph = c;
+            pos++;
+        }
+        else
+        {
+            glyph = GetGlyph(Decode(text, length, pos));
+            if (glyph == NO_GLYPH)
+                continue;
+        }
+        unsigned int cell = cells % CHUNK_LENGTH;
+        if (cell == 0)
+        {
+            // new report, zero-filled: unused cells are blank
+            reportPos = encoded.size();
+            encoded.resize(reportPos + REPORT_SIZE, 0);
+            encoded[reportPos] = REPORT_ID;
+        }
+        uint8_t *p = &encoded[reportPos + REPORT_HEADER + 2 * cell];
+        p[0] = static_cast<uint8_t>(glyph);
+        p[1] = static_cast<uint8_t>(glyph >> 8);
+        cells++;
+    }
+    if (cells)
+    {
+        encoded[reportPos + 1] = LAST_CHUNK;
+    }
+    return cells;
+}
@@ -0,0 +1,57 @@
+/** \file
+    \brief Encoding text for CX300 display: UTF-8 to 16-bit (UCS-2, little endian) cells of 0x15 text reports
+    \note Decoding is table-driven (class of each byte), glyphs are written directly into report
+    buffers. Characters display cannot show are replaced using fallback glyph map (e.g. typographic
+    quotes and dashes -> ASCII), others by '?'. Bytes that are not valid UTF-8 are taken as Latin-1,
+    so text from ANSI sources is still shown.
+*/
+
+#ifndef DisplayTextH
+#define DisplayTextH
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class DisplayText
+{
+public:
+    enum { REPORT_ID = 0x15 };
+    enum { CHUNK_LENGTH = 8 };                                  ///< characters in one text report
+    enum { REPORT_HEADER = 1 + 1 };                             ///< report ID, continuation flag
+    enum { REPORT_SIZE = REPORT_HEADER + 2 * CHUNK_LENGTH };
+    enum { LAST_CHUNK = 0x80 };                                 ///< continuation flag of last report of line
+    enum { MAX_LINE_CELLS = 31 };                               ///< characters shown in one line
+    enum { NO_GLYPH = 0 };                                      ///< GetGlyph(): character takes no cell
+
+    /** \brief Encode text as sequence of text reports, REPORT_SIZE bytes each
+        \param maxCells characters written at most; text is cut after this many display cells, not bytes
+        \return number of characters written
+    */
+    static unsigned int EncodeLine(const char *text, unsigned int length, unsigned int maxCells, std::vector<uint8_t> &encoded);
+    static unsigned int EncodeLine(const std::string &text, unsigned int maxCells, std::vector<uint8_t> &encoded) {
+        return EncodeLine(text.data(), text.length(), maxCells, encoded);
+    }
+
+    /** \brief Decode whole text into display glyphs (characters taking no cell are skipped)
+    */
+    static void ToGlyphs(const char *text, unsigned int length, std::vector<uint16_t> &glyphs);
+
+    /** \brief Encode glyphs as sequence of text reports, like EncodeLine()
+    */
+    static void EncodeGlyphs(const uint16_t *glyphs, unsigned int count, std::vector<uint8_t> &encoded);
+
+    /** \brief Display glyph (UCS-2) for Unicode code point: code point itself, fallback glyph or '?'
+        \return NO_GLYPH for characters that should be skipped (zero width, combining marks)
+    */
+    static uint16_t GetGlyph(uint32_t codePoint);
+
+    /** \brief Decode one character
+        \param pos position in text, advanced past decoded sequence
+        \return code point; invalid byte is returned as Latin-1 character, incomplete sequence at end
+        of text as NO_GLYPH
+    */
+    static uint32_t Decode(const char *text, unsigned int length, unsigned int &pos);
+};
+
+#endif // DisplayTextH
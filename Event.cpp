@@ -0,0 +1,121 @@
+#include "Event.h"
+
+#ifdef _WIN32
+
+Event::Event(bool manualReset)
+{
+    handle = CreateEvent(NULL, manualReset ? TRUE : FALSE, FALSE, NULL);
+}
+
+Event::~Event()
+{
+    CloseHandle(handle);
+}
+
+void Event::Set(void)
+{
+    SetEvent(handle);
+}
+
+void Event::Reset(void)
+{
+    ResetEvent(handle);
+}
+
+bool Event::Wait(unsigned int timeout)
+{
+    return WaitForSingleObject(handle, timeout) == WAIT_OBJECT_0;
+}
+
+int Event::WaitAny(Event* const *events, int count, unsigned int timeout)
+{
+    enum { MAX_EVENTS = MAXIMUM_WAIT_OBJECTS };
+    HANDLE handles[MAX_EVENTS];
+    if (count <= 0 || count > MAX_EVENTS)
+        return -1;
+    for (int i=0; i<count; i++)
+        handles[i] = events[i]->handle;
+    DWORD rc = WaitForMultipleObjects(count, handles, FALSE, timeout);
+    if (rc >= WAIT_OBJECT_0 && rc < WAIT_OBJECT_0 + count)
+        return rc - WAIT_OBJECT_0;
+    return -1;
+}
+
+#else
+
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdint.h>
+
+Event::Event(bool manualReset):
+    manualReset(manualReset)
+{
+    fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+Event::~Event()
+{
+    close(fd);
+}
+
+void Event::Set(void)
+{
+    uint64_t one = 1;
+    ssize_t rc = write(fd, &one, sizeof(one));
+    (void)rc;
+}
+
+void Event::Reset(void)
+{
+    uint64_t value;
+    ssize_t rc = read(fd, &value, sizeof(value));
+    (void)rc;
+}
+
+void Event::Consume(void)
+{
+    if (!manualReset)
+        Reset();
+}
+
+bool Event::Wait(unsigned int timeout)
+{
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int rc = poll(&pfd, 1, (timeout == INFINITE_TIMEOUT) ? -1 : (int)timeout);
+    if (rc <= 0)
+        return false;
+    Consume();
+    return true;
+}
+
+int Event::WaitAny(Event* const *events, int count, unsigned int timeout)
+{
+    enum { MAX_EVENTS = 64 };
+    struct pollfd pfd[MAX_EVENTS];
+    if (count <= 0 || count > MAX_EVENTS)
+        return -1;
+    for (int i=0; i<count; i++)
+    {
+        pfd[i].fd = events[i]->fd;
+        pfd[i].events = POLLIN;
+        pfd[i].revents = 0;
+    }
+    int rc = poll(pfd, count, (timeout == INFINITE_TIMEOUT) ? -1 : (int)timeout);
+    if (rc <= 0)
+        return -1;
+    for (int i=0; i<count; i++)
+    {
+        if (pfd[i].revents)
+        {
+            events[i]->Consume();
+            return i;
+        }
+    }
+    return -1;
+}
+
+#endif
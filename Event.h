@@ -0,0 +1,64 @@
+/** \file
+    \brief Waitable event (Win32 event object / Linux eventfd)
+*/
+
+#ifndef EventH
+#define EventH
+
+#ifdef _WIN32
+#   include <windows.h>
+#endif
+
+class Event
+{
+public:
+    enum { INFINITE_TIMEOUT = 0xFFFFFFFF };
+
+    /** \param manualReset if false event is reset by successful Wait()
+    */
+    explicit Event(bool manualReset = false);
+    ~Event();
+
+    void Set(void);
+    void Reset(void);
+
+    /** \brief Wait for event to become signaled
+        \param timeout [ms] or INFINITE_TIMEOUT
+        \return true if event was signaled
+    */
+    bool Wait(unsigned int timeout);
+
+    /** \brief Wait for any of events to become signaled
+        \param timeout [ms] or INFINITE_TIMEOUT
+        \return index of signaled event or -1 on timeout/error
+    */
+    static int WaitAny(Event* const *events, int count, unsigned int timeout);
+
+#ifdef _WIN32
+    HANDLE GetHandle(void) const {
+        return handle;
+    }
+#else
+    /** \brief Descriptor that becomes readable when event is signaled, usable with poll()
+    */
+    int GetFd(void) const {
+        return fd;
+    }
+
+    /** \brief Consume signaled state after fd was reported readable by poll()
+    */
+    void Consume(void);
+#endif
+
+private:
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    int fd;
+    bool manualReset;
+#endif
+    Event(const Event&);
+    Event& operator=(const Event&);
+};
+
+#endif // EventH
@@ -1,6 +1,337 @@
 #include "HidDevice.h"
 #include "Log.h"
+#include "Clock.h"
 #include "bin2str.h"
+#include "ScopedLock.h"
+
+#include <sstream>
+#include <vector>
+#include <string.h>
+#include <assert.h>
+
+using namespace nsHidDevice;
+
+
+HidDevice::SERROR HidDevice::tabErrorsName[E_ERR_LIMIT] =
+{
+    { E_ERR_INV_PARAM,                  "Invalid parameter" },
+    { E_ERR_NOTFOUND,                   "Device not found" },
+    { E_ERR_IO,                         "Error calling I/O function" },
+    { E_ERR_TIMEOUT,                    "Timeout" },
+    { E_ERR_OTHER,                      "Other error" },
+    { E_ERR_QUEUE_FULL,                 "Write queue full" },
+    { 0,		                        "No error" }
+};
+
+/** \brief Get short error message
+*/
+std::string HidDevice::GetErrorDesc(int ErrorCode)
+{
+    int a=0;
+    std::stringstream stream;
+    while (tabErrorsName[a].nCode > 0)
+    {
+        if (tabErrorsName[a].nCode == ErrorCode)
+        {
+            stream << tabErrorsName[a].lpName;
+            return stream.str();
+        }
+        a++;
+    }
+    return stream.str();
+}
+
+bool HidDevice::GetReport(HidReport &report)
+{
+    return reports.Pop(report);
+}
+
+int HidDevice::GetReportLength(enum E_REPORT_TYPE type) const
+{
+    unsigned long length;
+    switch (type)
+    {
+    case E_REPORT_IN:
+        length = reportInLength;
+        break;
+    case E_REPORT_OUT:
+        length = reportOutLength;
+        break;
+    case E_REPORT_FEATURE:
+        length = reportFeatureLength;
+        break;
+    default:
+        return 0;
+    }
+    if (length > 1 + HidReport::MAX_SIZE)
+        length = 1 + HidReport::MAX_SIZE;
+    return length;
+}
+
+/* ------------------------------------------------------------------------ */
+
+int HidDevice::BeginReport(enum E_REPORT_TYPE type, int id, uint8_t **data, int *size)
+{
+    if (type == E_REPORT_IN)
+        return E_ERR_INV_PARAM;
+    int length = GetReportLength(type);
+    if (length < 2)
+        return E_ERR_INV_PARAM;
+
+    ScopedLock<Mutex> lock(writeMutex);
+    if (!writerRunning)
+        return E_ERR_NOTFOUND;
+    assert(!reportBegun);
+    if (writeReserved - writeTail >= WRITE_QUEUE_SIZE)
+        return E_ERR_QUEUE_FULL;
+    if (writeReserved == writeHead)
+        writeFrame++;
+    WriteRequest &req = writeSlots[writeReserved & (WRITE_QUEUE_SIZE - 1)];
+    writeReserved++;
+    reportBegun = true;
+
+    // only part used by this device is cleared
+    memset(req.data, 0, length);
+    req.data[0] = id;
+    req.type = type;
+    req.size = length;
+    req.len = length;
+    req.frame = writeFrame;
+    *data = req.data + 1;
+    *size = length - 1;
+    return 0;
+}
+
+int HidDevice::CommitReport(int len, unsigned int timeout, WriteCallback callback, void *opaque, bool frameEnd)
+{
+    ScopedLock<Mutex> lock(writeMutex);
+    if (!reportBegun)
+        return E_ERR_INV_PARAM;
+    reportBegun = false;
+    WriteRequest &req = writeSlots[(writeReserved - 1) & (WRITE_QUEUE_SIZE - 1)];
+    if (req.type == E_REPORT_OUT)
+    {
+        if (len < 0 || len + 1 > req.size)
+        {
+            writeReserved = writeHead;
+            return E_ERR_INV_PARAM;
+        }
+        req.len = len + 1;
+    }
+    req.deadlineUs = Clock::GetTimeUs() + static_cast<uint64_t>(timeout) * 1000;
+    req.callback = callback;
+    req.opaque = opaque;
+    req.frameEnd = frameEnd;
+    if (!frameEnd)
+        return 0;
+    if (!writerRunning)
+    {
+        writeReserved = writeHead;
+        return E_ERR_NOTFOUND;
+    }
+    writeHead = writeReserved;
+    writeEvent.Set();
+    return 0;
+}
+
+void HidDevice::CancelReports(void)
+{
+    ScopedLock<Mutex> lock(writeMutex);
+    reportBegun = false;
+    writeReserved = writeHead;
+}
+
+int HidDevice::QueueCopy(enum E_REPORT_TYPE type, int id, const unsigned char *buffer, int len,
+    unsigned int timeout, WriteCallback callback, void *opaque, bool frameEnd)
+{
+    if (id < 0)
+    {
+        // buffer starts with report ID
+        if (len < 1)
+            return E_ERR_INV_PARAM;
+        id = buffer[0];
+        buffer++;
+        len--;
+    }
+    if (len < 0)
+        return E_ERR_INV_PARAM;
+    uint8_t *data;
+    int size;
+    int status = BeginReport(type, id, &data, &size);
+    if (status)
+        return status;
+    if (len > size)
+    {
+        LOG("Error: report 0x%02X too long (%d bytes, device capabilities: %d)", id, len, size);
+        CancelReports();
+        return E_ERR_INV_PARAM;
+    }
+    memcpy(data, buffer, len);
+    return CommitReport(len, timeout, callback, opaque, frameEnd);
+}
+
+int HidDevice::SubmitReport(enum E_REPORT_TYPE type, int id, const unsigned char *buffer, int len,
+    unsigned int timeout, WriteCallback callback, void *opaque)
+{
+    return QueueCopy(type, id, buffer, len, timeout, callback, opaque, true);
+}
+
+int HidDevice::SubmitReportOut(const unsigned char *buffer, int len,
+    unsigned int timeout, WriteCallback callback, void *opaque)
+{
+    return QueueCopy(E_REPORT_OUT, -1, buffer, len, timeout, callback, opaque, true);
+}
+
+int HidDevice::SubmitFrameOut(const unsigned char *buffer, const int *lengths, int count,
+    unsigned int timeout, WriteCallback callback, void *opaque)
+{
+    if (count <= 0)
+        return E_ERR_INV_PARAM;
+    {
+        // whole frame has to fit, partially queued frame is not written
+        ScopedLock<Mutex> lock(writeMutex);
+        if (writeReserved - writeTail + count > WRITE_QUEUE_SIZE)
+            return E_ERR_QUEUE_FULL;
+    }
+    for (int i=0; i<count; i++)
+    {
+        int status = QueueCopy(E_REPORT_OUT, -1, buffer, lengths[i], timeout, callback, opaque, i == count - 1);
+        if (status)
+        {
+            CancelReports();
+            return status;
+        }
+        buffer += lengths[i];
+    }
+    return 0;
+}
+
+int HidDevice::Flush(unsigned int timeout)
+{
+    uint64_t endUs = Clock::GetTimeUs() + timeout * 1000ULL;
+    for (;;)
+    {
+        {
+            ScopedLock<Mutex> lock(writeMutex);
+            if (writeTail == writeHead || !writerRunning)
+                return 0;
+        }
+        uint64_t now = Clock::GetTimeUs();
+        if (now >= endUs)
+            return E_ERR_TIMEOUT;
+        writeIdleEvent.Wait(static_cast<unsigned int>((endUs - now + 999) / 1000));
+    }
+}
+
+void HidDevice::SyncWriteCallback(void *opaque, int status)
+{
+    HidDevice *dev = reinterpret_cast<HidDevice*>(opaque);
+    dev->syncWriteStatus = status;
+    __atomic_add_fetch(&dev->syncWritesCompleted, 1, __ATOMIC_RELEASE);
+    dev->syncWriteDone.Set();
+}
+
+int HidDevice::WriteSync(enum E_REPORT_TYPE type, int id, const unsigned char *buffer, int len)
+{
+    ScopedLock<Mutex> lock(syncWriteMutex);
+    syncWriteDone.Reset();
+    int status = QueueCopy(type, id, buffer, len, DEFAULT_WRITE_TIMEOUT, SyncWriteCallback, this, true);
+    if (status)
+        return status;
+    unsigned int ticket = ++syncWritesIssued;
+    // writer should complete request by its deadline; do not rely on it (driver may not return)
+    uint64_t endUs = Clock::GetTimeUs() + (DEFAULT_WRITE_TIMEOUT + SYNC_WRITE_MARGIN) * 1000ULL;
+    for (;;)
+    {
+        if (static_cast<int>(__atomic_load_n(&syncWritesCompleted, __ATOMIC_ACQUIRE) - ticket) >= 0)
+            return syncWriteStatus;
+        uint64_t now = Clock::GetTimeUs();
+        if (now >= endUs)
+            break;
+        syncWriteDone.Wait(static_cast<unsigned int>((endUs - now + 999) / 1000));
+    }
+    // queued request itself is dropped by writer (deadline passed) or completes later, unobserved
+    CancelReports();
+    LOG("Error: blocking write not completed within %u ms", static_cast<unsigned int>(DEFAULT_WRITE_TIMEOUT + SYNC_WRITE_MARGIN));
+    return E_ERR_TIMEOUT;
+}
+
+int HidDevice::WriteReport(enum E_REPORT_TYPE type, int id, const unsigned char *buffer, int len)
+{
+    if (id < 0)
+        return E_ERR_INV_PARAM;
+#ifndef _WIN32
+    // hidraw feature write cannot be bounded, WriteSync() would not keep its timeout
+    if (type == E_REPORT_FEATURE)
+        return E_ERR_INV_PARAM;
+#endif
+    return WriteSync(type, id, buffer, len);
+}
+
+int HidDevice::WriteReportOut(const unsigned char *buffer, int len)
+{
+    return WriteSync(E_REPORT_OUT, -1, buffer, len);
+}
+
+void HidDevice::WriterLoop(void)
+{
+    Event* events[2] = { &writeEvent, &writerStopEvent };
+    bool frameFailed = false;
+    unsigned int failedFrame = 0;
+
+    for (;;)
+    {
+        WriteRequest *preq = NULL;
+        {
+            ScopedLock<Mutex> lock(writeMutex);
+            if (writeTail != writeHead)
+                preq = &writeSlots[writeTail & (WRITE_QUEUE_SIZE - 1)];
+        }
+        if (preq == NULL)
+        {
+            // queue is drained before stopping so that e.g. last display update on Close() is written
+            if (Event::WaitAny(events, 2, Event::INFINITE_TIMEOUT) == 1)
+                break;
+            continue;
+        }
+
+        // slot is written in place: producer does not reuse it until tail is moved
+        const WriteRequest &req = *preq;
+        if (!(frameFailed && req.frame == failedFrame))
+        {
+            int status;
+            if (Clock::GetTimeUs() >= req.deadlineUs)
+            {
+                LOG("Write deadline passed before write, len = %d, HEX: %s", req.len, BufToHexString(req.data, req.len).c_str());
+                status = E_ERR_TIMEOUT;
+            }
+            else
+            {
+                status = DoWrite(req);
+            }
+
+            if (status != 0)
+            {
+                frameFailed = true;
+                failedFrame = req.frame;
+                if (req.callback)
+                    req.callback(req.opaque, status);
+            }
+            else if (req.frameEnd && req.callback)
+            {
+                req.callback(req.opaque, 0);
+            }
+        }
+
+        ScopedLock<Mutex> lock(writeMutex);
+        writeTail++;
+        if (writeTail == writeHead)
+            writeIdleEvent.Set();
+    }
+}
+
+
+#ifdef _WIN32
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -9,15 +340,19 @@ extern "C"
 {
 #include <ddk/hidsdi.h>
 #include <setupapi.h>
+#include <cfgmgr32.h>
 }
 #include <dbt.h>
+#include <winioctl.h>
+
+#ifndef IOCTL_HID_SET_FEATURE
+#define IOCTL_HID_SET_FEATURE CTL_CODE(FILE_DEVICE_KEYBOARD, 100, METHOD_IN_DIRECT, FILE_ANY_ACCESS)
+#endif
 
-#include <sstream>
 #include <iostream>
 #include <algorithm>
 #include <assert.h>
 
-using namespace nsHidDevice;
 using namespace std;
 
 
@@ -52,33 +387,6 @@ std::string GetLastErrorMessage(DWORD dw)
 }
 
 
-HidDevice::SERROR HidDevice::tabErrorsName[E_ERR_LIMIT] =
-{
-    { E_ERR_INV_PARAM,                  "Invalid parameter" },
-    { E_ERR_NOTFOUND,                   "Device not found" },
-    { E_ERR_IO,                         "Error calling I/O function" },
-    { E_ERR_TIMEOUT,                    "Timeout" },
-    { 0,		                        "No error" }
-};
-
-/** \brief Get short error message
-*/
-std::string HidDevice::GetErrorDesc(int ErrorCode)
-{
-    int a=0;
-    std::stringstream stream;
-    while (tabErrorsName[a].nCode > 0)
-    {
-        if (tabErrorsName[a].nCode == ErrorCode)
-        {
-            stream << tabErrorsName[a].lpName;
-            return stream.str();
-        }
-        a++;
-    }
-    return stream.str();
-}
-
 void HidDevice::UnicodeToAscii(char *buffer)
 {
     unsigned short  *unicode = (unsigned short*)buffer;
@@ -98,24 +406,57 @@ HidDevice::HidDevice(void):
     readHandle(INVALID_HANDLE_VALUE),
     writeHandle(INVALID_HANDLE_VALUE),
     hEventObject(NULL),
+    preparsedData(NULL),
     VID(0),
     PID(0),
     usagePage(-1),
-    preparsedData(NULL),
     reportInLength(0),
-    reportOutLength(0)
+    reportOutLength(0),
+    reportFeatureLength(0),
+    readerThread(NULL),
+    writerThread(NULL),
+    readerStopEvent(true),
+    readerReportSize(0),
+    readerFailed(false),
+    droppedReports(0),
+    writeTail(0),
+    writeHead(0),
+    writeReserved(0),
+    reportBegun(false),
+    writeFrame(0),
+    writerRunning(false),
+    writerStopEvent(true),
+    syncWriteStatus(0),
+    syncWritesIssued(0),
+    syncWritesCompleted(0)
 {
     pOverlapped = new OVERLAPPED;
     HidD_GetHidGuid(&hidGuid);
+
+    OVERLAPPED *ro = new OVERLAPPED;
+    memset(ro, 0, sizeof(*ro));
+    ro->hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    pReaderOverlapped = ro;
+
+    OVERLAPPED *wo = new OVERLAPPED;
+    memset(wo, 0, sizeof(*wo));
+    wo->hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    pWriterOverlapped = wo;
 }
 
 HidDevice::~HidDevice(void)
 {
+    Close();
     OVERLAPPED *o = (OVERLAPPED*)pOverlapped;
     delete o;
+    OVERLAPPED *ro = (OVERLAPPED*)pReaderOverlapped;
+    CloseHandle(ro->hEvent);
+    delete ro;
+    OVERLAPPED *wo = (OVERLAPPED*)pWriterOverlapped;
+    CloseHandle(wo->hEvent);
+    delete wo;
     if (preparsedData)
         HidD_FreePreparsedData(preparsedData);
-    Close();
 }
 
 void HidDevice::GetHidGuid(GUID *guid) const
@@ -198,6 +539,12 @@ int HidDevice::Open(int VID, int PID, char *vendorName, char *productName, int u
 
         if (usagePage >= 0)
         {
+            // data from previously checked (not matching) interface
+            if (preparsedData)
+            {
+                HidD_FreePreparsedData(preparsedData);
+                preparsedData = NULL;
+            }
             // returns a pointer to a buffer containing the information about the device's capabilities.
             if (HidD_GetPreparsedData(handle, &preparsedData) == FALSE)
             {
@@ -220,6 +567,7 @@ int HidDevice::Open(int VID, int PID, char *vendorName, char *productName, int u
 
             reportInLength = Capabilities.InputReportByteLength;
             reportOutLength = Capabilities.OutputReportByteLength;
+            reportFeatureLength = Capabilities.FeatureReportByteLength;
 
             HidD_FlushQueue(handle);
 
@@ -232,6 +580,8 @@ int HidDevice::Open(int VID, int PID, char *vendorName, char *productName, int u
     {
         path = deviceDetails->DevicePath;
         errorCode = CreateReadWriteHandles(deviceDetails->DevicePath);
+        if (errorCode == 0)
+            errorCode = StartWriter();
     }
 
     SetupDiDestroyDeviceInfoList(deviceInfoList);
@@ -240,6 +590,137 @@ int HidDevice::Open(int VID, int PID, char *vendorName, char *productName, int u
     return errorCode;
 }
 
+int HidDevice::Enumerate(int VID, int PID, std::map<std::string, InterfaceMap> &devices)
+{
+    HDEVINFO                            deviceInfoList;
+    SP_DEVICE_INTERFACE_DATA            deviceInfo;
+    SP_DEVINFO_DATA                     devInfoData;
+    std::vector<char>                   detailsBuffer;
+    DWORD                               size;
+    GUID                                guid;
+    char                                idPattern[32];
+
+    devices.clear();
+    HidD_GetHidGuid(&guid);
+    // device path looks like \\?\hid#vid_095d&pid_9201&mi_03#...
+    snprintf(idPattern, sizeof(idPattern), "vid_%04x&pid_%04x", VID, PID);
+
+    deviceInfoList = SetupDiGetClassDevs(&guid, NULL, NULL, DIGCF_PRESENT | DIGCF_INTERFACEDEVICE);
+    if (deviceInfoList == INVALID_HANDLE_VALUE)
+        return E_ERR_IO;
+    deviceInfo.cbSize = sizeof(deviceInfo);
+    for (int i=0; SetupDiEnumDeviceInterfaces(deviceInfoList, 0, &guid, i, &deviceInfo); i++)
+    {
+        SetupDiGetDeviceInterfaceDetail(deviceInfoList, &deviceInfo, NULL, 0, &size, NULL);
+        if (size < sizeof(SP_DEVICE_INTERFACE_DETAIL_DATA))
+            continue;
+        detailsBuffer.resize(size);
+        SP_DEVICE_INTERFACE_DETAIL_DATA *deviceDetails = reinterpret_cast<SP_DEVICE_INTERFACE_DETAIL_DATA*>(&detailsBuffer[0]);
+        deviceDetails->cbSize = sizeof(*deviceDetails);
+        devInfoData.cbSize = sizeof(devInfoData);
+        if (!SetupDiGetDeviceInterfaceDetail(deviceInfoList, &deviceInfo, deviceDetails, size, &size, &devInfoData))
+            continue;
+
+        std::string devicePath = deviceDetails->DevicePath;
+        if (VID != 0 && PID != 0)
+        {
+            // filter by path first - opening every HID device on machine is expensive
+            std::string lowerPath = devicePath;
+            std::transform(lowerPath.begin(), lowerPath.end(), lowerPath.begin(), ::tolower);
+            if (lowerPath.find(idPattern) == std::string::npos)
+                continue;
+        }
+
+        // HID collection -> USB interface (MI_xx) -> USB device
+        std::string parentId;
+        DEVINST usbInterface, usbDevice;
+        char instanceId[MAX_DEVICE_ID_LEN];
+        if (CM_Get_Parent(&usbInterface, devInfoData.DevInst, 0) == CR_SUCCESS &&
+            CM_Get_Parent(&usbDevice, usbInterface, 0) == CR_SUCCESS &&
+            CM_Get_Device_ID(usbDevice, instanceId, sizeof(instanceId), 0) == CR_SUCCESS)
+        {
+            parentId = instanceId;
+        }
+        else
+        {
+            parentId = devicePath;
+        }
+
+        // no read/write access is needed to query attributes and capabilities
+        HANDLE h = CreateFile(devicePath.c_str(), 0, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+        if (h == INVALID_HANDLE_VALUE)
+            continue;
+
+        HIDD_ATTRIBUTES deviceAttributes;
+        deviceAttributes.Size = sizeof(deviceAttributes);
+        PHIDP_PREPARSED_DATA data = NULL;
+        if (HidD_GetAttributes(h, &deviceAttributes) &&
+            (VID == 0 || deviceAttributes.VendorID == VID) &&
+            (PID == 0 || deviceAttributes.ProductID == PID) &&
+            HidD_GetPreparsedData(h, &data))
+        {
+            HIDP_CAPS Capabilities;
+            if (HidP_GetCaps(data, &Capabilities) == HIDP_STATUS_SUCCESS)
+            {
+                InterfaceMap &interfaces = devices[parentId];
+                if (interfaces.find(Capabilities.UsagePage) == interfaces.end())
+                    interfaces[Capabilities.UsagePage] = devicePath;
+            }
+            HidD_FreePreparsedData(data);
+        }
+        CloseHandle(h);
+    }
+    SetupDiDestroyDeviceInfoList(deviceInfoList);
+
+    return devices.empty() ? E_ERR_NOTFOUND : 0;
+}
+
+int HidDevice::OpenPath(const std::string &path, int usagePage)
+{
+    Close();
+
+    handle = CreateFile(path.c_str(), GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+        return E_ERR_NOTFOUND;
+
+    HIDD_ATTRIBUTES deviceAttributes;
+    deviceAttributes.Size = sizeof(deviceAttributes);
+    HIDP_CAPS Capabilities;
+    if (HidD_GetAttributes(handle, &deviceAttributes) == FALSE ||
+        HidD_GetPreparsedData(handle, &preparsedData) == FALSE)
+    {
+        Close();
+        return E_ERR_IO;
+    }
+    if (HidP_GetCaps(preparsedData, &Capabilities) != HIDP_STATUS_SUCCESS)
+    {
+        Close();
+        return E_ERR_IO;
+    }
+    if (usagePage >= 0 && Capabilities.UsagePage != usagePage)
+    {
+        // path is now used by other interface
+        Close();
+        return E_ERR_NOTFOUND;
+    }
+
+    this->usagePage = usagePage;
+    this->VID = deviceAttributes.VendorID;
+    this->PID = deviceAttributes.ProductID;
+    reportInLength = Capabilities.InputReportByteLength;
+    reportOutLength = Capabilities.OutputReportByteLength;
+    reportFeatureLength = Capabilities.FeatureReportByteLength;
+    HidD_FlushQueue(handle);
+
+    this->path = path;
+    int errorCode = CreateReadWriteHandles(path);
+    if (errorCode == 0)
+        errorCode = StartWriter();
+    if (errorCode != 0)
+        Close();
+    return errorCode;
+}
+
 bool HidDevice::IsOpened(void) const
 {
     return (handle != INVALID_HANDLE_VALUE);
@@ -251,7 +732,7 @@ int HidDevice::CreateReadWriteHandles(std::string path)
                               FILE_SHARE_READ|FILE_SHARE_WRITE,
                               (LPSECURITY_ATTRIBUTES)NULL,
                               OPEN_EXISTING,
-                              0,
+                              FILE_FLAG_OVERLAPPED,
                               NULL);
     if (writeHandle == INVALID_HANDLE_VALUE)
     {
@@ -329,6 +810,8 @@ int HidDevice::DumpCapabilities(std::string &dump)
 
 void HidDevice::Close(void)
 {
+    StopReading();
+    StopWriter();
     if (handle != INVALID_HANDLE_VALUE)
     {
         CloseHandle(handle);
@@ -344,54 +827,103 @@ void HidDevice::Close(void)
         CloseHandle(readHandle);
         readHandle = INVALID_HANDLE_VALUE;
     }
+    if (preparsedData)
+    {
+        HidD_FreePreparsedData(preparsedData);
+        preparsedData = NULL;
+    }
 }
 
-int HidDevice::WriteReport(enum E_REPORT_TYPE type, int id, const unsigned char *buffer, int len)
+int HidDevice::DoWrite(const WriteRequest &req)
 {
-    BOOL status = 0;
+    BOOL status = FALSE;
     DWORD bytesWritten = 0;
-    unsigned char sendbuf[65];
-    memset(sendbuf, 0, sizeof(sendbuf));
-    sendbuf[0] = id;
-    assert (len < (int)sizeof(sendbuf));
-    memcpy(sendbuf+1, buffer, std::min((int)sizeof(sendbuf)-1, len));
+    const char *name = (req.type == E_REPORT_FEATURE) ? "WriteReport (feature)" : "WriteReportOut";
 
-    switch (type)
+    OVERLAPPED *o = (OVERLAPPED*)pWriterOverlapped;
+    ResetEvent(o->hEvent);
+    o->Offset = 0;
+    o->OffsetHigh = 0;
+    SetLastError(0);
+    switch (req.type)
     {
-    case E_REPORT_IN:
-        return E_ERR_INV_PARAM;
     case E_REPORT_OUT:
-        status = WriteFile(writeHandle, sendbuf, len+1, &bytesWritten, NULL);
+        status = WriteFile(writeHandle, req.data, req.len, NULL, o);
         break;
     case E_REPORT_FEATURE:
-        status = HidD_SetFeature(handle, sendbuf, sizeof(sendbuf));
+        // overlapped equivalent of HidD_SetFeature(), so feature report (keepalive) cannot stall
+        // writer past its deadline; buffer length has to match FeatureReportByteLength
+        status = DeviceIoControl(writeHandle, IOCTL_HID_SET_FEATURE, const_cast<unsigned char*>(req.data), req.len,
+            NULL, 0, NULL, o);
         break;
     default:
         return E_ERR_INV_PARAM;
     }
-
+    if (!status)
+    {
+        DWORD dw = GetLastError();
+        if (dw != ERROR_IO_PENDING)
+        {
+            LOG("Error: %s, len = %d, HEX: %s, GetLastError = %d (%s)", name, req.len, BufToHexString(req.data, req.len).c_str(), dw, GetLastErrorMessage(dw).c_str());
+            return E_ERR_IO;
+        }
+    }
+    uint64_t now = Clock::GetTimeUs();
+    DWORD timeout = (req.deadlineUs > now) ? static_cast<DWORD>((req.deadlineUs - now + 999) / 1000) : 0;
+    if (WaitForSingleObject(o->hEvent, timeout) != WAIT_OBJECT_0)
+    {
+        CancelIo(writeHandle);
+        GetOverlappedResult(writeHandle, o, &bytesWritten, TRUE);
+        LOG("Error: %s timeout, len = %d, HEX: %s", name, req.len, BufToHexString(req.data, req.len).c_str());
+        return E_ERR_TIMEOUT;
+    }
+    status = GetOverlappedResult(writeHandle, o, &bytesWritten, FALSE);
     if (status == FALSE)
     {
         DWORD dw = GetLastError();
-        LOG("Error: WriteReport, len = %d, HEX: %s, GetLastError = %d (%s)", len+1, BufToHexString(sendbuf, len+1).c_str(), dw, GetLastErrorMessage(dw).c_str());
+        LOG("Error: %s, len = %d, HEX: %s, GetLastError = %d (%s)", name, req.len, BufToHexString(req.data, req.len).c_str(), dw, GetLastErrorMessage(dw).c_str());
     }
 
-    return status == 0 ? E_ERR_IO : 0;
+    return status == FALSE ? E_ERR_IO : 0;
 }
 
-int HidDevice::WriteReportOut(const unsigned char *buffer, int len)
+int HidDevice::StartWriter(void)
 {
-    BOOL status = FALSE;
-    DWORD   bytesWritten = 0;
+    StopWriter();
+    writerStopEvent.Reset();
+    writeTail = writeHead = writeReserved = 0;
+    reportBegun = false;
+    DWORD dwtid;
+    writerThread = CreateThread(NULL, 0, WriterThreadProc, this, 0, &dwtid);
+    if (writerThread == NULL)
+    {
+        LOG("Failed to create HID writer thread!");
+        return E_ERR_OTHER;
+    }
+    ScopedLock<Mutex> lock(writeMutex);
+    writerRunning = true;
+    return 0;
+}
 
-    SetLastError(0);
-    status = WriteFile(writeHandle, buffer, len, &bytesWritten, NULL);
-    if (status == FALSE)
+void HidDevice::StopWriter(void)
+{
     {
-        DWORD dw = GetLastError();
-        LOG("Error: WriteReportOut, len = %d, HEX: %s, GetLastError = %d (%s)", len, BufToHexString(buffer, len).c_str(), dw, GetLastErrorMessage(dw).c_str());
+        ScopedLock<Mutex> lock(writeMutex);
+        writerRunning = false;
     }
-    return status == FALSE ? E_ERR_IO : 0;
+    if (writerThread == NULL)
+        return;
+    writerStopEvent.Set();
+    WaitForSingleObject(writerThread, INFINITE);
+    CloseHandle(writerThread);
+    writerThread = NULL;
+}
+
+DWORD WINAPI HidDevice::WriterThreadProc(LPVOID data)
+{
+    HidDevice *dev = reinterpret_cast<HidDevice*>(data);
+    dev->WriterLoop();
+    return 0;
 }
 
 /* ------------------------------------------------------------------------ */
@@ -463,3 +995,113 @@ int HidDevice::ReadReport(enum E_REPORT_TYPE type, int id, char *buffer, int *le
     return status == 0 ? E_ERR_IO : 0;
 }
 
+
+/* ------------------------------------------------------------------------ */
+
+int HidDevice::StartReading(void)
+{
+    if (readHandle == INVALID_HANDLE_VALUE)
+        return E_ERR_NOTFOUND;
+    int size = GetReportLength(E_REPORT_IN) - 1;
+    if (size <= 0)
+        return E_ERR_INV_PARAM;
+
+    StopReading();
+    reports.Clear();
+    readerReportSize = size;
+    readerFailed = false;
+    readerStopEvent.Reset();
+
+    DWORD dwtid;
+    readerThread = CreateThread(NULL, 0, ReaderThreadProc, this, 0, &dwtid);
+    if (readerThread == NULL)
+    {
+        LOG("Failed to create HID reader thread!");
+        return E_ERR_OTHER;
+    }
+    return 0;
+}
+
+void HidDevice::StopReading(void)
+{
+    if (readerThread == NULL)
+        return;
+    readerStopEvent.Set();
+    WaitForSingleObject(readerThread, INFINITE);
+    CloseHandle(readerThread);
+    readerThread = NULL;
+}
+
+DWORD WINAPI HidDevice::ReaderThreadProc(LPVOID data)
+{
+    HidDevice *dev = reinterpret_cast<HidDevice*>(data);
+    dev->ReaderLoop();
+    return 0;
+}
+
+void HidDevice::ReaderLoop(void)
+{
+    OVERLAPPED *o = (OVERLAPPED*)pReaderOverlapped;
+    HANDLE handles[2] = { o->hEvent, readerStopEvent.GetHandle() };
+    HidReport overflow;     // target for reads when ring is full, report is then dropped
+
+    for (;;)
+    {
+        // read directly into ring slot
+        HidReport *report = reports.Reserve();
+        if (report == NULL)
+            report = &overflow;
+        DWORD bytesRead = 0;
+        ResetEvent(o->hEvent);
+        o->Offset = 0;
+        o->OffsetHigh = 0;
+        if (!ReadFile(readHandle, report->raw, readerReportSize + 1, NULL, o))
+        {
+            DWORD dw = GetLastError();
+            if (dw != ERROR_IO_PENDING)
+            {
+                LOG("Error: reader ReadFile, GetLastError = %d (%s)", dw, GetLastErrorMessage(dw).c_str());
+                readerFailed = true;
+                break;
+            }
+        }
+
+        DWORD result = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+        if (result != WAIT_OBJECT_0)
+        {
+            // stop requested (or wait failure): read is still pending, cancel it before buffer is released
+            CancelIo(readHandle);
+            GetOverlappedResult(readHandle, o, &bytesRead, TRUE);
+            if (result != WAIT_OBJECT_0 + 1)
+                readerFailed = true;
+            break;
+        }
+
+        if (!GetOverlappedResult(readHandle, o, &bytesRead, FALSE))
+        {
+            DWORD dw = GetLastError();
+            LOG("Error: reader GetOverlappedResult, GetLastError = %d (%s)", dw, GetLastErrorMessage(dw).c_str());
+            readerFailed = true;
+            break;
+        }
+
+        report->timestampUs = Clock::GetTimeUs();
+        // as with ReadReport: device may return shorter report (InputReportByteLength includes ID),
+        // missing bytes are zeroed
+        report->size = readerReportSize;
+        if (bytesRead < static_cast<DWORD>(readerReportSize + 1))
+            memset(report->raw + bytesRead, 0, readerReportSize + 1 - bytesRead);
+        if (report == &overflow)
+        {
+            droppedReports++;
+            continue;
+        }
+        reports.Commit();
+        reportEvent.Set();
+    }
+
+    // wake up consumer so it could notice failure
+    reportEvent.Set();
+}
+
+#endif  // _WIN32
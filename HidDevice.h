@@ -15,31 +15,100 @@
 #ifndef HIDDEVICE_H_INCLUDED
 #define HIDDEVICE_H_INCLUDED
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <ddk/hidusage.h>
 #include <ddk/hidpi.h>
 #include <windef.h>
+#else
+#include <pthread.h>
+#endif
+#include <stdint.h>
 #include <string>
+#include <vector>
+#include <map>
+#include "SpscRing.h"
+#include "Event.h"
+#include "Mutex.h"
 
 namespace nsHidDevice {
 
+    /** \brief Input report received by reader thread
+        \note Reader thread reads directly into ring slot, so report is stored as transferred:
+        report ID (0 if device does not use IDs) followed by report data.
+    */
+    struct HidReport
+    {
+        enum { MAX_SIZE = 64 };
+        uint8_t raw[1 + MAX_SIZE];  ///< report ID + report
+        int size;                   ///< report size without report ID, from device capabilities
+        uint64_t timestampUs;       ///< read completion time, Clock::GetTimeUs()
+        uint8_t GetId(void) const {
+            return raw[0];
+        }
+        /** \brief Report without report ID */
+        const uint8_t* GetData(void) const {
+            return raw + 1;
+        }
+    };
+
+#ifndef _WIN32
+    class SimulatedDevice;
+#endif
+
     class HidDevice {
+    public:
+        /** \brief Completion callback for queued writes, called from writer thread
+            \param status 0 on success, E_ERR_TIMEOUT if deadline passed
+        */
+        typedef void (*WriteCallback)(void *opaque, int status);
+
     private:
+#ifdef _WIN32
         HANDLE handle;
         HANDLE readHandle;
         HANDLE writeHandle;
         HANDLE hEventObject;
         void* pOverlapped;
         GUID hidGuid;        /* GUID for HID driver */
+        PHIDP_PREPARSED_DATA preparsedData;
+#else
+        int fd;                 ///< /dev/hidrawN
+        bool numberedReports;   ///< report descriptor contains Report ID items
+        SimulatedDevice *simulated;     ///< opened instead of hidraw node, NULL for real device
+#endif
         int VID, PID;
         std::string path;
         int usagePage;
-        PHIDP_PREPARSED_DATA preparsedData;
-        unsigned long reportInLength;
+        unsigned long reportInLength;       ///< including report ID, as HIDP_CAPS
         unsigned long reportOutLength;
+        unsigned long reportFeatureLength;
 
+        enum { REPORT_RING_SIZE = 64 };
+#ifdef _WIN32
+        HANDLE readerThread;
+        void* pReaderOverlapped;
+        static DWORD WINAPI ReaderThreadProc(LPVOID data);
+        HANDLE writerThread;
+        void* pWriterOverlapped;
+        static DWORD WINAPI WriterThreadProc(LPVOID data);
         int CreateReadWriteHandles(std::string path);
+#else
+        pthread_t readerThread;
+        bool readerRunning;
+        static void* ReaderThreadProc(void *data);
+        pthread_t writerThread;
+        static void* WriterThreadProc(void *data);
+#endif
+        Event readerStopEvent;
+        Event reportEvent;              ///< signaled when report is pushed to ring
+        int readerReportSize;
+        volatile bool readerFailed;
+        volatile unsigned int droppedReports;
+        SpscRing<HidReport, REPORT_RING_SIZE> reports;
+
+        void ReaderLoop(void);
 
         HidDevice(const HidDevice& source) {};
         HidDevice& operator=(const HidDevice&);
@@ -54,6 +123,7 @@ namespace nsHidDevice {
             E_ERR_IO,
             E_ERR_TIMEOUT,
             E_ERR_OTHER,
+            E_ERR_QUEUE_FULL,
             E_ERR_LIMIT // dummy
         };
         typedef struct
@@ -74,10 +144,29 @@ namespace nsHidDevice {
         HidDevice(void);
         ~HidDevice(void);
 
+#ifdef _WIN32
         void GetHidGuid(GUID *guid) const;
         HANDLE GetHandle(void) const {
             return handle;
         }
+        /** \brief Preparsed data of opened device, valid until Close()
+        */
+        PHIDP_PREPARSED_DATA GetPreparsedData(void) const {
+            return preparsedData;
+        }
+#else
+        /** \brief Read report descriptor of opened device
+            \return 0 on success
+        */
+        int GetReportDescriptor(std::vector<uint8_t> &desc) const;
+
+        /** \brief Register device simulated in process: OpenPath() of this path opens it
+            instead of hidraw node
+            \note Not synchronized - register before and remove after device is used.
+        */
+        static void AddSimulated(const std::string &path, SimulatedDevice *device);
+        static void RemoveSimulated(const std::string &path);
+#endif
 
         std::string GetPath(void) const {
             return path;
@@ -85,6 +174,8 @@ namespace nsHidDevice {
 
 
         /** \brief Search and open device with specified parameters
+            \note On Linux /dev/hidraw* nodes are searched through sysfs;
+            vendorName and productName are then matched against HID_NAME (manufacturer + product).
             \param VID required Vendor ID
             \param PID required Product ID
             \param vendorName required vendor name string, ignored if NULL
@@ -93,6 +184,26 @@ namespace nsHidDevice {
         */
         int Open(int VID, int PID, char *vendorName, char *productName, int usagePage);
 
+        /** \brief Interfaces of single physical device: paths keyed by usage page of top level collection
+        */
+        typedef std::map<int, std::string> InterfaceMap;
+
+        /** \brief Find all interfaces of devices with specified VID/PID in single pass over HID device list
+            \note On Windows only interfaces with matching VID/PID in device path are opened
+            to read their capabilities, so cost depends on number of matching interfaces.
+            \param devices found interfaces grouped by parent (USB) device: on Windows device
+                instance ID of USB device (e.g. USB\VID_095D&PID_9201\5&1A2B3C4&0&2),
+                on Linux name of USB device in sysfs (bus-port, e.g. 1-2.4)
+            \return 0 if at least one interface was found
+        */
+        static int Enumerate(int VID, int PID, std::map<std::string, InterfaceMap> &devices);
+
+        /** \brief Open device with known path (e.g. from Enumerate() or remembered from previous connection)
+            \param usagePage required usage page, ignored if < 0
+            \return 0 on success, E_ERR_NOTFOUND if device is not present (anymore) under this path
+        */
+        int OpenPath(const std::string &path, int usagePage);
+
         bool IsOpened(void) const;
 
         /** \brief Dump device capabilities as text
@@ -100,19 +211,140 @@ namespace nsHidDevice {
         */
         int DumpCapabilities(std::string &dump);
 
-        /** \brief Write report to device
+        enum { DEFAULT_WRITE_TIMEOUT = 1000 };  ///< [ms], used by blocking write functions
+
+        /** \brief Report length from device capabilities
+            \return length including report ID byte, 0 if device has no reports of this type
+        */
+        int GetReportLength(enum E_REPORT_TYPE type) const;
+
+        /** \brief Write report to device, waiting for completion
             \return 0 on success
+            \note Linux: feature reports are not accepted (E_ERR_INV_PARAM) - their write is not
+            bounded by timeout (see SubmitReport()), so waiting for it could block caller.
         */
         int WriteReport(enum E_REPORT_TYPE type, int id, const unsigned char *buffer, int len);
 
         /** \brief Read report from device
             \param timeout operation timeout [ms]
             \return 0 on success
+            \note Do not read input reports this way while reader thread is running
         */
         int ReadReport(enum E_REPORT_TYPE type, int id, char *buffer, int *len, int timeout);
 
+        /** \brief Write OUT report (buffer[0] = report ID) to device, waiting for completion
+            \return 0 on success
+        */
         int WriteReportOut(const unsigned char *buffer, int len);
 
+        /** \brief Get write queue slot to fill report in place
+            \param type E_REPORT_OUT or E_REPORT_FEATURE
+            \param id report ID, already stored in front of returned buffer
+            \param data receives zeroed report buffer (after report ID)
+            \param size receives report size without report ID, from device capabilities
+            \return 0 on success, E_ERR_QUEUE_FULL if there is no free slot
+            \note Each BeginReport() must be followed by CommitReport() or CancelReports();
+                queue has single producer - call it from one thread only.
+        */
+        int BeginReport(enum E_REPORT_TYPE type, int id, uint8_t **data, int *size);
+
+        /** \brief Queue report filled after BeginReport()
+            \param len used part of report (without report ID) for OUT report,
+                transferred length; ignored for feature report, which is always sent in full size
+            \param timeout see SubmitReport()
+            \param frameEnd false if more reports of the same frame follow: frame is passed
+                to writer thread at once when its last report is committed (see SubmitFrameOut())
+            \return 0 if report was queued
+        */
+        int CommitReport(int len, unsigned int timeout, WriteCallback callback, void *opaque, bool frameEnd = true);
+
+        /** \brief Drop reports of frame that was not completed with CommitReport()
+        */
+        void CancelReports(void);
+
+        /** \brief Queue report for writing without waiting for completion
+            \note Reports are written by writer thread in submission order.
+            Report is copied into queue slot, see BeginReport() to fill it in place.
+            \param timeout deadline for the write [ms], counted from submission;
+                report that cannot be written within it is completed with E_ERR_TIMEOUT
+            \param callback completion callback, may be NULL
+            \return 0 if report was queued
+            \note Linux: feature report is written with blocking HIDIOCSFEATURE ioctl and deadline is
+            checked only before it - the write is unbounded (kernel waits for USB control transfer,
+            usually up to 5 s) and delays reports queued behind it on this interface.
+        */
+        int SubmitReport(enum E_REPORT_TYPE type, int id, const unsigned char *buffer, int len,
+            unsigned int timeout, WriteCallback callback, void *opaque);
+
+        /** \brief Queue OUT report (buffer[0] = report ID), see SubmitReport()
+        */
+        int SubmitReportOut(const unsigned char *buffer, int len,
+            unsigned int timeout, WriteCallback callback, void *opaque);
+
+        /** \brief Queue sequence of OUT reports at once
+            \param buffer reports (each starting with report ID) placed one after another
+            \param lengths length of each report
+            \param count number of reports
+            \note Callback is called once: after last report or on first failure;
+                remaining reports of failed frame are dropped.
+        */
+        int SubmitFrameOut(const unsigned char *buffer, const int *lengths, int count,
+            unsigned int timeout, WriteCallback callback, void *opaque);
+
+        /** \brief Wait until writer is done with all queued reports (written, failed or dropped)
+            \param timeout [ms]
+            \return 0 if write queue is empty, E_ERR_TIMEOUT otherwise
+            \note Do not call from write completion callback.
+        */
+        int Flush(unsigned int timeout);
+
+        /** \brief Start thread keeping overlapped input report read pending all the time
+            \note Reports are read with input report length from device capabilities.
+            \return 0 on success
+        */
+        int StartReading(void);
+
+        /** \brief Stop reader thread, called also by Close()
+        */
+        void StopReading(void);
+
+        /** \brief Take oldest input report received by reader thread
+            \return false if there is no report waiting
+        */
+        bool GetReport(HidReport &report);
+
+        /** \brief Access oldest input report in place, without copying
+            \return NULL if there is no report waiting; otherwise report stays valid
+            until ReleaseReport()
+        */
+        const HidReport* PeekReport(void) const {
+            return reports.Front();
+        }
+
+        /** \brief Free report returned by PeekReport()
+        */
+        void ReleaseReport(void) {
+            reports.Release();
+        }
+
+        /** \brief Event signaled (auto-reset) when new report is available
+        */
+        Event& GetReportEvent(void) {
+            return reportEvent;
+        }
+
+        /** \brief Check if reader thread stopped because of I/O error (e.g. device disconnected)
+        */
+        bool IsReadingFailed(void) const {
+            return readerFailed;
+        }
+
+        /** \brief Number of reports lost because of ring overflow
+        */
+        unsigned int GetDroppedReports(void) const {
+            return droppedReports;
+        }
+
         /** \brief Close connection to device
         */
         void Close(void);
@@ -127,7 +359,89 @@ namespace nsHidDevice {
         int GetUsagePage(void) const {
             return usagePage;
         }
+
+    private:
+        struct WriteRequest
+        {
+            enum E_REPORT_TYPE type;
+            unsigned char data[1 + HidReport::MAX_SIZE];    ///< report ID + report
+            int len;                ///< transferred length, including report ID
+            int size;               ///< capacity from device capabilities, including report ID
+            uint64_t deadlineUs;
+            unsigned int frame;     ///< requests submitted together share frame number
+            bool frameEnd;
+            WriteCallback callback;
+            void *opaque;
+        };
+        enum { WRITE_QUEUE_SIZE = 256 };    ///< must be power of 2
+        Mutex writeMutex;
+        /** \brief Write queue: slots are filled in place by producer and written from place by writer thread.
+            Slots [writeTail, writeHead) are queued, [writeHead, writeReserved) belong to frame being filled.
+        */
+        WriteRequest writeSlots[WRITE_QUEUE_SIZE];
+        unsigned int writeTail;
+        unsigned int writeHead;
+        unsigned int writeReserved;
+        bool reportBegun;           ///< BeginReport() called, CommitReport() not yet
+        unsigned int writeFrame;
+        bool writerRunning;
+        Event writeEvent;
+        Event writerStopEvent;
+        Event writeIdleEvent;       ///< signaled when writer empties queue
+        Mutex syncWriteMutex;
+        Event syncWriteDone;
+        volatile int syncWriteStatus;
+        /** Blocking writes queued and completed; completions come in queue order, so WriteSync()
+            waiting for its ticket is not confused by late completion of write that timed out before */
+        unsigned int syncWritesIssued;
+        unsigned int syncWritesCompleted;
+        /** Time WriteSync() waits after request deadline, for writer to report completion [ms] */
+        enum { SYNC_WRITE_MARGIN = 200 };
+
+        int StartWriter(void);
+        void StopWriter(void);
+        void WriterLoop(void);
+        /** \brief Platform specific, blocking write of single request within its deadline */
+        int DoWrite(const WriteRequest &req);
+        /** \brief Copy report into queue slot and commit it
+            \param id report ID, -1 if buffer already starts with report ID
+        */
+        int QueueCopy(enum E_REPORT_TYPE type, int id, const unsigned char *buffer, int len,
+            unsigned int timeout, WriteCallback callback, void *opaque, bool frameEnd);
+        int WriteSync(enum E_REPORT_TYPE type, int id, const unsigned char *buffer, int len);
+        static void SyncWriteCallback(void *opaque, int status);
+    };
+
+#ifndef _WIN32
+    /** \brief Device implemented in process instead of hidraw node (report replay)
+        \note Registered with HidDevice::AddSimulated(), opened with HidDevice::OpenPath().
+        Capabilities are taken from report descriptor. Written reports pass through write queue
+        and writer thread as for real device. There is no reader thread - input reports are
+        passed to report handling by owner.
+    */
+    class SimulatedDevice
+    {
+    public:
+        SimulatedDevice(void):
+            device(NULL)
+        {}
+        virtual ~SimulatedDevice(void) {}
+        virtual void GetReportDescriptor(std::vector<uint8_t> &desc) const = 0;
+        /** \brief Write report, called from writer thread
+            \param report report ID + report
+            \param len length including report ID
+            \return 0 on success
+        */
+        virtual int Write(enum HidDevice::E_REPORT_TYPE type, const uint8_t *report, int len) = 0;
+        /** \brief HidDevice this device is opened with, NULL if closed */
+        HidDevice* GetDevice(void) const {
+            return device;
+        }
+    private:
+        friend class HidDevice;
+        HidDevice *device;
     };
+#endif
 
 };
 
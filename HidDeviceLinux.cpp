@@ -0,0 +1,747 @@
+/** \file
+    \brief Linux (hidraw) implementation of HidDevice
+*/
+
+#ifndef _WIN32
+
+#include "HidDevice.h"
+#include "Log.h"
+#include "Clock.h"
+#include "bin2str.h"
+#include "ScopedLock.h"
+
+#include <linux/hidraw.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <assert.h>
+
+using namespace nsHidDevice;
+using namespace std;
+
+
+namespace
+{
+
+const char* const SYSFS_HIDRAW = "/sys/class/hidraw";
+
+/** \brief Information extracted from report descriptor
+    \note Lengths are calculated the same way as HIDP_CAPS fields: largest report + 1 byte for report ID
+*/
+struct DescriptorSummary
+{
+    int usagePage;          ///< usage page of first top level collection
+    bool numberedReports;
+    unsigned int inputLength;
+    unsigned int outputLength;
+    unsigned int featureLength;
+};
+
+unsigned int ItemValue(const uint8_t *data, int size)
+{
+    unsigned int value = 0;
+    for (int i=0; i<size; i++)
+        value |= static_cast<unsigned int>(data[i]) << (8*i);
+    return value;
+}
+
+void SummarizeDescriptor(const std::vector<uint8_t> &desc, DescriptorSummary &summary)
+{
+    enum { MAX_REPORT_ID = 256 };
+    std::vector<unsigned int> inBits(MAX_REPORT_ID, 0), outBits(MAX_REPORT_ID, 0), featureBits(MAX_REPORT_ID, 0);
+    unsigned int usagePage = 0, reportSize = 0, reportCount = 0, reportId = 0;
+    int depth = 0;
+
+    summary.usagePage = -1;
+    summary.numberedReports = false;
+
+    for (unsigned int i=0; i<desc.size(); )
+    {
+        uint8_t prefix = desc[i];
+        if (prefix == 0xFE)
+        {
+            // long item: prefix, size, tag, data
+            if (i + 1 >= desc.size())
+                break;
+            i += 3 + desc[i+1];
+            continue;
+        }
+        int size = prefix & 0x03;
+        if (size == 3)
+            size = 4;
+        if (i + 1 + size > desc.size())
+            break;
+        int type = (prefix >> 2) & 0x03;
+        int tag = (prefix >> 4) & 0x0F;
+        unsigned int value = ItemValue(&desc[i+1], size);
+        i += 1 + size;
+
+        if (type == 0)          // main
+        {
+            switch (tag)
+            {
+            case 0x08:
+                inBits[reportId] += reportSize * reportCount;
+                break;
+            case 0x09:
+                outBits[reportId] += reportSize * reportCount;
+                break;
+            case 0x0B:
+                featureBits[reportId] += reportSize * reportCount;
+                break;
+            case 0x0A:
+                if (depth == 0 && summary.usagePage < 0)
+                    summary.usagePage = usagePage;
+                depth++;
+                break;
+            case 0x0C:
+                if (depth > 0)
+                    depth--;
+                break;
+            default:
+                break;
+            }
+        }
+        else if (type == 1)     // global
+        {
+            switch (tag)
+            {
+            case 0x00:
+                usagePage = value;
+                break;
+            case 0x07:
+                reportSize = value;
+                break;
+            case 0x08:
+                reportId = value & 0xFF;
+                summary.numberedReports = true;
+                break;
+            case 0x09:
+                reportCount = value;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    summary.inputLength = summary.outputLength = summary.featureLength = 0;
+    for (unsigned int id=0; id<MAX_REPORT_ID; id++)
+    {
+        summary.inputLength = std::max(summary.inputLength, (inBits[id] + 7) / 8);
+        summary.outputLength = std::max(summary.outputLength, (outBits[id] + 7) / 8);
+        summary.featureLength = std::max(summary.featureLength, (featureBits[id] + 7) / 8);
+    }
+    if (summary.inputLength)
+        summary.inputLength++;
+    if (summary.outputLength)
+        summary.outputLength++;
+    if (summary.featureLength)
+        summary.featureLength++;
+}
+
+bool ReadFileContent(const std::string &filename, std::vector<uint8_t> &content)
+{
+    std::ifstream ifs(filename.c_str(), std::ios::binary);
+    if (!ifs)
+        return false;
+    content.assign((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    return true;
+}
+
+/** \brief Read HID_ID and HID_NAME from hidraw parent device uevent
+*/
+bool ReadUevent(const std::string &node, int &vid, int &pid, std::string &name)
+{
+    std::ifstream ifs((std::string(SYSFS_HIDRAW) + "/" + node + "/device/uevent").c_str());
+    if (!ifs)
+        return false;
+    bool idFound = false;
+    std::string line;
+    while (std::getline(ifs, line))
+    {
+        if (line.compare(0, 7, "HID_ID=") == 0)
+        {
+            unsigned int bus, v, p;
+            if (sscanf(line.c_str() + 7, "%x:%x:%x", &bus, &v, &p) == 3)
+            {
+                vid = v;
+                pid = p;
+                idFound = true;
+            }
+        }
+        else if (line.compare(0, 9, "HID_NAME=") == 0)
+        {
+            name = line.substr(9);
+        }
+    }
+    return idFound;
+}
+
+std::string DescriptorPath(const std::string &devPath)
+{
+    // /dev/hidrawN -> /sys/class/hidraw/hidrawN/device/report_descriptor
+    std::string::size_type slash = devPath.rfind('/');
+    std::string node = (slash == std::string::npos) ? devPath : devPath.substr(slash + 1);
+    return std::string(SYSFS_HIDRAW) + "/" + node + "/device/report_descriptor";
+}
+
+/** \brief Name of USB device the hidraw node belongs to
+    \note /sys/class/hidraw/hidrawN/device -> .../usb1/1-2/1-2:1.3/0003:095D:9201.0005,
+    USB device is parent of USB interface (1-2); node name is returned if path is different
+*/
+std::string UsbDeviceName(const std::string &node)
+{
+    std::string link = std::string(SYSFS_HIDRAW) + "/" + node + "/device";
+    char *resolved = realpath(link.c_str(), NULL);
+    if (resolved == NULL)
+        return node;
+    std::string path = resolved;
+    free(resolved);
+    for (int i=0; i<2; i++)
+    {
+        std::string::size_type slash = path.rfind('/');
+        if (slash == std::string::npos || slash == 0)
+            return node;
+        path.erase(slash);
+    }
+    std::string::size_type slash = path.rfind('/');
+    return path.substr(slash + 1);
+}
+
+/** \brief List hidraw nodes (hidraw0, hidraw1, ...) in stable order
+*/
+int ListNodes(std::vector<std::string> &nodes)
+{
+    DIR *dir = opendir(SYSFS_HIDRAW);
+    if (dir == NULL)
+    {
+        LOG("Failed to open %s: %s", SYSFS_HIDRAW, strerror(errno));
+        return -1;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strncmp(entry->d_name, "hidraw", 6) == 0)
+            nodes.push_back(entry->d_name);
+    }
+    closedir(dir);
+    std::sort(nodes.begin(), nodes.end());
+    return 0;
+}
+
+typedef std::map<std::string, SimulatedDevice*> SimulatedDevices;
+
+SimulatedDevices& GetSimulatedDevices(void)
+{
+    static SimulatedDevices devices;
+    return devices;
+}
+
+}   // namespace
+
+
+HidDevice::HidDevice(void):
+    fd(-1),
+    numberedReports(false),
+    simulated(NULL),
+    VID(0),
+    PID(0),
+    usagePage(-1),
+    reportInLength(0),
+    reportOutLength(0),
+    reportFeatureLength(0),
+    readerRunning(false),
+    readerStopEvent(true),
+    readerReportSize(0),
+    readerFailed(false),
+    droppedReports(0),
+    writeTail(0),
+    writeHead(0),
+    writeReserved(0),
+    reportBegun(false),
+    writeFrame(0),
+    writerRunning(false),
+    writerStopEvent(true),
+    syncWriteStatus(0),
+    syncWritesIssued(0),
+    syncWritesCompleted(0)
+{
+}
+
+HidDevice::~HidDevice(void)
+{
+    Close();
+}
+
+int HidDevice::Open(int VID, int PID, char *vendorName, char *productName, int usagePage)
+{
+    int errorCode = E_ERR_NOTFOUND;
+
+    Close();
+    this->usagePage = usagePage;
+
+    std::vector<std::string> nodes;
+    if (ListNodes(nodes) != 0)
+        return E_ERR_NOTFOUND;
+
+    for (unsigned int i=0; i<nodes.size(); i++)
+    {
+        int devVid = 0, devPid = 0;
+        std::string name;
+        if (!ReadUevent(nodes[i], devVid, devPid, name))
+            continue;
+        if (VID != 0 && devVid != VID)
+            continue;
+        if (PID != 0 && devPid != PID)
+            continue;
+        // HID_NAME is "manufacturer product"
+        if (vendorName != NULL && name.find(vendorName) == std::string::npos)
+            continue;
+        if (productName != NULL && name.find(productName) == std::string::npos)
+            continue;
+
+        errorCode = OpenPath(std::string("/dev/") + nodes[i], usagePage);
+        if (errorCode == 0)
+            break;
+    }
+
+    return errorCode;
+}
+
+int HidDevice::Enumerate(int VID, int PID, std::map<std::string, InterfaceMap> &devices)
+{
+    devices.clear();
+    std::vector<std::string> nodes;
+    if (ListNodes(nodes) != 0)
+        return E_ERR_NOTFOUND;
+
+    for (unsigned int i=0; i<nodes.size(); i++)
+    {
+        // uevent is cheap to read - descriptor is parsed only for matching devices
+        int devVid = 0, devPid = 0;
+        std::string name;
+        if (!ReadUevent(nodes[i], devVid, devPid, name))
+            continue;
+        if (VID != 0 && devVid != VID)
+            continue;
+        if (PID != 0 && devPid != PID)
+            continue;
+        std::string devPath = std::string("/dev/") + nodes[i];
+        std::vector<uint8_t> desc;
+        if (!ReadFileContent(DescriptorPath(devPath), desc))
+            continue;
+        DescriptorSummary summary;
+        SummarizeDescriptor(desc, summary);
+        if (summary.usagePage < 0)
+            continue;
+        InterfaceMap &interfaces = devices[UsbDeviceName(nodes[i])];
+        if (interfaces.find(summary.usagePage) == interfaces.end())
+            interfaces[summary.usagePage] = devPath;
+    }
+
+    return devices.empty() ? E_ERR_NOTFOUND : 0;
+}
+
+void HidDevice::AddSimulated(const std::string &path, SimulatedDevice *device)
+{
+    GetSimulatedDevices()[path] = device;
+}
+
+void HidDevice::RemoveSimulated(const std::string &path)
+{
+    GetSimulatedDevices().erase(path);
+}
+
+int HidDevice::OpenPath(const std::string &path, int usagePage)
+{
+    Close();
+
+    SimulatedDevices::const_iterator iter = GetSimulatedDevices().find(path);
+    if (iter != GetSimulatedDevices().end())
+    {
+        std::vector<uint8_t> desc;
+        iter->second->GetReportDescriptor(desc);
+        DescriptorSummary summary;
+        SummarizeDescriptor(desc, summary);
+        if (usagePage >= 0 && summary.usagePage != usagePage)
+            return E_ERR_NOTFOUND;
+        simulated = iter->second;
+        simulated->device = this;
+        this->usagePage = usagePage;
+        numberedReports = summary.numberedReports;
+        reportInLength = summary.inputLength;
+        reportOutLength = summary.outputLength;
+        reportFeatureLength = summary.featureLength;
+        this->path = path;
+        int errorCode = StartWriter();
+        if (errorCode != 0)
+            Close();
+        return errorCode;
+    }
+
+    std::string::size_type slash = path.rfind('/');
+    std::string node = (slash == std::string::npos) ? path : path.substr(slash + 1);
+    int devVid = 0, devPid = 0;
+    std::string name;
+    if (!ReadUevent(node, devVid, devPid, name))
+        return E_ERR_NOTFOUND;
+    std::vector<uint8_t> desc;
+    if (!ReadFileContent(DescriptorPath(path), desc))
+        return E_ERR_IO;
+    DescriptorSummary summary;
+    SummarizeDescriptor(desc, summary);
+    if (usagePage >= 0)
+    {
+        LOG("Device UsagePage = 0x%X", summary.usagePage);
+        if (summary.usagePage != usagePage)
+            return E_ERR_NOTFOUND;
+    }
+
+    // non-blocking: reads and writes are waited for with poll() to honor timeouts
+    fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG("Failed to open %s: %s", path.c_str(), strerror(errno));
+        return (errno == ENOENT) ? E_ERR_NOTFOUND : E_ERR_IO;
+    }
+
+    this->usagePage = usagePage;
+    this->VID = devVid;
+    this->PID = devPid;
+    numberedReports = summary.numberedReports;
+    reportInLength = summary.inputLength;
+    reportOutLength = summary.outputLength;
+    reportFeatureLength = summary.featureLength;
+    this->path = path;
+    int errorCode = StartWriter();
+    if (errorCode != 0)
+        Close();
+    return errorCode;
+}
+
+bool HidDevice::IsOpened(void) const
+{
+    return (fd >= 0 || simulated != NULL);
+}
+
+int HidDevice::GetReportDescriptor(std::vector<uint8_t> &desc) const
+{
+    if (simulated)
+    {
+        simulated->GetReportDescriptor(desc);
+        return 0;
+    }
+    if (fd < 0)
+        return E_ERR_INV_PARAM;
+    int size = 0;
+    if (ioctl(fd, HIDIOCGRDESCSIZE, &size) < 0 || size <= 0)
+    {
+        LOG("HIDIOCGRDESCSIZE failed: %s", strerror(errno));
+        return E_ERR_IO;
+    }
+    struct hidraw_report_descriptor rd;
+    memset(&rd, 0, sizeof(rd));
+    rd.size = size;
+    if (ioctl(fd, HIDIOCGRDESC, &rd) < 0)
+    {
+        LOG("HIDIOCGRDESC failed: %s", strerror(errno));
+        return E_ERR_IO;
+    }
+    desc.assign(rd.value, rd.value + rd.size);
+    return 0;
+}
+
+int HidDevice::DumpCapabilities(std::string &dump)
+{
+    std::vector<uint8_t> desc;
+    if (simulated)
+        simulated->GetReportDescriptor(desc);
+    else if (!ReadFileContent(DescriptorPath(path), desc))
+        return E_ERR_IO;
+    DescriptorSummary summary;
+    SummarizeDescriptor(desc, summary);
+
+    std::stringstream stream;
+    stream << "Path: " << path << endl;
+    stream << "Usage Page: 0x" << hex << summary.usagePage << endl;
+    stream << dec;
+    stream << "Input Report Byte Length: " << summary.inputLength << endl;
+    stream << "Output Report Byte Length: " << summary.outputLength << endl;
+    stream << "Feature Report Byte Length: " << summary.featureLength << endl;
+    stream << "Numbered reports: " << (summary.numberedReports ? "yes" : "no") << endl;
+    stream << "Report descriptor: " << BufToHexString(&desc[0], desc.size()) << endl;
+
+    dump = stream.str();
+    return 0;
+}
+
+void HidDevice::Close(void)
+{
+    StopReading();
+    StopWriter();
+    if (fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    if (simulated)
+    {
+        simulated->device = NULL;
+        simulated = NULL;
+    }
+}
+
+int HidDevice::DoWrite(const WriteRequest &req)
+{
+    if (simulated)
+        return simulated->Write(req.type, req.data, req.len);
+    int rc;
+    switch (req.type)
+    {
+    case E_REPORT_OUT:
+        for (;;)
+        {
+            rc = write(fd, req.data, req.len);
+            if (rc >= 0 || (errno != EAGAIN && errno != EINTR))
+                break;
+            uint64_t now = Clock::GetTimeUs();
+            if (now >= req.deadlineUs)
+            {
+                LOG("Error: WriteReportOut timeout, len = %d, HEX: %s", req.len, BufToHexString(req.data, req.len).c_str());
+                return E_ERR_TIMEOUT;
+            }
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            poll(&pfd, 1, static_cast<int>((req.deadlineUs - now + 999) / 1000));
+        }
+        if (rc < 0)
+        {
+            LOG("Error: WriteReportOut, len = %d, HEX: %s, errno = %d (%s)", req.len, BufToHexString(req.data, req.len).c_str(), errno, strerror(errno));
+            return E_ERR_IO;
+        }
+        return 0;
+    case E_REPORT_FEATURE:
+        // synchronous ioctl, unbounded: deadline is only checked before the call (see SubmitReport())
+        rc = ioctl(fd, HIDIOCSFEATURE(req.len), req.data);
+        if (rc < 0)
+        {
+            LOG("Error: WriteReport, len = %d, HEX: %s, errno = %d (%s)", req.len, BufToHexString(req.data, req.len).c_str(), errno, strerror(errno));
+            return E_ERR_IO;
+        }
+        return 0;
+    default:
+        return E_ERR_INV_PARAM;
+    }
+}
+
+int HidDevice::StartWriter(void)
+{
+    StopWriter();
+    writerStopEvent.Reset();
+    writeTail = writeHead = writeReserved = 0;
+    reportBegun = false;
+    if (pthread_create(&writerThread, NULL, WriterThreadProc, this) != 0)
+    {
+        LOG("Failed to create HID writer thread!");
+        return E_ERR_OTHER;
+    }
+    ScopedLock<Mutex> lock(writeMutex);
+    writerRunning = true;
+    return 0;
+}
+
+void HidDevice::StopWriter(void)
+{
+    {
+        ScopedLock<Mutex> lock(writeMutex);
+        if (!writerRunning)
+            return;
+        writerRunning = false;
+    }
+    writerStopEvent.Set();
+    pthread_join(writerThread, NULL);
+}
+
+void* HidDevice::WriterThreadProc(void *data)
+{
+    HidDevice *dev = reinterpret_cast<HidDevice*>(data);
+    dev->WriterLoop();
+    return NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+
+int HidDevice::ReadReport(enum E_REPORT_TYPE type, int id, char *buffer, int *len, int timeout)
+{
+    int outBufSize = *len;
+
+    unsigned char rcvbuf[65];
+    memset(rcvbuf, 0, sizeof(rcvbuf));
+    rcvbuf[0] = id;
+    assert (*len < (int)sizeof(rcvbuf));
+
+    switch (type)
+    {
+    case E_REPORT_IN:
+    {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int rc = poll(&pfd, 1, timeout);
+        if (rc == 0)
+            return E_ERR_TIMEOUT;
+        if (rc < 0 || (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)))
+            return E_ERR_IO;
+        // without report IDs hidraw returns data only, keep it at the same offset as on Windows
+        unsigned char *dst = numberedReports ? rcvbuf : rcvbuf + 1;
+        rc = read(fd, dst, sizeof(rcvbuf) - 1);
+        if (rc < 0)
+        {
+            LOG("Error: ReadReport, errno = %d (%s)", errno, strerror(errno));
+            return E_ERR_IO;
+        }
+        *len = outBufSize;
+        memcpy(buffer, rcvbuf+1, *len);
+        return 0;
+    }
+    case E_REPORT_OUT:
+        return E_ERR_INV_PARAM;
+    case E_REPORT_FEATURE:
+    {
+        int rc = ioctl(fd, HIDIOCGFEATURE(*len + 1), rcvbuf);
+        if (rc < 0)
+            return E_ERR_IO;
+        memcpy(buffer, rcvbuf+1, outBufSize);
+        return 0;
+    }
+    default:
+        return E_ERR_INV_PARAM;
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+
+int HidDevice::StartReading(void)
+{
+    if (fd < 0 && simulated == NULL)
+        return E_ERR_NOTFOUND;
+    int size = GetReportLength(E_REPORT_IN) - 1;
+    if (size <= 0)
+        return E_ERR_INV_PARAM;
+
+    StopReading();
+    reports.Clear();
+    readerReportSize = size;
+    readerFailed = false;
+    if (simulated)
+        return 0;   // nothing to read
+    readerStopEvent.Reset();
+
+    if (pthread_create(&readerThread, NULL, ReaderThreadProc, this) != 0)
+    {
+        LOG("Failed to create HID reader thread!");
+        return E_ERR_OTHER;
+    }
+    readerRunning = true;
+    return 0;
+}
+
+void HidDevice::StopReading(void)
+{
+    if (!readerRunning)
+        return;
+    readerStopEvent.Set();
+    pthread_join(readerThread, NULL);
+    readerRunning = false;
+}
+
+void* HidDevice::ReaderThreadProc(void *data)
+{
+    HidDevice *dev = reinterpret_cast<HidDevice*>(data);
+    dev->ReaderLoop();
+    return NULL;
+}
+
+void HidDevice::ReaderLoop(void)
+{
+    HidReport overflow;     // target for reads when ring is full, report is then dropped
+    struct pollfd pfd[2];
+    pfd[0].fd = fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = readerStopEvent.GetFd();
+    pfd[1].events = POLLIN;
+
+    for (;;)
+    {
+        pfd[0].revents = pfd[1].revents = 0;
+        int rc = poll(pfd, 2, -1);
+        if (rc < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            readerFailed = true;
+            break;
+        }
+        if (pfd[1].revents)
+            break;
+        if (pfd[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+        {
+            LOG("Error: reader poll, revents = 0x%X", pfd[0].revents);
+            readerFailed = true;
+            break;
+        }
+
+        // read directly into ring slot
+        HidReport *report = reports.Reserve();
+        if (report == NULL)
+            report = &overflow;
+        // without report IDs hidraw returns data only, keep it at the same offset as on Windows
+        unsigned char *dst = numberedReports ? report->raw : report->raw + 1;
+        rc = read(fd, dst, numberedReports ? readerReportSize + 1 : readerReportSize);
+        if (rc < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            LOG("Error: reader read, errno = %d (%s)", errno, strerror(errno));
+            readerFailed = true;
+            break;
+        }
+
+        report->timestampUs = Clock::GetTimeUs();
+        report->size = readerReportSize;
+        int received = numberedReports ? rc : rc + 1;
+        if (!numberedReports)
+            report->raw[0] = 0;
+        if (received < readerReportSize + 1)
+            memset(report->raw + received, 0, readerReportSize + 1 - received);
+        if (report == &overflow)
+        {
+            droppedReports++;
+            continue;
+        }
+        reports.Commit();
+        reportEvent.Set();
+    }
+
+    // wake up consumer so it could notice failure
+    reportEvent.Set();
+}
+
+#endif  // !_WIN32
@@ -0,0 +1,42 @@
+/** \file
+    \brief Key codes and host functions of tSIP phone plugin interface used by device code
+    \note Windows (plugin DLL) build takes E_KEY from tSIP sources, checked out next to this
+    repository (../tSIP), as the DLL interface in Phone.cpp does. Other builds (Linux static
+    library, replay tool) have no tSIP host and use declaration below, so they build from
+    this repository alone; only key names (KeyMap::GetKeyName()) are visible there.
+*/
+
+#ifndef HostPhoneH
+#define HostPhoneH
+
+#ifdef _WIN32
+#include "../tSIP/tSIP/phone/Phone.h"
+#else
+enum E_KEY
+{
+    KEY_0 = 0,
+    KEY_1,
+    KEY_2,
+    KEY_3,
+    KEY_4,
+    KEY_5,
+    KEY_6,
+    KEY_7,
+    KEY_8,
+    KEY_9,
+    KEY_STAR,
+    KEY_HASH,
+    KEY_OK,
+    KEY_C,
+    KEY_CALL_HANGUP,
+    KEY_VOICEMAIL,
+    KEY_HOOK
+};
+#endif
+
+/* provided by host: Phone.cpp (tSIP DLL interface) or application linking Linux library */
+void Key(int keyCode, int state);
+int RunScriptAsync(const char* script);
+int Redial(void);
+
+#endif // HostPhoneH
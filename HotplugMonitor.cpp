@@ -0,0 +1,328 @@
+#include "HotplugMonitor.h"
+#include "Log.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef _WIN32
+#include "Utils.h"
+#include <windows.h>
+#include <dbt.h>
+extern "C"
+{
+#include <ddk/hidsdi.h>
+}
+#else
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#endif
+
+
+HotplugMonitor::HotplugMonitor(void):
+    running(false),
+    arrival(0),
+    removal(0),
+    startStatus(0)
+#ifdef _WIN32
+    ,thread(NULL),
+    hwnd(NULL)
+#else
+    ,sock(-1),
+    stopEvent(true)
+#endif
+{
+}
+
+HotplugMonitor::~HotplugMonitor(void)
+{
+    Stop();
+}
+
+bool HotplugMonitor::TakeArrival(void)
+{
+    return __atomic_exchange_n(&arrival, 0, __ATOMIC_ACQ_REL) != 0;
+}
+
+bool HotplugMonitor::TakeRemoval(void)
+{
+    return __atomic_exchange_n(&removal, 0, __ATOMIC_ACQ_REL) != 0;
+}
+
+void HotplugMonitor::Inject(enum E_EVENT ev)
+{
+    __atomic_store_n((ev == E_ARRIVAL) ? &arrival : &removal, 1, __ATOMIC_RELEASE);
+    event.Set();
+}
+
+bool HotplugMonitor::Matches(const char *name) const
+{
+    std::string upper(name);
+    for (unsigned int i=0; i<upper.size(); i++)
+        upper[i] = toupper(upper[i]);
+    return upper.find(idPattern) != std::string::npos;
+}
+
+#ifdef _WIN32
+
+namespace
+{
+    const char* const WINDOW_CLASS = "PhonePolycomCX300Hotplug";
+}
+
+int HotplugMonitor::Start(int VID, int PID)
+{
+    Stop();
+    char pattern[32];
+    snprintf(pattern, sizeof(pattern), "VID_%04X&PID_%04X", VID, PID);
+    idPattern = pattern;
+
+    startStatus = -1;
+    started.Reset();
+    DWORD dwtid;
+    thread = CreateThread(NULL, 0, ThreadProc, this, 0, &dwtid);
+    if (thread == NULL)
+        return -1;
+    started.Wait(Event::INFINITE_TIMEOUT);
+    if (startStatus != 0)
+    {
+        WaitForSingleObject(thread, INFINITE);
+        CloseHandle(thread);
+        thread = NULL;
+        return startStatus;
+    }
+    running = true;
+    return 0;
+}
+
+void HotplugMonitor::Stop(void)
+{
+    if (!running)
+        return;
+    PostMessage(hwnd, WM_CLOSE, 0, 0);
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+    thread = NULL;
+    running = false;
+}
+
+DWORD WINAPI HotplugMonitor::ThreadProc(LPVOID data)
+{
+    HotplugMonitor *monitor = reinterpret_cast<HotplugMonitor*>(data);
+    monitor->Loop();
+    return 0;
+}
+
+void HotplugMonitor::Loop(void)
+{
+    HINSTANCE hInstance = Utils::GetCurrentModule();
+    WNDCLASSEX wc;
+    memset(&wc, 0, sizeof(wc));
+    wc.cbSize = sizeof(wc);
+    wc.lpfnWndProc = WndProc;
+    wc.hInstance = hInstance;
+    wc.lpszClassName = WINDOW_CLASS;
+    if (RegisterClassEx(&wc) == 0 && GetLastError() != ERROR_CLASS_ALREADY_EXISTS)
+    {
+        LOG("Hotplug: failed to register window class");
+        started.Set();
+        return;
+    }
+
+    hwnd = CreateWindowEx(0, WINDOW_CLASS, "", 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, hInstance, NULL);
+    if (hwnd == NULL)
+    {
+        LOG("Hotplug: failed to create window");
+        started.Set();
+        return;
+    }
+    SetWindowLongPtr(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(this));
+
+    DEV_BROADCAST_DEVICEINTERFACE filter;
+    memset(&filter, 0, sizeof(filter));
+    filter.dbcc_size = sizeof(filter);
+    filter.dbcc_devicetype = DBT_DEVTYP_DEVICEINTERFACE;
+    HidD_GetHidGuid(&filter.dbcc_classguid);
+    HDEVNOTIFY notify = RegisterDeviceNotification(hwnd, &filter, DEVICE_NOTIFY_WINDOW_HANDLE);
+    if (notify == NULL)
+    {
+        LOG("Hotplug: RegisterDeviceNotification failed, GetLastError = %d", static_cast<int>(GetLastError()));
+        DestroyWindow(hwnd);
+        hwnd = NULL;
+        started.Set();
+        return;
+    }
+
+    startStatus = 0;
+    started.Set();
+
+    MSG msg;
+    while (GetMessage(&msg, NULL, 0, 0) > 0)
+    {
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+    }
+
+    UnregisterDeviceNotification(notify);
+    hwnd = NULL;
+}
+
+LRESULT CALLBACK HotplugMonitor::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
+{
+    HotplugMonitor *monitor = reinterpret_cast<HotplugMonitor*>(GetWindowLongPtr(hwnd, GWLP_USERDATA));
+    switch (msg)
+    {
+    case WM_DEVICECHANGE:
+        if (monitor && (wParam == DBT_DEVICEARRIVAL || wParam == DBT_DEVICEREMOVECOMPLETE))
+        {
+            DEV_BROADCAST_HDR *hdr = reinterpret_cast<DEV_BROADCAST_HDR*>(lParam);
+            if (hdr && hdr->dbch_devicetype == DBT_DEVTYP_DEVICEINTERFACE)
+            {
+                DEV_BROADCAST_DEVICEINTERFACE_A *di = reinterpret_cast<DEV_BROADCAST_DEVICEINTERFACE_A*>(hdr);
+                if (monitor->Matches(di->dbcc_name))
+                    monitor->Inject((wParam == DBT_DEVICEARRIVAL) ? E_ARRIVAL : E_REMOVAL);
+            }
+        }
+        return TRUE;
+    case WM_CLOSE:
+        DestroyWindow(hwnd);
+        return 0;
+    case WM_DESTROY:
+        PostQuitMessage(0);
+        return 0;
+    default:
+        return DefWindowProc(hwnd, msg, wParam, lParam);
+    }
+}
+
+#else
+
+namespace
+{
+    enum { UDEV_MONITOR_GROUP = 2 };    ///< events already processed by udev (device node permissions set)
+}
+
+int HotplugMonitor::Start(int VID, int PID)
+{
+    Stop();
+    char pattern[32];
+    // DEVPATH: .../0003:095D:9201.0005/hidraw/hidraw3
+    snprintf(pattern, sizeof(pattern), ":%04X:%04X.", VID, PID);
+    idPattern = pattern;
+
+    sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+    if (sock < 0)
+    {
+        LOG("Hotplug: failed to create netlink socket, errno = %d", errno);
+        return -1;
+    }
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = UDEV_MONITOR_GROUP;
+    if (bind(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0)
+    {
+        LOG("Hotplug: failed to bind netlink socket, errno = %d", errno);
+        close(sock);
+        sock = -1;
+        return -1;
+    }
+
+    stopEvent.Reset();
+    if (pthread_create(&thread, NULL, ThreadProc, this) != 0)
+    {
+        close(sock);
+        sock = -1;
+        return -1;
+    }
+    running = true;
+    return 0;
+}
+
+void HotplugMonitor::Stop(void)
+{
+    if (!running)
+        return;
+    stopEvent.Set();
+    pthread_join(thread, NULL);
+    close(sock);
+    sock = -1;
+    running = false;
+}
+
+void* HotplugMonitor::ThreadProc(void *data)
+{
+    HotplugMonitor *monitor = reinterpret_cast<HotplugMonitor*>(data);
+    monitor->Loop();
+    return NULL;
+}
+
+void HotplugMonitor::Loop(void)
+{
+    struct pollfd pfd[2];
+    pfd[0].fd = sock;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = stopEvent.GetFd();
+    pfd[1].events = POLLIN;
+    char buf[8192];
+
+    for (;;)
+    {
+        pfd[0].revents = pfd[1].revents = 0;
+        if (poll(pfd, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (pfd[1].revents)
+            break;
+        int len = recv(sock, buf, sizeof(buf) - 1, 0);
+        if (len <= 0)
+            continue;
+        buf[len] = '\0';
+        HandleMessage(buf, len);
+    }
+}
+
+void HotplugMonitor::HandleMessage(const char *buf, int len)
+{
+    const char *props = buf;
+    int propsLen = len;
+    if (len >= 24 && memcmp(buf, "libudev", 8) == 0)
+    {
+        // udev_monitor_netlink_header: prefix[8], magic, header_size, properties_off, properties_len, ...
+        uint32_t off, plen;
+        memcpy(&off, buf + 16, sizeof(off));
+        memcpy(&plen, buf + 20, sizeof(plen));
+        if (off + plen > static_cast<uint32_t>(len))
+            return;
+        props = buf + off;
+        propsLen = plen;
+    }
+
+    const char *action = "", *subsystem = "", *devpath = "";
+    for (int pos = 0; pos < propsLen; )
+    {
+        const char *prop = props + pos;
+        if (strncmp(prop, "ACTION=", 7) == 0)
+            action = prop + 7;
+        else if (strncmp(prop, "SUBSYSTEM=", 10) == 0)
+            subsystem = prop + 10;
+        else if (strncmp(prop, "DEVPATH=", 8) == 0)
+            devpath = prop + 8;
+        pos += strlen(prop) + 1;
+    }
+
+    if (strcmp(subsystem, "hidraw") != 0 || !Matches(devpath))
+        return;
+    if (strcmp(action, "add") == 0)
+        Inject(E_ARRIVAL);
+    else if (strcmp(action, "remove") == 0)
+        Inject(E_REMOVAL);
+}
+
+#endif
@@ -0,0 +1,85 @@
+/** \file
+    \brief Device arrival/removal notifications
+    \note Windows: device interface notifications (WM_DEVICECHANGE) received by message-only window,
+    Linux: udev netlink monitor (hidraw subsystem).
+*/
+
+#ifndef HotplugMonitorH
+#define HotplugMonitorH
+
+#include "Event.h"
+#include <string>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+class HotplugMonitor
+{
+public:
+    enum E_EVENT
+    {
+        E_ARRIVAL = 0,
+        E_REMOVAL
+    };
+
+    HotplugMonitor(void);
+    ~HotplugMonitor(void);
+
+    /** \brief Start receiving notifications for HID devices with specified VID/PID
+        \return 0 on success
+    */
+    int Start(int VID, int PID);
+    void Stop(void);
+    bool IsRunning(void) const {
+        return running;
+    }
+
+    /** \brief Event signaled (auto-reset) on every matching device event
+    */
+    Event& GetEvent(void) {
+        return event;
+    }
+
+    /** \brief Check and clear arrival flag
+    */
+    bool TakeArrival(void);
+    /** \brief Check and clear removal flag
+    */
+    bool TakeRemoval(void);
+
+    /** \brief Deliver event as if it came from the system (fake event source for tests)
+    */
+    void Inject(enum E_EVENT ev);
+
+    /** \brief Check if device path/name from notification matches monitored VID/PID
+    */
+    bool Matches(const char *name) const;
+
+private:
+    bool running;
+    std::string idPattern;  ///< VID/PID as they appear in interface name (Windows) or DEVPATH (Linux)
+    int arrival;
+    int removal;
+    Event event;
+    Event started;          ///< thread initialized (successfully or not)
+    volatile int startStatus;
+
+#ifdef _WIN32
+    HANDLE thread;
+    HWND hwnd;
+    static DWORD WINAPI ThreadProc(LPVOID data);
+    static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+#else
+    pthread_t thread;
+    int sock;
+    Event stopEvent;
+    static void* ThreadProc(void *data);
+    void HandleMessage(const char *buf, int len);
+#endif
+    void Loop(void);
+
+    HotplugMonitor(const HotplugMonitor&);
+    HotplugMonitor& operator=(const HotplugMonitor&);
+};
+
+#endif // HotplugMonitorH
@@ -0,0 +1,219 @@
+#include "KeyMacro.h"
+#include "KeyMap.h"
+#include "Log.h"
+#include "Stats.h"
+#include "HostPhone.h"
+#include <stddef.h>
+#include <algorithm>
+
+namespace
+{
+
+/** Time between key down and key up of "key" step [ms] */
+enum { KEY_PRESS_MS = 50 };
+
+void AddKeyPress(KeyMacro &macro, int keyCode, unsigned int delayMs)
+{
+    KeyMacro::Step step;
+    step.action = KeyMacro::Step::KEY_DOWN;
+    step.keyCode = keyCode;
+    step.delayMs = delayMs;
+    macro.steps.push_back(step);
+    step.action = KeyMacro::Step::KEY_UP;
+    step.delayMs = KEY_PRESS_MS;
+    macro.steps.push_back(step);
+}
+
+/** \return false if entry is invalid */
+bool CompileMacro(const CustomConf::KeyMacroConf &conf, KeyMacro &macro)
+{
+    macro.name = conf.key + (conf.longPress ? " (long)" : "");
+    macro.steps.clear();
+    for (unsigned int i=0; i<conf.steps.size(); i++)
+    {
+        const CustomConf::KeyMacroConf::Step &entry = conf.steps[i];
+        KeyMacro::Step step;
+        step.keyCode = -1;
+        step.delayMs = entry.delayMs;
+        if (entry.action == "key" || entry.action == "keyDown" || entry.action == "keyUp")
+        {
+            step.keyCode = KeyMap::GetKeyCode(entry.value);
+            if (step.keyCode < 0)
+            {
+                LOG("Key macro %s: unknown key \"%s\"", macro.name.c_str(), entry.value.c_str());
+                return false;
+            }
+            if (entry.action == "key")
+            {
+                AddKeyPress(macro, step.keyCode, step.delayMs);
+                continue;
+            }
+            step.action = (entry.action == "keyDown") ? KeyMacro::Step::KEY_DOWN : KeyMacro::Step::KEY_UP;
+        }
+        else if (entry.action == "script")
+        {
+            step.action = KeyMacro::Step::SCRIPT;
+            step.script = entry.value;
+        }
+        else if (entry.action == "redial")
+        {
+            step.action = KeyMacro::Step::REDIAL;
+        }
+        else
+        {
+            LOG("Key macro %s: unknown action \"%s\"", macro.name.c_str(), entry.action.c_str());
+            return false;
+        }
+        macro.steps.push_back(step);
+    }
+    return true;
+}
+
+}   // namespace
+
+
+KeyMacroTable::KeyMacroTable(void)
+{
+}
+
+void KeyMacroTable::Compile(const std::vector<CustomConf::KeyMacroConf> &conf)
+{
+    for (unsigned int i=0; i<KEY_COUNT; i++)
+    {
+        macros[i][0] = macros[i][1] = KeyMacro();
+    }
+
+    // default: long press of "1" clears entered digit and calls voicemail
+    KeyMacro &voicemail = macros[1][1];
+    voicemail.name = "1 (long)";
+    AddKeyPress(voicemail, KEY_C, 0);
+    AddKeyPress(voicemail, KEY_VOICEMAIL, KEY_PRESS_MS);
+
+    for (unsigned int i=0; i<conf.size(); i++)
+    {
+        unsigned int index = KeyMap::GetControl(conf[i].key);
+        if (index >= KEY_COUNT)
+        {
+            LOG("Key macro: invalid key \"%s\", expected 0...9, * or #", conf[i].key.c_str());
+            continue;
+        }
+        KeyMacro macro;
+        if (CompileMacro(conf[i], macro))
+        {
+            macros[index][conf[i].longPress ? 1 : 0] = macro;
+        }
+    }
+}
+
+
+KeyMacroPlayer::KeyMacroPlayer(TimerWheel &timers):
+    timers(timers),
+    step(0),
+    stepUs(0),
+    timer(TimerWheel::INVALID_TIMER),
+    due(false)
+{
+}
+
+KeyMacroPlayer::~KeyMacroPlayer(void)
+{
+    Stop();
+}
+
+bool KeyMacroPlayer::Start(const KeyMacro &macro)
+{
+    if (queue.size() >= MAX_QUEUED)
+    {
+        stats.keyMacrosDropped++;
+        return false;
+    }
+    stats.keyMacrosStarted++;
+    queue.push_back(&macro);
+    if (queue.size() == 1)
+    {
+        step = 0;
+        stepUs = timers.GetTime();
+        Run();
+    }
+    return true;
+}
+
+void KeyMacroPlayer::Poll(void)
+{
+    if (due)
+    {
+        due = false;
+        Run();
+    }
+}
+
+void KeyMacroPlayer::Stop(void)
+{
+    timers.Cancel(timer);
+    timer = TimerWheel::INVALID_TIMER;
+    due = false;
+    queue.clear();
+    step = 0;
+    for (unsigned int i=0; i<heldKeys.size(); i++)
+    {
+        Key(heldKeys[i], 0);
+    }
+    heldKeys.clear();
+}
+
+void KeyMacroPlayer::OnTimer(void *opaque)
+{
+    KeyMacroPlayer *player = reinterpret_cast<KeyMacroPlayer*>(opaque);
+    player->timer = TimerWheel::INVALID_TIMER;
+    player->due = true;
+}
+
+void KeyMacroPlayer::Run(void)
+{
+    while (!queue.empty())
+    {
+        const KeyMacro &macro = *queue.front();
+        if (step >= macro.steps.size())
+        {
+            // next macro continues from time of last step
+            queue.pop_front();
+            step = 0;
+            continue;
+        }
+        const KeyMacro::Step &s = macro.steps[step];
+        uint64_t at = stepUs + s.delayMs * 1000ULL;
+        uint64_t now = timers.GetTime();
+        if (at > now)
+        {
+            timer = timers.Schedule(at - now, 0, OnTimer, this);
+            return;
+        }
+        stepUs = at;
+        step++;
+        Execute(s);
+    }
+}
+
+void KeyMacroPlayer::Execute(const KeyMacro::Step &s)
+{
+    switch (s.action)
+    {
+    case KeyMacro::Step::KEY_DOWN:
+        Key(s.keyCode, 1);
+        if (std::find(heldKeys.begin(), heldKeys.end(), s.keyCode) == heldKeys.end())
+            heldKeys.push_back(s.keyCode);
+        break;
+    case KeyMacro::Step::KEY_UP:
+        Key(s.keyCode, 0);
+        heldKeys.erase(std::remove(heldKeys.begin(), heldKeys.end(), s.keyCode), heldKeys.end());
+        break;
+    case KeyMacro::Step::SCRIPT:
+        RunScriptAsync(s.script.c_str());
+        break;
+    case KeyMacro::Step::REDIAL:
+        Redial();
+        break;
+    default:
+        break;
+    }
+}
@@ -0,0 +1,116 @@
+/** \file
+    \brief Key macros: timed sequences of key events, scripts and redial run on phone key press
+    \note Macros are compiled once from configuration into KeyMacroTable. Each phone has its own
+    KeyMacroPlayer that queues started macros and executes their steps from comm thread Poll()
+    when they are due, so input processing never waits for a running macro.
+*/
+
+#ifndef KeyMacroH
+#define KeyMacroH
+
+#include "CustomConf.h"
+#include "TimerWheel.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+
+struct KeyMacro
+{
+    struct Step
+    {
+        enum Action
+        {
+            KEY_DOWN,
+            KEY_UP,
+            SCRIPT,
+            REDIAL
+        };
+        enum Action action;
+        int keyCode;            ///< E_KEY for KEY_DOWN/KEY_UP
+        std::string script;
+        unsigned int delayMs;   ///< pause after previous step
+    };
+    std::string name;           ///< for logs
+    std::vector<Step> steps;
+};
+
+/** \brief Macros assigned to phone keypad keys, separately for short and long press
+*/
+class KeyMacroTable
+{
+public:
+    /** \brief Keypad keys: 0...9, *, # - indexed as KeyMap controls */
+    enum { KEY_COUNT = 12 };
+
+    KeyMacroTable(void);
+
+    /** \brief Build table: built-in defaults, overridden by configured macros
+        \note Configured macro with no steps removes default macro of the key.
+        Invalid entries are logged and skipped.
+    */
+    void Compile(const std::vector<CustomConf::KeyMacroConf> &conf);
+
+    /** \brief Get macro for keypad key
+        \param keyIndex 0...KEY_COUNT-1
+        \return NULL if key has no macro
+    */
+    const KeyMacro* Find(unsigned int keyIndex, bool longPress) const {
+        if (keyIndex >= KEY_COUNT)
+            return NULL;
+        const KeyMacro &macro = macros[keyIndex][longPress ? 1 : 0];
+        return macro.steps.empty() ? NULL : &macro;
+    }
+
+private:
+    KeyMacro macros[KEY_COUNT][2];  ///< [key][short/long press]
+};
+
+/** \brief Executes started macros one after another
+    \note Steps that are due are executed immediately (from Start() or Poll()), others are
+    timed with one-shot timer on comm thread timer wheel. Delays are counted from due time of
+    previous step, so late Poll() does not stretch the rest of the macro.
+*/
+class KeyMacroPlayer
+{
+public:
+    /** Limit of macros waiting for execution, further macros are dropped */
+    enum { MAX_QUEUED = 16 };
+
+    explicit KeyMacroPlayer(TimerWheel &timers);
+    ~KeyMacroPlayer(void);
+
+    /** \brief Queue macro, start executing it if no other macro is running
+        \note Macro is referenced, not copied - it must exist until it is finished or Stop() is called.
+        \return false if queue is full
+    */
+    bool Start(const KeyMacro &macro);
+
+    /** \brief Execute steps that became due */
+    void Poll(void);
+
+    /** \brief Drop all queued macros, release keys that were left pressed by macro */
+    void Stop(void);
+
+    bool IsRunning(void) const {
+        return !queue.empty();
+    }
+
+private:
+    TimerWheel &timers;
+    std::deque<const KeyMacro*> queue;  ///< front = running macro
+    unsigned int step;                  ///< next step of running macro
+    uint64_t stepUs;                    ///< due time of previous step, timer wheel time
+    TimerWheel::TimerId timer;
+    bool due;                           ///< set by timer callback
+    std::vector<int> heldKeys;          ///< KEY_DOWN without KEY_UP yet
+
+    static void OnTimer(void *opaque);
+    void Run(void);
+    void Execute(const KeyMacro::Step &s);
+
+    KeyMacroPlayer(const KeyMacroPlayer&);
+    KeyMacroPlayer& operator=(const KeyMacroPlayer&);
+};
+
+#endif // KeyMacroH
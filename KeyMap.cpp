@@ -0,0 +1,133 @@
+#include "KeyMap.h"
+#include "Log.h"
+#include "HostPhone.h"
+
+const KeyAction KeyMap::NO_ACTION;
+
+namespace
+{
+
+struct Name
+{
+    const char *name;
+    int value;
+};
+
+const Name KEY_NAMES[] = {
+    { "0", KEY_0 }, { "1", KEY_1 }, { "2", KEY_2 }, { "3", KEY_3 }, { "4", KEY_4 },
+    { "5", KEY_5 }, { "6", KEY_6 }, { "7", KEY_7 }, { "8", KEY_8 }, { "9", KEY_9 },
+    { "*", KEY_STAR }, { "#", KEY_HASH },
+    { "OK", KEY_OK }, { "C", KEY_C }, { "HANGUP", KEY_CALL_HANGUP },
+    { "VOICEMAIL", KEY_VOICEMAIL }, { "HOOK", KEY_HOOK }
+};
+
+const Name CONTROL_NAMES[] = {
+    { "*", KeyMap::CTRL_STAR }, { "#", KeyMap::CTRL_POUND },
+    { "FLASH", KeyMap::CTRL_FLASH }, { "REDIAL", KeyMap::CTRL_REDIAL },
+    { "HOLD", KeyMap::CTRL_HOLD }, { "MUTE", KeyMap::CTRL_MUTE }
+};
+
+KeyAction MakeKey(int keyCode, int keyCodeRinging)
+{
+    KeyAction action;
+    action.type = KeyAction::KEY;
+    action.keyCode = keyCode;
+    action.keyCodeRinging = keyCodeRinging;
+    return action;
+}
+
+}   // namespace
+
+
+KeyMap::KeyMap(void)
+{
+}
+
+unsigned int KeyMap::GetControl(const std::string &name)
+{
+    if (name.length() == 1 && name[0] >= '0' && name[0] <= '9')
+        return CTRL_0 + (name[0] - '0');
+    for (unsigned int i=0; i<sizeof(CONTROL_NAMES)/sizeof(CONTROL_NAMES[0]); i++)
+    {
+        if (name == CONTROL_NAMES[i].name)
+            return CONTROL_NAMES[i].value;
+    }
+    return CTRL_NONE;
+}
+
+int KeyMap::GetKeyCode(const std::string &name)
+{
+    for (unsigned int i=0; i<sizeof(KEY_NAMES)/sizeof(KEY_NAMES[0]); i++)
+    {
+        if (name == KEY_NAMES[i].name)
+            return KEY_NAMES[i].value;
+    }
+    return -1;
+}
+
+const char* KeyMap::GetKeyName(int keyCode)
+{
+    for (unsigned int i=0; i<sizeof(KEY_NAMES)/sizeof(KEY_NAMES[0]); i++)
+    {
+        if (keyCode == KEY_NAMES[i].value)
+            return KEY_NAMES[i].name;
+    }
+    return NULL;
+}
+
+void KeyMap::Compile(const std::vector<CustomConf::KeyMapEntry> &conf, const std::string &dialKey)
+{
+    for (unsigned int i=0; i<=CTRL_9; i++)
+    {
+        actions[i] = MakeKey(KEY_0 + i, KEY_0 + i);
+    }
+    actions[CTRL_STAR] = (dialKey == "*") ? MakeKey(KEY_OK, KEY_OK) : MakeKey(KEY_STAR, KEY_STAR);
+    actions[CTRL_POUND] = (dialKey == "#") ? MakeKey(KEY_OK, KEY_OK) : MakeKey(KEY_HASH, KEY_HASH);
+    // flash rejects incoming call, otherwise works as "C"
+    actions[CTRL_FLASH] = MakeKey(KEY_C, KEY_CALL_HANGUP);
+    actions[CTRL_REDIAL] = KeyAction();
+    actions[CTRL_REDIAL].type = KeyAction::REDIAL;
+    actions[CTRL_HOLD] = KeyAction();
+    actions[CTRL_HOLD].type = KeyAction::SCRIPT;
+    actions[CTRL_HOLD].script = "ToggleHold()";
+    actions[CTRL_MUTE] = KeyAction();     // mute is handled by phone itself
+
+    for (unsigned int i=0; i<conf.size(); i++)
+    {
+        const CustomConf::KeyMapEntry &entry = conf[i];
+        unsigned int control = GetControl(entry.control);
+        if (control == CTRL_NONE)
+        {
+            LOG("Key map: unknown control \"%s\"", entry.control.c_str());
+            continue;
+        }
+        KeyAction action;
+        if (entry.action == "key")
+        {
+            action.type = KeyAction::KEY;
+            action.keyCode = GetKeyCode(entry.value);
+            action.keyCodeRinging = entry.ringingValue.empty() ? action.keyCode : GetKeyCode(entry.ringingValue);
+            if (action.keyCode < 0 || action.keyCodeRinging < 0)
+            {
+                LOG("Key map: %s - unknown key \"%s\"", entry.control.c_str(),
+                    (action.keyCode < 0) ? entry.value.c_str() : entry.ringingValue.c_str());
+                continue;
+            }
+        }
+        else if (entry.action == "script")
+        {
+            action.type = KeyAction::SCRIPT;
+            action.script = entry.value;
+        }
+        else if (entry.action == "redial")
+        {
+            action.type = KeyAction::REDIAL;
+        }
+        else if (entry.action != "none")
+        {
+            LOG("Key map: %s - unknown action \"%s\"", entry.control.c_str(), entry.action.c_str());
+            continue;
+        }
+        actions[control] = action;
+    }
+}
@@ -0,0 +1,88 @@
+/** \file
+    \brief Assignment of actions to phone keys and buttons
+    \note Compiled once from configuration (defaults, dialKey, keyMap); phone builds its
+    report dispatch tables from it, so decoding a report does not look at configuration.
+*/
+
+#ifndef KeyMapH
+#define KeyMapH
+
+#include "CustomConf.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/** \brief What pressing key or button does
+*/
+struct KeyAction
+{
+    enum Type
+    {
+        NONE,
+        KEY,            ///< Key() press and release
+        SCRIPT,         ///< RunScriptAsync() on press
+        REDIAL          ///< Redial() on press
+    };
+    enum Type type;
+    int keyCode;            ///< E_KEY for KEY
+    int keyCodeRinging;     ///< E_KEY for KEY while phone is ringing
+    std::string script;
+    KeyAction(void):
+        type(NONE),
+        keyCode(-1),
+        keyCodeRinging(-1)
+    {}
+};
+
+class KeyMap
+{
+public:
+    /** \brief Mappable controls; keypad keys have the same index as in KeyMacroTable
+    */
+    enum Control
+    {
+        CTRL_0 = 0,
+        CTRL_9 = 9,
+        CTRL_STAR = 10,
+        CTRL_POUND = 11,
+        CTRL_FLASH,
+        CTRL_REDIAL,
+        CTRL_HOLD,
+        CTRL_MUTE,
+        CONTROL_COUNT,
+        CTRL_NONE = 0xFF
+    };
+    enum { KEYPAD_COUNT = CTRL_POUND + 1 };
+
+    KeyMap(void);
+
+    /** \brief Build map: defaults, dialKey, then configured entries
+        \note Invalid entries are logged and skipped.
+    */
+    void Compile(const std::vector<CustomConf::KeyMapEntry> &conf, const std::string &dialKey);
+
+    const KeyAction& Get(unsigned int control) const {
+        return (control < CONTROL_COUNT) ? actions[control] : NO_ACTION;
+    }
+
+    /** \brief Translate control name used in configuration ("0"..."9", "*", "#", "FLASH", "REDIAL", "HOLD", "MUTE")
+        \return CTRL_NONE if name is unknown
+    */
+    static unsigned int GetControl(const std::string &name);
+
+    /** \brief Translate key name used in configuration ("0"..."9", "*", "#", "OK", "C", ...)
+        \return E_KEY value, -1 if name is unknown
+    */
+    static int GetKeyCode(const std::string &name);
+
+    /** \brief Name of E_KEY value, as used in configuration
+        \return NULL if key has no name
+    */
+    static const char* GetKeyName(int keyCode);
+
+private:
+    static const KeyAction NO_ACTION;
+    KeyAction actions[CONTROL_COUNT];
+};
+
+#endif // KeyMapH
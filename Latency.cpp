@@ -0,0 +1,113 @@
+#include "Latency.h"
+#include <sstream>
+
+LatencyStats latency;
+
+LatencyHistogram::LatencyHistogram(void):
+    count(0),
+    max(0)
+{
+    for (unsigned int i=0; i<BUCKET_COUNT; i++)
+        buckets[i] = 0;
+}
+
+unsigned int LatencyHistogram::GetBucket(uint32_t us)
+{
+    if (us < LINEAR_BUCKETS)
+        return us;
+    unsigned int exponent = 31 - __builtin_clz(us);     // >= 4
+    unsigned int sub = (us >> (exponent - SUB_BITS)) & ((1 << SUB_BITS) - 1);
+    return LINEAR_BUCKETS + ((exponent - 4) << SUB_BITS) + sub;
+}
+
+uint32_t LatencyHistogram::GetBucketLimit(unsigned int bucket)
+{
+    if (bucket < LINEAR_BUCKETS)
+        return bucket;
+    unsigned int exponent = 4 + ((bucket - LINEAR_BUCKETS) >> SUB_BITS);
+    unsigned int sub = (bucket - LINEAR_BUCKETS) & ((1 << SUB_BITS) - 1);
+    uint64_t lower = static_cast<uint64_t>((1 << SUB_BITS) + sub) << (exponent - SUB_BITS);
+    return static_cast<uint32_t>(lower + (static_cast<uint64_t>(1) << (exponent - SUB_BITS)) - 1);
+}
+
+void LatencyHistogram::Record(uint64_t us)
+{
+    uint32_t value = (us > 0xFFFFFFFFULL) ? 0xFFFFFFFF : static_cast<uint32_t>(us);
+    __atomic_fetch_add(&buckets[GetBucket(value)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&count, 1, __ATOMIC_RELAXED);
+    uint32_t prev = __atomic_load_n(&max, __ATOMIC_RELAXED);
+    while (value > prev &&
+        !__atomic_compare_exchange_n(&max, &prev, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+        // prev reloaded by failed CAS
+    }
+}
+
+void LatencyHistogram::Reset(void)
+{
+    for (unsigned int i=0; i<BUCKET_COUNT; i++)
+        __atomic_store_n(&buckets[i], 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&max, 0, __ATOMIC_RELAXED);
+}
+
+uint32_t LatencyHistogram::GetPercentile(unsigned int permille) const
+{
+    // snapshot of buckets - total is counted from it, so it is consistent with bucket values
+    uint32_t snapshot[BUCKET_COUNT];
+    uint64_t total = 0;
+    for (unsigned int i=0; i<BUCKET_COUNT; i++)
+    {
+        snapshot[i] = __atomic_load_n(&buckets[i], __ATOMIC_RELAXED);
+        total += snapshot[i];
+    }
+    if (total == 0)
+        return 0;
+    uint64_t target = (total * permille + 999) / 1000;
+    if (target == 0)
+        target = 1;
+    uint64_t sum = 0;
+    for (unsigned int i=0; i<BUCKET_COUNT; i++)
+    {
+        sum += snapshot[i];
+        if (sum >= target)
+        {
+            uint32_t limit = GetBucketLimit(i);
+            uint32_t maxValue = GetMax();
+            return (maxValue != 0 && maxValue < limit) ? maxValue : limit;
+        }
+    }
+    return GetMax();
+}
+
+const char* LatencyStats::GetStageName(enum Stage stage)
+{
+    switch (stage)
+    {
+    case READ_TO_DECODE:
+        return "read->decode";
+    case KEY_CALLBACK:
+        return "Key() callback";
+    case READ_TO_KEY:
+        return "read->Key() done";
+    default:
+        return "???";
+    }
+}
+
+std::string LatencyStats::ToString(void) const
+{
+    std::stringstream stream;
+    stream << "Input latency [us]";
+    for (int i=0; i<STAGE_COUNT; i++)
+    {
+        const LatencyHistogram &h = stages[i];
+        stream << ((i == 0) ? ": " : "; ") << GetStageName(static_cast<Stage>(i)) << " n=" << h.GetCount();
+        if (h.GetCount())
+        {
+            stream << " p50 " << h.GetPercentile(500) << " p90 " << h.GetPercentile(900);
+            stream << " p99 " << h.GetPercentile(990) << " max " << h.GetMax();
+        }
+    }
+    return stream.str();
+}
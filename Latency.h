@@ -0,0 +1,75 @@
+/** \file
+    \brief Input latency histograms
+    \note Buckets are fixed: values below 16 us are exact, above that each power of 2 is split
+    into 8 buckets (error below 12.5%). Recording and reading use atomic operations only, so
+    histogram can be updated from comm thread and dumped from any thread without locking.
+*/
+
+#ifndef LatencyH
+#define LatencyH
+
+#include <stdint.h>
+#include <string>
+
+class LatencyHistogram
+{
+public:
+    enum { LINEAR_BUCKETS = 16 };
+    enum { SUB_BITS = 3 };
+    enum { BUCKET_COUNT = LINEAR_BUCKETS + (32 - 4) * (1 << SUB_BITS) };
+
+    LatencyHistogram(void);
+
+    /** \brief Add sample [us] */
+    void Record(uint64_t us);
+
+    /** \brief Clear all samples; samples recorded at the same time may be lost */
+    void Reset(void);
+
+    uint32_t GetCount(void) const {
+        return __atomic_load_n(&count, __ATOMIC_RELAXED);
+    }
+    uint32_t GetMax(void) const {
+        return __atomic_load_n(&max, __ATOMIC_RELAXED);
+    }
+
+    /** \brief Value that given part of samples does not exceed
+        \param permille 500 = median, 990 = p99
+        \return upper edge of bucket [us], 0 if there are no samples
+    */
+    uint32_t GetPercentile(unsigned int permille) const;
+
+    static unsigned int GetBucket(uint32_t us);
+    /** \brief Largest value that falls into bucket */
+    static uint32_t GetBucketLimit(unsigned int bucket);
+
+private:
+    uint32_t buckets[BUCKET_COUNT];
+    uint32_t count;
+    uint32_t max;
+};
+
+/** \brief Latency of input report processing stages
+*/
+struct LatencyStats
+{
+    enum Stage
+    {
+        READ_TO_DECODE,     ///< read completion (HidReport::timestampUs) to HandleReportIn()
+        KEY_CALLBACK,       ///< Key() call to return from tSIP callback
+        READ_TO_KEY,        ///< read completion to return from Key() callback
+        STAGE_COUNT
+    };
+    LatencyHistogram stages[STAGE_COUNT];
+
+    void Record(enum Stage stage, uint64_t us) {
+        stages[stage].Record(us);
+    }
+    static const char* GetStageName(enum Stage stage);
+    /** \brief count, p50/p90/p99/max of each stage in one line */
+    std::string ToString(void) const;
+};
+
+extern LatencyStats latency;
+
+#endif // LatencyH
@@ -0,0 +1,67 @@
+#include "Marquee.h"
+#include "DisplayText.h"
+#include "Stats.h"
+
+Marquee::Marquee(void):
+    cells(0),
+    scroll(false),
+    step(0)
+{
+}
+
+void Marquee::Set(const std::string &text, unsigned int cells, bool scroll)
+{
+    if (!frames.empty() && text == this->text && cells == this->cells && scroll == this->scroll)
+        return;
+    this->text = text;
+    this->cells = cells;
+    this->scroll = scroll;
+    step = 0;
+
+    std::vector<uint16_t> glyphs;
+    DisplayText::ToGlyphs(text.data(), text.length(), glyphs);
+    if (!scroll || glyphs.size() <= cells)
+    {
+        frames.resize(1);
+        DisplayText::EncodeGlyphs(glyphs.empty() ? NULL : &glyphs[0], (glyphs.size() < cells) ? glyphs.size() : cells, frames[0]);
+        return;
+    }
+
+    // text, gap and start of text again: every window of slot width is continuous
+    unsigned int period = glyphs.size() + GAP;
+    glyphs.reserve(period + cells);
+    glyphs.resize(period, ' ');
+    for (unsigned int i=0; i<cells; i++)
+    {
+        glyphs.push_back(glyphs[i]);
+    }
+    frames.resize(period);
+    for (unsigned int i=0; i<period; i++)
+    {
+        DisplayText::EncodeGlyphs(&glyphs[i], cells, frames[i]);
+    }
+    stats.marqueeRenders++;
+}
+
+void Marquee::Clear(void)
+{
+    text.clear();
+    frames.clear();
+    step = 0;
+}
+
+void Marquee::Step(void)
+{
+    if (!IsScrolling())
+        return;
+    step++;
+    if (step >= frames.size() + HOLD_STEPS)
+        step = 0;
+}
+
+const std::vector<uint8_t>& Marquee::GetFrame(void) const
+{
+    if (frames.empty())
+        return empty;
+    return frames[(step > HOLD_STEPS) ? step - HOLD_STEPS : 0];
+}
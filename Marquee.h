@@ -0,0 +1,55 @@
+/** \file
+    \brief Scrolling of text longer than display slot
+    \note All frames (text shifted by one character each) are encoded once, when text or slot
+    width changes; scroll step only selects next frame, so it costs one slot write and no encoding.
+    Text scrolls in a loop: start is held for a while, then text moves left and its start follows
+    after short gap.
+*/
+
+#ifndef MarqueeH
+#define MarqueeH
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class Marquee
+{
+public:
+    enum { GAP = 4 };           ///< blank cells between end of text and its repeated start
+    enum { HOLD_STEPS = 4 };    ///< additional steps start of text is shown before scrolling
+
+    Marquee(void);
+
+    /** \brief Set text shown in slot of specified width
+        \note Same text and width as before keeps current frames and position.
+        \param scroll if false or if text fits, text is cut to slot width (single frame)
+    */
+    void Set(const std::string &text, unsigned int cells, bool scroll);
+
+    /** \brief Drop text and frames */
+    void Clear(void);
+
+    /** \brief Text does not fit and is scrolled: Step() changes frame */
+    bool IsScrolling(void) const {
+        return frames.size() > 1;
+    }
+
+    /** \brief Advance to next scroll position (no-op for text that fits)
+    */
+    void Step(void);
+
+    /** \brief Encoded text reports of current position; empty before Set()
+    */
+    const std::vector<uint8_t>& GetFrame(void) const;
+
+private:
+    std::string text;
+    unsigned int cells;
+    bool scroll;
+    std::vector< std::vector<uint8_t> > frames;     ///< encoded text reports for each scroll offset
+    unsigned int step;                              ///< position in scroll cycle, including hold steps
+    std::vector<uint8_t> empty;
+};
+
+#endif // MarqueeH
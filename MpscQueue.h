@@ -0,0 +1,81 @@
+/** \file
+    \brief Bounded lock-free multi-producer/single-consumer queue
+    \note Any number of threads may call Push(), exactly one thread may call Pop().
+    Each slot carries sequence number: producer claims slot by moving head with CAS,
+    copies item and publishes it by updating slot sequence, so consumer never sees
+    partially written item. Capacity N must be a power of 2.
+*/
+
+#ifndef MpscQueueH
+#define MpscQueueH
+
+template <typename T, unsigned int N>
+class MpscQueue
+{
+public:
+    MpscQueue(void):
+        head(0),
+        tail(0)
+    {
+        for (unsigned int i=0; i<N; i++)
+            cells[i].sequence = i;
+    }
+
+    /** \brief Add item (producer side, any thread)
+        \return false if queue is full
+    */
+    bool Push(const T &item) {
+        unsigned int pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        for (;;) {
+            Cell &cell = cells[pos & (N - 1)];
+            unsigned int seq = __atomic_load_n(&cell.sequence, __ATOMIC_ACQUIRE);
+            int diff = static_cast<int>(seq - pos);
+            if (diff == 0) {
+                // slot is free in this lap - try to claim it
+                if (__atomic_compare_exchange_n(&head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                    cell.item = item;
+                    __atomic_store_n(&cell.sequence, pos + 1, __ATOMIC_RELEASE);
+                    return true;
+                }
+                // pos was reloaded by failed CAS
+            } else if (diff < 0) {
+                // slot still holds item from previous lap
+                return false;
+            } else {
+                // other producer claimed this slot
+                pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    /** \brief Take oldest item (consumer side)
+        \return false if queue is empty or oldest item is not completely written yet
+    */
+    bool Pop(T &item) {
+        Cell &cell = cells[tail & (N - 1)];
+        unsigned int seq = __atomic_load_n(&cell.sequence, __ATOMIC_ACQUIRE);
+        if (seq != tail + 1)
+            return false;
+        item = cell.item;
+        // free slot for next lap
+        __atomic_store_n(&cell.sequence, tail + N, __ATOMIC_RELEASE);
+        tail++;
+        return true;
+    }
+
+private:
+    enum { CAPACITY_CHECK = 1 / ((N & (N - 1)) == 0 ? 1 : 0) };   ///< N must be power of 2
+    struct Cell
+    {
+        unsigned int sequence;
+        T item;
+    };
+    unsigned int head;  ///< next position to claim, shared by producers
+    unsigned int tail;  ///< consumer only
+    Cell cells[N];
+
+    MpscQueue(const MpscQueue&);
+    MpscQueue& operator=(const MpscQueue&);
+};
+
+#endif // MpscQueueH
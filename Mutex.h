@@ -1,6 +1,8 @@
 #ifndef MutexH
 #define MutexH
 
+#ifdef _WIN32
+
 #include <windows.h>
 
 class Mutex
@@ -18,4 +20,30 @@ private:
 	Mutex& operator = (const Mutex&);
 };
 
+#else
+
+#include <pthread.h>
+
+class Mutex
+{
+public:
+	Mutex () {
+		pthread_mutexattr_t attr;
+		pthread_mutexattr_init(&attr);
+		// recursive, same as critical section
+		pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+		pthread_mutex_init(&m, &attr);
+		pthread_mutexattr_destroy(&attr);
+	}
+	~Mutex () { pthread_mutex_destroy(&m); }
+	inline void lock () { pthread_mutex_lock(&m); }
+	inline void unlock () { pthread_mutex_unlock(&m); }
+private:
+	pthread_mutex_t m;
+	Mutex(const Mutex&);
+	Mutex& operator = (const Mutex&);
+};
+
+#endif
+
 #endif
@@ -9,11 +9,13 @@
 #include "HidDevice.h"
 #include "Log.h"
 #include "CustomConf.h"
+#include "Latency.h"
 #include <assert.h>
 #include <algorithm>	// needed by Utils::in_group
 #include "Utils.h"
 #include <string>
 #include <fstream>
+#include <string.h>
 #include <json/json.h>
 
 //---------------------------------------------------------------------------
@@ -183,3 +185,16 @@ void SetRunScriptAsyncCallback(CALLBACK_RUN_SCRIPT_ASYNC lpRunScriptAsync) {
 void SetRedialCallback(CALLBACK_REDIAL lpRedial) {
 	lpRedialFn = lpRedial;
 }
+
+/** \brief Diagnostics (not part of tSIP interface): input latency percentiles as text
+    \return text length; text is truncated to fit into buffer
+*/
+extern "C" __declspec(dllexport) int DumpLatency(char *buffer, int size) {
+    std::string text = latency.ToString();
+    if (buffer && size > 0) {
+        int len = std::min(static_cast<int>(text.length()), size - 1);
+        memcpy(buffer, text.data(), len);
+        buffer[len] = '\0';
+    }
+    return static_cast<int>(text.length());
+}
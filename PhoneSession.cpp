@@ -0,0 +1,1261 @@
+#include "PhoneSession.h"
+#include "Log.h"
+#include "CustomConf.h"
+#include "Clock.h"
+#include "Stats.h"
+#include "Latency.h"
+#include "RingCadence.h"
+#include "DisplayText.h"
+#include "HostPhone.h"
+#include "PolycomCX300.h"
+#include <time.h>
+#include <string.h>
+#include <stdio.h>
+
+using namespace nsHidDevice;
+
+namespace
+{
+
+/* https://github.com/probonopd/OpenPhone */
+const uint8_t STATUS_AVAILABLE[] = {0x16, 0x01};
+const uint8_t STATUS_BUSY[] = {0x16, 0x03};
+const uint8_t STATUS_BE_RIGHT_BACK[] = {0x16, 0x05};
+const uint8_t STATUS_AWAY[] = {0x16, 0x05};
+const uint8_t STATUS_DO_NOT_DISTURB[] = {0x16, 0x06};
+const uint8_t STATUS_OFF_WORK[] = {0x16, 0x07};
+
+const uint8_t STATUS_LED_GREEN[] = {0x16, 0x01};
+const uint8_t STATUS_LED_RED[] = {0x16, 0x03};
+const uint8_t STATUS_LED_ORANGE_RED[] = {0x16, 0x04};
+const uint8_t STATUS_LED_ORANGE[] = {0x16, 0x05};
+const uint8_t STATUS_LED_OFF[] = {0x16, 0x07};
+const uint8_t STATUS_LED_GREEN_ORANGE[] = {0x16, 0x08};
+
+/** Startup self-test: LED patterns shown one after another after phone is opened */
+const uint8_t* const SELF_TEST_PATTERNS[] = {
+    STATUS_LED_GREEN, STATUS_LED_RED, STATUS_LED_ORANGE_RED,
+    STATUS_LED_ORANGE, STATUS_LED_GREEN_ORANGE, STATUS_LED_OFF
+};
+enum { SELF_TEST_PATTERN_COUNT = sizeof(SELF_TEST_PATTERNS)/sizeof(SELF_TEST_PATTERNS[0]) };
+
+const uint8_t SPEAKER_LED_OFF[] = {0x02, 0x00};
+const uint8_t SPEAKER_LED_ON[] = {0x02, 0x01};
+
+const uint8_t DISPLAY_CLEAR[] = {0x13, 0x00};
+
+const uint8_t TEXT_MODE_FOUR_CORNERS[] = {0x13, 0x0D};
+const uint8_t TEXT_TOP_LEFT[] = {0x14, 0x01, 0x80};
+const uint8_t TEXT_BOTTOM_LEFT[] = {0x14, 0x02, 0x80};
+const uint8_t TEXT_TOP_RIGHT[] = {0x14, 0x03, 0x80};
+const uint8_t TEXT_BOTTOM_RIGHT[] = {0x14, 0x04, 0x80};
+
+const uint8_t TEXT_MODE_TWO_LINES[] = {0x13, 0x15};
+const uint8_t TEXT_TOP_LINE[] = {0x14, 0x05, 0x80};
+const uint8_t TEXT_BOTTOM_LINE[] = {0x14, 0x0A, 0x80};
+const uint8_t TEXT_END[] = {0x80, 0x00};
+
+/** Text mode reports, by DisplayLayout::Mode */
+const uint8_t* const TEXT_MODE[DisplayLayout::MODE_COUNT] = { TEXT_MODE_TWO_LINES, TEXT_MODE_FOUR_CORNERS };
+enum { TEXT_MODE_SIZE = 2 };
+/** Slot select reports, by DisplayLayout::Mode and DisplayLayout::Slot */
+const uint8_t* const TEXT_SELECT[DisplayLayout::MODE_COUNT][DisplayLayout::SLOT_COUNT] = {
+    { TEXT_TOP_LINE, TEXT_BOTTOM_LINE, NULL, NULL },
+    { TEXT_TOP_LEFT, TEXT_BOTTOM_LEFT, TEXT_TOP_RIGHT, TEXT_BOTTOM_RIGHT }
+};
+
+/** Deadline for queued OUT/feature reports [ms] */
+const unsigned int WRITE_TIMEOUT = 500;
+/** Close() waits at most this long for frame chain to be written [ms] */
+const unsigned int CLOSE_DRAIN_TIMEOUT = 2 * WRITE_TIMEOUT;
+
+/* Periodic jobs [ms] */
+const unsigned int KEEPALIVE_PERIOD = 25000;
+const unsigned int SELF_TEST_STEP = 300;
+/** Idle clock is updated this long after wall clock second changes [ms], covers timer tick rounding */
+const unsigned int CLOCK_MARGIN = 10;
+
+/** Bottom line text for RingCadence::OUT_DISPLAY steps */
+const char RING_TEXT[] = "Incoming call";
+
+const E_KEY KEY_NONE = static_cast<E_KEY>(-1);
+
+/* Input report controls (telephony usage page) */
+enum { USAGE_PAGE_TELEPHONY = 0x0B };
+const uint32_t USAGE_HOOK_SWITCH = ReportDecoder::MakeUsage(USAGE_PAGE_TELEPHONY, 0x20);
+const uint32_t USAGE_FLASH = ReportDecoder::MakeUsage(USAGE_PAGE_TELEPHONY, 0x21);
+const uint32_t USAGE_HOLD = ReportDecoder::MakeUsage(USAGE_PAGE_TELEPHONY, 0x23);
+const uint32_t USAGE_REDIAL = ReportDecoder::MakeUsage(USAGE_PAGE_TELEPHONY, 0x24);
+const uint32_t USAGE_PHONE_MUTE = ReportDecoder::MakeUsage(USAGE_PAGE_TELEPHONY, 0x2F);
+const uint32_t USAGE_PHONE_KEY_0 = ReportDecoder::MakeUsage(USAGE_PAGE_TELEPHONY, 0xB0);
+const uint32_t USAGE_PHONE_KEY_POUND = ReportDecoder::MakeUsage(USAGE_PAGE_TELEPHONY, 0xBB);
+/** Long press flag (report[0] & 0x08) is not a telephony control - private usage for it */
+const uint32_t USAGE_LONG_PRESS = ReportDecoder::MakeUsage(0xFFFF, 0x0001);
+
+/** Names of PhoneSession::Dispatch button bits, for logs */
+const char* const BUTTON_NAMES[] = { "FLASH", "REDIAL", "HOLD", "MUTE", "long press flag" };
+
+/** \brief Input report layout as observed on CX300 (_doc/logs.txt), used for controls
+    that could not be found in report descriptor
+*/
+const ReportDecoder& GetDefaultLayout(void) {
+    static ReportDecoder decoder;
+    if (decoder.GetFieldCount() == 0) {
+        decoder.AddVariable(USAGE_HOOK_SWITCH, 0, 1);
+        decoder.AddVariable(USAGE_HOLD, 1, 1);
+        decoder.AddVariable(USAGE_REDIAL, 2, 1);
+        decoder.AddVariable(USAGE_LONG_PRESS, 3, 1);
+        decoder.AddVariable(USAGE_PHONE_MUTE, 4, 1);
+        decoder.AddVariable(USAGE_FLASH, 5, 1);
+        // report[1]: 0 = no key, 1...12 = 0...9, *, #
+        std::vector<uint32_t> keys(1, 0);
+        for (uint32_t usage = USAGE_PHONE_KEY_0; usage <= USAGE_PHONE_KEY_POUND; usage++) {
+            keys.push_back(usage);
+        }
+        decoder.AddArray(keys, 0, 8, 8);
+    }
+    return decoder;
+}
+
+/** \brief Characters '0'...'9' as encoded by DisplayText::EncodeLine() */
+const uint8_t DIGIT_GLYPHS[10][2] = {
+    {'0', 0x00}, {'1', 0x00}, {'2', 0x00}, {'3', 0x00}, {'4', 0x00},
+    {'5', 0x00}, {'6', 0x00}, {'7', 0x00}, {'8', 0x00}, {'9', 0x00}
+};
+
+/** Idle time line, hh:mm:ss - exactly one text report */
+const char CLOCK_TEMPLATE[] = "00:00:00";
+enum { CLOCK_HOURS_POS = 0, CLOCK_MINUTES_POS = 3, CLOCK_SECONDS_POS = 6 };
+
+/** \brief Overwrite two characters of encoded line with decimal value 0...99
+*/
+void PutTwoDigits(std::vector<uint8_t> &encoded, unsigned int textPos, unsigned int value) {
+    uint8_t *report = &encoded[(textPos / DisplayText::CHUNK_LENGTH) * DisplayText::REPORT_SIZE];
+    uint8_t *glyph = report + DisplayText::REPORT_HEADER + 2 * (textPos % DisplayText::CHUNK_LENGTH);
+    memcpy(glyph, DIGIT_GLYPHS[(value / 10) % 10], 2);
+    memcpy(glyph + 2, DIGIT_GLYPHS[value % 10], 2);
+}
+
+/** \brief Format report as in REPORT_IN log lines: "00 01 00 00 D5 5A 00 00"
+*/
+std::string ReportToString(const uint8_t *report, int size) {
+    std::string text;
+    char buf[4];
+    for (int i=0; i<size; i++) {
+        snprintf(buf, sizeof(buf), (i == 0) ? "%02X" : " %02X", report[i]);
+        text += buf;
+    }
+    return text;
+}
+
+}   // namespace
+
+#	define DET_LOG if (customConf.detailedLogging) LOG
+
+
+HostState::HostState(void):
+    regState(0),
+    callState(0),
+    ringState(0),
+    callStartUs(0),
+    displayGeneration(0),
+    ringGeneration(0),
+    ledGeneration(0)
+{
+}
+
+void HostState::Apply(const HostCommand &cmd, uint64_t nowUs) {
+    switch (cmd.type) {
+    case HostCommand::REGISTRATION_STATE:
+        regState = cmd.state;
+        displayGeneration++;
+        ledGeneration++;
+        break;
+    case HostCommand::CALL_STATE:
+        if (cmd.state == 0) {
+            callStartUs = 0;
+        } else if (callState == 0) {
+            callStartUs = nowUs;
+        }
+        callState = cmd.state;
+        callDisplay = cmd.display;
+        displayGeneration++;
+        break;
+    case HostCommand::RING:
+        if (ringState != cmd.state) {
+            ringState = cmd.state;
+            ringGeneration++;
+            ledGeneration++;
+        }
+        break;
+    case HostCommand::MWI:
+        mwiNewMessages[cmd.accountId] = cmd.newMessages;
+        displayGeneration++;
+        ledGeneration++;
+        break;
+    default:
+        break;
+    }
+}
+
+unsigned int HostState::GetNewMessages(int accountId) const {
+    if (accountId >= 0) {
+        std::map<int, unsigned int>::const_iterator iter = mwiNewMessages.find(accountId);
+        return (iter != mwiNewMessages.end()) ? iter->second : 0;
+    }
+    unsigned int sum = 0;
+    for (std::map<int, unsigned int>::const_iterator iter = mwiNewMessages.begin(); iter != mwiNewMessages.end(); ++iter) {
+        sum += iter->second;
+    }
+    return sum;
+}
+
+
+PhoneSession::PhoneSession(unsigned int id, const std::string &deviceId, TimerWheel &timers, const KeyMap &keyMap, const KeyMacroTable &keyMacros,
+    const DisplayLayout &layout):
+    id(id),
+    deviceId(deviceId),
+    accountId(-1),
+    present(false),
+    timers(timers),
+    keyMap(keyMap),
+    keyMacros(keyMacros),
+    layout(layout),
+    macroPlayer(timers),
+    writeError(0),
+    lastControl(KeyMap::CTRL_NONE),
+    pressedKeyCode(KEY_NONE),
+    lastOffHook(false),
+    reportUs(0),
+    timeSource(Clock::GetTimeUs),
+    wallTimeSource(Clock::GetWallTimeUs),
+    displayGeneration(0),
+    ringGeneration(0),
+    ledGeneration(0),
+    keepaliveTimer(TimerWheel::INVALID_TIMER),
+    clockTimer(TimerWheel::INVALID_TIMER),
+    ringTimer(TimerWheel::INVALID_TIMER),
+    selfTestTimer(TimerWheel::INVALID_TIMER),
+    marqueeTimer(TimerWheel::INVALID_TIMER),
+    keepaliveDue(false),
+    clockDue(false),
+    ledDue(false),
+    displayDue(false),
+    selfTestDue(false),
+    marqueeDue(false),
+    selfTestStep(-1),
+    detectedUs(0),
+    readerStartedMs(0),
+    keepaliveWrittenMs(0),
+    keepaliveWritten(0),
+    readyPending(false),
+    cadence(NULL),
+    ringStep(0),
+    ringStepUs(0),
+    ringOutputs(0)
+{
+}
+
+PhoneSession::~PhoneSession(void) {
+    CloseDevices();
+}
+
+void PhoneSession::CompileInputLayout(void) {
+    int status = decoder.Compile(hidDevice);
+    if (status != 0) {
+        LOG("Phone #%u: failed to compile input report layout: %s", id, HidDevice::GetErrorDesc(status).c_str());
+    }
+    ResolveInputLayout();
+}
+
+void PhoneSession::ResolveInputLayout(void) {
+    // controls missing in descriptor (or moved to unknown usages) are taken from default layout
+    const ReportDecoder &defaults = GetDefaultLayout();
+    const uint32_t required[] = { USAGE_HOOK_SWITCH, USAGE_HOLD, USAGE_REDIAL, USAGE_FLASH, USAGE_PHONE_MUTE, USAGE_LONG_PRESS, USAGE_PHONE_KEY_0 };
+    for (unsigned int i=0; i<sizeof(required)/sizeof(required[0]); i++) {
+        if (!decoder.Resolve(required[i]).IsValid()) {
+            DET_LOG("Phone #%u: usage 0x%08X not found in input report, using default location", id, required[i]);
+            decoder.AddField(defaults.GetField(defaults.Resolve(required[i]).field));
+        }
+    }
+
+    input.hook = decoder.Resolve(USAGE_HOOK_SWITCH);
+    input.hold = decoder.Resolve(USAGE_HOLD);
+    input.redial = decoder.Resolve(USAGE_REDIAL);
+    input.flash = decoder.Resolve(USAGE_FLASH);
+    input.mute = decoder.Resolve(USAGE_PHONE_MUTE);
+    input.longPress = decoder.Resolve(USAGE_LONG_PRESS);
+    input.keypad = decoder.Resolve(USAGE_PHONE_KEY_0).field;
+    DET_LOG("Phone #%u: input report layout:\n%s", id, decoder.ToString().c_str());
+    CompileDispatch();
+}
+
+void PhoneSession::CompileDispatch(void) {
+    memset(dispatch.keypad, KeyMap::CTRL_NONE, sizeof(dispatch.keypad));
+    if (input.keypad >= 0) {
+        const ReportDecoder::Field &f = decoder.GetField(input.keypad);
+        for (unsigned int i=0; i<f.usages.size() && i<sizeof(dispatch.keypad); i++) {
+            // usages of keypad keys are in KeyMap order: 0...9, *, #
+            if (f.usages[i] >= USAGE_PHONE_KEY_0 && f.usages[i] <= USAGE_PHONE_KEY_POUND) {
+                dispatch.keypad[i] = static_cast<uint8_t>(KeyMap::CTRL_0 + (f.usages[i] - USAGE_PHONE_KEY_0));
+            } else if (f.usages[i] != 0) {
+                DET_LOG("Phone #%u: unhandled key usage 0x%08X", id, f.usages[i]);
+            }
+        }
+    }
+
+    // buttons act only when pressed alone, not in reports repeated with long press flag
+    memset(dispatch.buttons, KeyMap::CTRL_NONE, sizeof(dispatch.buttons));
+    dispatch.buttons[Dispatch::BUTTON_FLASH] = KeyMap::CTRL_FLASH;
+    dispatch.buttons[Dispatch::BUTTON_REDIAL] = KeyMap::CTRL_REDIAL;
+    dispatch.buttons[Dispatch::BUTTON_HOLD] = KeyMap::CTRL_HOLD;
+    dispatch.buttons[Dispatch::BUTTON_MUTE] = KeyMap::CTRL_MUTE;
+
+    // with all buttons as single bits of the same byte (as in CX300 report[0]) mask is one lookup
+    const ReportDecoder::Location* locations[Dispatch::BUTTON_COUNT] = {
+        &input.flash, &input.redial, &input.hold, &input.mute, &input.longPress
+    };
+    dispatch.buttonByte = -1;
+    bool sameByte = true;
+    for (unsigned int i=0; i<Dispatch::BUTTON_COUNT; i++) {
+        if (!locations[i]->IsValid()) {
+            continue;
+        }
+        const ReportDecoder::Field &f = decoder.GetField(locations[i]->field);
+        int byte = f.bitOffset / 8;
+        if (f.array || f.bitSize != 1 || (dispatch.buttonByte >= 0 && dispatch.buttonByte != byte)) {
+            sameByte = false;
+            break;
+        }
+        dispatch.buttonByte = byte;
+    }
+    if (!sameByte) {
+        dispatch.buttonByte = -1;
+    } else if (dispatch.buttonByte >= 0) {
+        for (unsigned int value=0; value<sizeof(dispatch.buttonMask); value++) {
+            uint8_t mask = 0;
+            for (unsigned int i=0; i<Dispatch::BUTTON_COUNT; i++) {
+                if (locations[i]->IsValid() && (value & (1 << (decoder.GetField(locations[i]->field).bitOffset % 8)))) {
+                    mask |= (1 << i);
+                }
+            }
+            dispatch.buttonMask[value] = mask;
+        }
+    }
+}
+
+unsigned int PhoneSession::GetButtons(const uint8_t *report, unsigned int size) const {
+    if (dispatch.buttonByte >= 0) {
+        return (static_cast<unsigned int>(dispatch.buttonByte) < size) ? dispatch.buttonMask[report[dispatch.buttonByte]] : 0;
+    }
+    unsigned int mask = 0;
+    mask |= decoder.IsActive(report, size, input.flash) ? Dispatch::BUTTON_FLASH : 0;
+    mask |= decoder.IsActive(report, size, input.redial) ? Dispatch::BUTTON_REDIAL : 0;
+    mask |= decoder.IsActive(report, size, input.hold) ? Dispatch::BUTTON_HOLD : 0;
+    mask |= decoder.IsActive(report, size, input.mute) ? Dispatch::BUTTON_MUTE : 0;
+    mask |= decoder.IsActive(report, size, input.longPress) ? Dispatch::BUTTON_LONG_PRESS : 0;
+    return mask;
+}
+
+void PhoneSession::PressControl(unsigned int control, const HostState &state) {
+    pressedKeyCode = KEY_NONE;
+    const KeyMacro *macro = keyMacros.Find(control, false);
+    if (macro) {
+        DET_LOG("Phone #%u: control %u, starting macro %s", id, control, macro->name.c_str());
+        StartMacro(*macro);
+        return;
+    }
+    const KeyAction &action = keyMap.Get(control);
+    if (action.type == KeyAction::KEY) {
+        pressedKeyCode = state.ringState ? action.keyCodeRinging : action.keyCode;
+        DET_LOG("Phone #%u: key code = %d, active", id, pressedKeyCode);
+        SendKey(pressedKeyCode, 1);
+    } else {
+        RunAction(action);
+    }
+}
+
+void PhoneSession::ReleaseControl(void) {
+    if (pressedKeyCode != KEY_NONE) {
+        DET_LOG("Phone #%u: key code = %d, inactive", id, pressedKeyCode);
+        SendKey(pressedKeyCode, 0);
+        pressedKeyCode = KEY_NONE;
+    }
+}
+
+void PhoneSession::SendKey(int keyCode, int state) {
+    uint64_t startUs = Clock::GetTimeUs();
+    Key(keyCode, state);
+    uint64_t endUs = Clock::GetTimeUs();
+    latency.Record(LatencyStats::KEY_CALLBACK, endUs - startUs);
+    if (reportUs) {
+        // report time may come from other (virtual) clock
+        uint64_t nowUs = timeSource();
+        latency.Record(LatencyStats::READ_TO_KEY, (nowUs > reportUs) ? nowUs - reportUs : 0);
+    }
+}
+
+void PhoneSession::RunAction(const KeyAction &action) {
+    switch (action.type) {
+    case KeyAction::SCRIPT:
+        RunScriptAsync(action.script.c_str());
+        break;
+    case KeyAction::REDIAL:
+        Redial();
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+    Third byte = 0x03 => phone is receiving audio
+    Fourth byte: type of audio device (handset/spkeaker/headset)
+*/
+void PhoneSession::HandleReportIn(const uint8_t *report, unsigned int size, uint64_t timestampUs, const HostState &state) {
+    uint64_t nowUs = timeSource();
+    latency.Record(LatencyStats::READ_TO_DECODE, (nowUs > timestampUs) ? nowUs - timestampUs : 0);
+    reportUs = timestampUs;
+    unsigned int control = KeyMap::CTRL_NONE;
+    if (input.keypad >= 0) {
+        uint32_t index = decoder.GetArrayIndex(report, size, input.keypad);
+        if (index < sizeof(dispatch.keypad)) {
+            control = dispatch.keypad[index];
+        }
+    }
+
+    unsigned int buttons = GetButtons(report, size);
+    buttonTracker.Update(buttons, timestampUs);
+    unsigned int released = buttonTracker.GetReleased();
+    for (unsigned int i=0; released >> i; i++) {
+        if (released & (1 << i)) {
+            DET_LOG("Phone #%u: %s released after %u ms", id, BUTTON_NAMES[i],
+                static_cast<unsigned int>(buttonTracker.GetDuration(i) / 1000));
+        }
+    }
+
+    // buttons act only when pressed alone; long press flag is not a button
+    unsigned int button = dispatch.buttons[buttons & ~Dispatch::BUTTON_LONG_PRESS];
+    if (button != KeyMap::CTRL_NONE) {
+        const KeyAction &action = keyMap.Get(button);
+        if (action.type == KeyAction::KEY) {
+            // pressed and released like keypad key
+            control = button;
+        } else if (buttonTracker.GetPressed() & buttons & ~Dispatch::BUTTON_LONG_PRESS) {
+            // once per press, not for reports repeated while button is held
+            RunAction(action);
+        }
+    }
+
+    if (lastControl == KeyMap::CTRL_NONE && control != KeyMap::CTRL_NONE) {
+        PressControl(control, state);
+    } else if (lastControl != KeyMap::CTRL_NONE && control == KeyMap::CTRL_NONE) {
+        ReleaseControl();
+    }
+
+    if (control != KeyMap::CTRL_NONE && control == lastControl && (buttonTracker.GetPressed() & Dispatch::BUTTON_LONG_PRESS)) {
+        // long press flag is repeated while key is held - macro is started on its edge only
+        DET_LOG("Phone #%u: control %u, long press", id, control);
+        const KeyMacro *macro = keyMacros.Find(control, true);
+        if (macro) {
+            DET_LOG("Phone #%u: starting macro %s", id, macro->name.c_str());
+            StartMacro(*macro);
+        }
+    }
+
+    lastControl = control;
+
+    bool offHook = decoder.IsActive(report, size, input.hook);
+    if (offHook != lastOffHook) {
+        DET_LOG("Phone #%u: OFF HOOK = %d", id, static_cast<int>(offHook));
+        SendKey(KEY_HOOK, offHook ? 0 : 1); // tSIP: 1 = handset down
+    }
+    lastOffHook = offHook;
+    reportUs = 0;
+}
+
+void PhoneSession::StartMacro(const KeyMacro &macro) {
+    if (!macroPlayer.Start(macro)) {
+        LOG("Phone #%u: too many key macros queued, macro %s dropped", id, macro.name.c_str());
+    }
+}
+
+void PhoneSession::CloseDevices(void) {
+    StopTimers();
+    macroPlayer.Stop();
+    hidDevice.Close();
+    hidDeviceDisplay.Close();
+    // writers are stopped, no completion can come anymore
+    chain.Reset();
+    shadow.Invalidate();
+}
+
+int PhoneSession::OpenDevices(const std::string &basicPath, const std::string &displayPath) {
+    int status = hidDevice.OpenPath(basicPath, BASIC_USAGE_PAGE);
+    if (status == 0) {
+        LOG("Phone #%u: HID device for telephony connected", id);
+        status = hidDeviceDisplay.OpenPath(displayPath, DISPLAY_USAGE_PAGE);
+        if (status != 0) {
+            LOG("Phone #%u: failed to open display HID device", id);
+            hidDevice.Close();
+        } else {
+            LOG("Phone #%u: HID device for display connected", id);
+        }
+    }
+    return status;
+}
+
+void PhoneSession::ResetInputState(void) {
+    lastControl = KeyMap::CTRL_NONE;
+    buttonTracker.Reset();
+    pressedKeyCode = KEY_NONE;
+    lastOffHook = false;
+}
+
+void PhoneSession::ResetInput(void) {
+    macroPlayer.Stop();
+    decoder.Clear();
+    ResolveInputLayout();
+    ResetInputState();
+}
+
+int PhoneSession::Open(const std::string &basicPath, const std::string &displayPath, uint64_t detectedUs) {
+    int status = OpenDevices(basicPath, displayPath);
+    if (status != 0) {
+        LOG("Phone #%u: error opening HID device: %s", id, HidDevice::GetErrorDesc(status).c_str());
+        return status;
+    }
+    this->basicPath = basicPath;
+    this->displayPath = displayPath;
+
+    if (customConf.detailedLogging) {
+        static bool once = false;
+        if (!once) {
+            once = true;
+            std::string dump;
+            status = hidDevice.DumpCapabilities(dump);
+            LOG("HID device: %s", dump.c_str());
+            if (status == 0) {
+                dump.clear();
+                status = hidDeviceDisplay.DumpCapabilities(dump);
+                LOG("HID display device: %s", dump.c_str());
+            }
+        }
+    }
+
+    __atomic_store_n(&writeError, 0, __ATOMIC_RELEASE);
+    ResetInputState();
+    this->detectedUs = detectedUs;
+    __atomic_store_n(&keepaliveWritten, 0, __ATOMIC_RELEASE);
+    status = SendKeepalive();
+    if (status != 0) {
+        CloseDevices();
+        return status;
+    }
+    ClearDisplay();
+
+    CompileInputLayout();
+    status = hidDevice.StartReading();
+    if (status != 0) {
+        LOG("Phone #%u: failed to start HID reader: %s", id, HidDevice::GetErrorDesc(status).c_str());
+        CloseDevices();
+        return status;
+    }
+    readerStartedMs = static_cast<unsigned int>((Clock::GetTimeUs() - detectedUs) / 1000);
+    readyPending = true;
+    // force display and ring update
+    displayGeneration--;
+    ringGeneration--;
+    ledGeneration--;
+    StartTimers();
+    if (customConf.ledSelfTest) {
+        // first pattern is written by following Poll(), input is read while test is running
+        selfTestStep = 0;
+        selfTestDue = true;
+    }
+    present = true;
+    return 0;
+}
+
+int PhoneSession::Reopen(uint64_t detectedUs) {
+    if (basicPath.empty()) {
+        return HidDevice::E_ERR_NOTFOUND;
+    }
+    return Open(basicPath, displayPath, detectedUs);
+}
+
+bool PhoneSession::IsOpened(void) const {
+    return hidDevice.IsOpened();
+}
+
+void PhoneSession::OnKeepaliveTimer(void *opaque) {
+    reinterpret_cast<PhoneSession*>(opaque)->keepaliveDue = true;
+}
+
+void PhoneSession::OnClockTimer(void *opaque) {
+    PhoneSession *phone = reinterpret_cast<PhoneSession*>(opaque);
+    phone->clockTimer = TimerWheel::INVALID_TIMER;
+    phone->clockDue = true;
+}
+
+void PhoneSession::ScheduleClock(void) {
+    // wake up once per second, right after displayed second changes
+    uint64_t wallUs = wallTimeSource();
+    uint64_t delayUs = 1000000 - (wallUs % 1000000) + CLOCK_MARGIN * 1000ULL;
+    clockTimer = timers.Schedule(delayUs, 0, OnClockTimer, this);
+}
+
+void PhoneSession::OnMarqueeTimer(void *opaque) {
+    PhoneSession *phone = reinterpret_cast<PhoneSession*>(opaque);
+    phone->marqueeDue = true;
+}
+
+void PhoneSession::OnSelfTestTimer(void *opaque) {
+    PhoneSession *phone = reinterpret_cast<PhoneSession*>(opaque);
+    phone->selfTestTimer = TimerWheel::INVALID_TIMER;
+    phone->selfTestDue = true;
+}
+
+int PhoneSession::SelfTestStep(void) {
+    if (selfTestStep >= SELF_TEST_PATTERN_COUNT) {
+        // last pattern shown long enough - LED returns to normal state
+        selfTestStep = -1;
+        ledDue = true;
+        return 0;
+    }
+    int status = SetLed(SELF_TEST_PATTERNS[selfTestStep], false);
+    if (status != 0) {
+        LOG("Phone #%u: error writing LED pattern #%d", id, selfTestStep);
+        return status;
+    }
+    selfTestStep++;
+    selfTestTimer = timers.Schedule(SELF_TEST_STEP * 1000ULL, 0, OnSelfTestTimer, this);
+    return 0;
+}
+
+void PhoneSession::OnRingTimer(void *opaque) {
+    PhoneSession *phone = reinterpret_cast<PhoneSession*>(opaque);
+    phone->ringTimer = TimerWheel::INVALID_TIMER;
+    phone->NextRingStep();
+}
+
+void PhoneSession::ScheduleRingStep(void) {
+    // step end is counted from cadence start, so timer rounding does not accumulate
+    uint64_t end = ringStepUs + cadence->GetStep(ringStep).durationMs * 1000ULL;
+    uint64_t now = timers.GetTime();
+    ringTimer = timers.Schedule((end > now) ? end - now : 0, 0, OnRingTimer, this);
+}
+
+void PhoneSession::NextRingStep(void) {
+    ringStepUs += cadence->GetStep(ringStep).durationMs * 1000ULL;
+    ringStep++;
+    if (ringStep >= cadence->GetStepCount()) {
+        ringStep = 0;
+    }
+    uint8_t outputs = cadence->GetStep(ringStep).outputs;
+    uint8_t changed = outputs ^ ringOutputs;
+    ringOutputs = outputs;
+    if (changed & (RingCadence::OUT_LED | RingCadence::OUT_SPEAKER_LED)) {
+        ledDue = true;
+    }
+    if (changed & RingCadence::OUT_DISPLAY) {
+        displayDue = true;
+    }
+    ScheduleRingStep();
+}
+
+void PhoneSession::StartTimers(void) {
+    StopTimers();
+    keepaliveDue = clockDue = ledDue = displayDue = marqueeDue = false;
+    keepaliveTimer = timers.Schedule(KEEPALIVE_PERIOD * 1000ULL, KEEPALIVE_PERIOD * 1000ULL, OnKeepaliveTimer, this);
+    // clock timer is started by first display update, if idle clock is shown
+}
+
+void PhoneSession::StopTimers(void) {
+    timers.Cancel(keepaliveTimer);
+    timers.Cancel(clockTimer);
+    timers.Cancel(ringTimer);
+    timers.Cancel(selfTestTimer);
+    timers.Cancel(marqueeTimer);
+    keepaliveTimer = clockTimer = ringTimer = selfTestTimer = marqueeTimer = TimerWheel::INVALID_TIMER;
+    ringOutputs = 0;
+    selfTestDue = false;
+    selfTestStep = -1;
+}
+
+/** \brief Completion of queued writes, called from HidDevice writer thread
+*/
+void PhoneSession::OnWriteDone(void *opaque, int status) {
+    if (status != 0) {
+        PhoneSession *phone = reinterpret_cast<PhoneSession*>(opaque);
+        if (status == HidDevice::E_ERR_TIMEOUT) {
+            __atomic_fetch_add(&stats.writeTimeouts, 1, __ATOMIC_RELAXED);
+        } else {
+            __atomic_fetch_add(&stats.writeErrors, 1, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&phone->writeError, status, __ATOMIC_RELEASE);
+        // idle comm thread may sleep until keepalive: let it handle error now
+        PolycomCX300::Wake();
+    }
+}
+
+/** \brief Keepalive write completion: first one after Open() is the last step to ready phone
+*/
+void PhoneSession::OnKeepaliveWritten(void *opaque, int status) {
+    OnWriteDone(opaque, status);
+    PhoneSession *phone = reinterpret_cast<PhoneSession*>(opaque);
+    if (status == 0 && !__atomic_load_n(&phone->keepaliveWritten, __ATOMIC_ACQUIRE)) {
+        phone->keepaliveWrittenMs = static_cast<unsigned int>((Clock::GetTimeUs() - phone->detectedUs) / 1000);
+        __atomic_store_n(&phone->keepaliveWritten, 1, __ATOMIC_RELEASE);
+        // count ready time without waiting for next timer
+        PolycomCX300::Wake();
+    }
+}
+
+void PhoneSession::OnChainWriteDone(void *opaque, int status) {
+    PhoneSession *phone = reinterpret_cast<PhoneSession*>(opaque);
+    OnWriteDone(opaque, status);
+    __atomic_store_n(&phone->chain.inFlight, 0, __ATOMIC_RELEASE);
+    // next run is queued by comm thread (single producer of write queues)
+    PolycomCX300::Wake();
+}
+
+int PhoneSession::PumpChain(void) {
+    unsigned int count = chain.frame.lengths.size();
+    if (chain.next >= count || __atomic_load_n(&chain.inFlight, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    HidDevice *dev = chain.frame.devs[chain.next];
+    unsigned int end = chain.next;
+    unsigned int bytes = 0;
+    while (end < count && chain.frame.devs[end] == dev) {
+        bytes += chain.frame.lengths[end];
+        end++;
+    }
+    chain.inFlight = 1;
+    int status = dev->SubmitFrameOut(&chain.frame.data[chain.dataPos], &chain.frame.lengths[chain.next], end - chain.next,
+        WRITE_TIMEOUT, OnChainWriteDone, this);
+    if (status != 0) {
+        chain.Reset();
+        return status;
+    }
+    stats.outReportsSubmitted += end - chain.next;
+    chain.next = end;
+    chain.dataPos += bytes;
+    if (chain.next >= count) {
+        // reports are copied into write queue
+        chain.frame.Clear();
+        chain.next = chain.dataPos = 0;
+    }
+    return 0;
+}
+
+void PhoneSession::DrainChain(unsigned int timeout) {
+    HidDevice* const devs[] = { &hidDevice, &hidDeviceDisplay };
+    uint64_t endUs = Clock::GetTimeUs() + timeout * 1000ULL;
+    while (chain.IsActive()) {
+        if (PumpChain() != 0) {
+            return;     // chain is reset
+        }
+        // run in flight is completed before its write queue is empty
+        for (unsigned int i=0; i<sizeof(devs)/sizeof(devs[0]); i++) {
+            uint64_t nowUs = Clock::GetTimeUs();
+            if (nowUs >= endUs || devs[i]->Flush(static_cast<unsigned int>((endUs - nowUs + 999) / 1000)) != 0) {
+                LOG("Phone #%u: frame chain not written within %u ms", id, timeout);
+                return;
+            }
+        }
+        if (__atomic_load_n(&chain.inFlight, __ATOMIC_ACQUIRE)) {
+            return;     // writer is not running, completion cannot come
+        }
+    }
+}
+
+int PhoneSession::WriteOut(HidDevice &dev, const uint8_t *buffer, int len) {
+    if (chain.IsActive()) {
+        // keep order behind frame still being written to other interface
+        OutFrame frame;
+        frame.Add(dev, buffer, len);
+        return SubmitFrame(frame);
+    }
+    int status = dev.SubmitReportOut(buffer, len, WRITE_TIMEOUT, OnWriteDone, this);
+    if (status == 0) {
+        stats.outReportsSubmitted++;
+    }
+    return status;
+}
+
+int PhoneSession::SubmitFrame(const OutFrame &frame) {
+    unsigned int count = frame.lengths.size();
+    if (count == 0)
+        return 0;
+    bool singleDevice = true;
+    for (unsigned int i=1; i<count; i++) {
+        if (frame.devs[i] != frame.devs[0]) {
+            singleDevice = false;
+            break;
+        }
+    }
+    if (!singleDevice || chain.IsActive()) {
+        // reports go to both interfaces (Windows 7): separate write queues would not keep
+        // the order between them, chain runs through completions instead
+        chain.frame.Append(frame);
+        return PumpChain();
+    }
+    int status = frame.devs[0]->SubmitFrameOut(&frame.data[0], &frame.lengths[0], count, WRITE_TIMEOUT, OnWriteDone, this);
+    if (status == 0) {
+        stats.outReportsSubmitted += count;
+    }
+    return status;
+}
+
+int PhoneSession::ClearDisplay(void) {
+#ifdef TARGET_WINDOWS7
+    HidDevice &dev = hidDevice;
+#else
+    HidDevice &dev = hidDeviceDisplay;
+#endif // TARGET_WINDOWS7
+    shadow.InvalidateText();
+    return WriteOut(dev, DISPLAY_CLEAR, sizeof(DISPLAY_CLEAR));
+}
+
+int PhoneSession::SetDisplayTwoLines(const std::string &line1, const std::string &line2) {
+    const std::vector<uint8_t> *slots[DisplayLayout::SLOT_COUNT] = {
+        displayCache.Get(DisplayLayout::TWO_LINES, DisplayLayout::TOP, line1),
+        displayCache.Get(DisplayLayout::TWO_LINES, DisplayLayout::BOTTOM, line2),
+        NULL, NULL
+    };
+    return WriteScreen(DisplayLayout::TWO_LINES, slots);
+}
+
+int PhoneSession::WriteScreen(enum DisplayLayout::Mode mode, const std::vector<uint8_t>* const *encoded) {
+#ifdef TARGET_WINDOWS7
+    HidDevice &dev = hidDevice;
+    // when trying to write 3 bytes on Windows 7: GetLastError = 1784 (The supplied user buffer is not valid for the requested operation.)
+    // on Windows 10 this is fine
+    enum { LINE_SEL_SIZE = 2 };
+#else
+    HidDevice &dev = hidDeviceDisplay;
+    enum { LINE_SEL_SIZE = 3 };
+#endif // TARGET_WINDOWS7
+
+    OutFrame frame;
+    if (shadow.textMode == mode) {
+        stats.outReportsSuppressed++;
+    } else {
+        // switching text mode blanks display: every slot has to be written again
+        shadow.InvalidateText();
+        frame.Add(dev, TEXT_MODE[mode], TEXT_MODE_SIZE);
+    }
+
+    // only slots whose text changed are written, e.g. call timer does not resend caller ID
+    unsigned int slotCount = (mode == DisplayLayout::FOUR_CORNERS) ? DisplayLayout::SLOT_COUNT : 2;
+    bool slotChanged[DisplayLayout::SLOT_COUNT];
+    for (unsigned int i=0; i<slotCount; i++) {
+        const std::vector<uint8_t> &text = *encoded[i];
+        slotChanged[i] = !(shadow.slotValid[i] && shadow.slot[i] == text);
+        if (!slotChanged[i]) {
+            stats.outReportsSuppressed += 1 + text.size() / DisplayText::REPORT_SIZE;
+            continue;
+        }
+        frame.Add(dev, TEXT_SELECT[mode][i], LINE_SEL_SIZE);
+        for (unsigned int pos = 0; pos < text.size(); pos += DisplayText::REPORT_SIZE) {
+            frame.Add(hidDeviceDisplay, &text[pos], DisplayText::REPORT_SIZE);
+        }
+    }
+
+    int status = SubmitFrame(frame);
+    if (status != 0) {
+        LOG("Phone #%u: error writing display frame: %s", id, HidDevice::GetErrorDesc(status).c_str());
+        shadow.InvalidateText();
+        return status;
+    }
+
+    shadow.textMode = mode;
+    for (unsigned int i=0; i<slotCount; i++) {
+        if (slotChanged[i]) {
+            shadow.slot[i] = *encoded[i];
+            shadow.slotValid[i] = true;
+        }
+    }
+    return status;
+}
+
+int PhoneSession::UpdateDisplay(const HostState &state) {
+    displayGeneration = state.displayGeneration;
+    /** \note Do not clear display here - it is redundant and causes flickering */
+
+    enum DisplayLayout::ScreenId screenId;
+    if (state.ringState) {
+        screenId = DisplayLayout::SCREEN_RINGING;
+    } else if (state.callState == 0 && state.callDisplay.empty()) {
+        screenId = DisplayLayout::SCREEN_IDLE;
+    } else {
+        screenId = DisplayLayout::SCREEN_CALL;
+    }
+    const DisplayLayout::Screen &screen = layout.Get(screenId);
+
+    if (screen.IsTimed()) {
+        if (clockTimer == TimerWheel::INVALID_TIMER) {
+            ScheduleClock();
+        }
+    } else {
+        // static text: no clock wakeups until timed screen is shown again
+        timers.Cancel(clockTimer);
+        clockTimer = TimerWheel::INVALID_TIMER;
+    }
+
+    unsigned int cells = DisplayLayout::GetSlotCells(screen.mode);
+    unsigned int slotCount = screen.GetSlotCount();
+    for (unsigned int i=0; i<slotCount; i++) {
+        if (screen.regions[i] == DisplayLayout::REGION_DATE || screen.regions[i] == DisplayLayout::REGION_CLOCK) {
+            RenderIdleClock(cells);
+            break;
+        }
+    }
+    const std::vector<uint8_t> *encoded[DisplayLayout::SLOT_COUNT] = { NULL, NULL, NULL, NULL };
+    bool scrolling = false;
+    for (unsigned int i=0; i<DisplayLayout::SLOT_COUNT; i++) {
+        if (i >= slotCount || screen.regions[i] != DisplayLayout::REGION_CALLER) {
+            marquee[i].Clear();
+        }
+        if (i < slotCount) {
+            encoded[i] = RenderRegion(screen.regions[i], screen.mode, i, state);
+            scrolling = scrolling || marquee[i].IsScrolling();
+        }
+    }
+    int status = WriteScreen(screen.mode, encoded);
+
+    if (scrolling) {
+        if (marqueeTimer == TimerWheel::INVALID_TIMER) {
+            uint64_t periodUs = customConf.marqueeStepMs * 1000ULL;
+            marqueeTimer = timers.Schedule(periodUs, periodUs, OnMarqueeTimer, this);
+        }
+    } else {
+        timers.Cancel(marqueeTimer);
+        marqueeTimer = TimerWheel::INVALID_TIMER;
+        marqueeDue = false;
+    }
+
+    if (status != 0) {
+        LOG("Phone #%u: UpdateDisplay status/error = %d", id, status);
+    }
+    return status;
+}
+
+void PhoneSession::RenderIdleClock(unsigned int dateCells) {
+    time_t now = static_cast<time_t>(wallTimeSource() / 1000000);
+    if (idleClock.minuteStart == -1 || now < idleClock.minuteStart || now >= idleClock.minuteStart + 60 ||
+            dateCells != idleClock.dateCells) {
+        // new minute (or wall clock was adjusted): time zone and DST are applied here
+        struct tm *timeinfo = localtime(&now);
+        if (timeinfo == NULL) {
+            return;
+        }
+        idleClock.minuteStart = now - timeinfo->tm_sec;
+        int day = timeinfo->tm_year * 1000 + timeinfo->tm_yday;
+        if (day != idleClock.day || dateCells != idleClock.dateCells) {
+            char text[32];
+            // full weekday name does not fit into corner
+            strftime(text, sizeof(text), (dateCells < DisplayText::MAX_LINE_CELLS) ? "%a %Y-%m-%d" : "%A %Y-%m-%d", timeinfo);
+            DisplayText::EncodeLine(text, strlen(text), dateCells, idleClock.line[0]);
+            idleClock.day = day;
+            idleClock.dateCells = dateCells;
+            stats.clockDateRenders++;
+        }
+        if (idleClock.line[1].empty()) {
+            DisplayText::EncodeLine(CLOCK_TEMPLATE, sizeof(CLOCK_TEMPLATE) - 1, DisplayText::MAX_LINE_CELLS, idleClock.line[1]);
+        }
+        PutTwoDigits(idleClock.line[1], CLOCK_HOURS_POS, timeinfo->tm_hour);
+        PutTwoDigits(idleClock.line[1], CLOCK_MINUTES_POS, timeinfo->tm_min);
+    }
+    PutTwoDigits(idleClock.line[1], CLOCK_SECONDS_POS, static_cast<unsigned int>(now - idleClock.minuteStart));
+    stats.clockTicks++;
+}
+
+const std::vector<uint8_t>* PhoneSession::RenderRegion(unsigned int region, enum DisplayLayout::Mode mode, unsigned int slot, const HostState &state) {
+    // unchanged date line is suppressed by shadow compare, as any other unchanged region
+    if (region == DisplayLayout::REGION_DATE && !idleClock.line[0].empty()) {
+        return &idleClock.line[0];
+    }
+    if (region == DisplayLayout::REGION_CLOCK && !idleClock.line[1].empty()) {
+        return &idleClock.line[1];
+    }
+
+    char text[32] = "";
+    switch (region) {
+    case DisplayLayout::REGION_CALLER:
+        // UTF-8 caller ID: encoded once per text, scrolled or cut to slot width;
+        // text that fits is cached (repeated calls), scrolled text is kept by marquee during call
+        if (!state.callDisplay.empty()) {
+            if (!marquee[slot].IsScrolling()) {
+                const std::vector<uint8_t> *cached = displayCache.Find(mode, slot, state.callDisplay);
+                if (cached) {
+                    marquee[slot].Clear();
+                    return cached;
+                }
+            }
+            marquee[slot].Set(state.callDisplay, DisplayLayout::GetSlotCells(mode), customConf.marqueeStepMs != 0);
+            const std::vector<uint8_t> &frame = marquee[slot].GetFrame();
+            if (marquee[slot].IsScrolling()) {
+                return &frame;
+            }
+            if (!frame.empty()) {
+                return displayCache.Insert(mode, slot, state.callDisplay, frame);
+            }
+        } else {
+            marquee[slot].Clear();
+        }
+        break;
+    case DisplayLayout::REGION_STATUS:
+        snprintf(text, sizeof(text), "%s", state.regState ? "Registered" : "Not registered");
+        break;
+    case DisplayLayout::REGION_CALL_TIME:
+        if (state.callStartUs != 0) {
+            unsigned int seconds = static_cast<unsigned int>((timers.GetTime() - state.callStartUs) / 1000000);
+            if (seconds < 3600) {
+                snprintf(text, sizeof(text), "%u:%02u", seconds / 60, seconds % 60);
+            } else {
+                snprintf(text, sizeof(text), "%u:%02u:%02u", seconds / 3600, (seconds / 60) % 60, seconds % 60);
+            }
+            DisplayText::EncodeLine(text, strlen(text), DisplayLayout::GetSlotCells(mode), regionText[slot]);
+            return &regionText[slot];
+        }
+        break;
+    case DisplayLayout::REGION_ACCOUNT:
+        if (accountId >= 0) {
+            snprintf(text, sizeof(text), "Account %d", accountId);
+        } else {
+            snprintf(text, sizeof(text), "All accounts");
+        }
+        break;
+    case DisplayLayout::REGION_MESSAGES: {
+        unsigned int messages = state.GetNewMessages(accountId);
+        if (messages) {
+            snprintf(text, sizeof(text), "%u new message%s", messages, (messages == 1) ? "" : "s");
+        }
+        break;
+    }
+    case DisplayLayout::REGION_RING:
+        if (state.ringState && (ringOutputs & RingCadence::OUT_DISPLAY)) {
+            snprintf(text, sizeof(text), "%s", RING_TEXT);
+        }
+        break;
+    default:
+        break;
+    }
+    if (text[0] == '\0') {
+        // blank slot is written as space, overwriting previous text
+        text[0] = ' ';
+        text[1] = '\0';
+    }
+    return displayCache.Get(mode, slot, text);
+}
+
+int PhoneSession::UpdateRing(const HostState &state) {
+    ringGeneration = state.ringGeneration;
+    timers.Cancel(ringTimer);
+    ringTimer = TimerWheel::INVALID_TIMER;
+    ringOutputs = 0;
+    // Does CX300 has a ringer? Probably not - ringing is indicated with LEDs and display.
+    if (state.ringState) {
+        // cadence starts with its first step right away
+        cadence = &RingCadence::Get(customConf.ringType);
+        ringStep = 0;
+        ringStepUs = timers.GetTime();
+        ringOutputs = cadence->GetStep(0).outputs;
+        ScheduleRingStep();
+    }
+    ledDue = true;
+    displayDue = true;
+    DET_LOG("Phone #%u: UpdateRing: state = %d, type = %u (%s)", id, state.ringState, customConf.ringType,
+        RingCadence::Get(customConf.ringType).GetName());
+    return 0;
+}
+
+int PhoneSession::SendKeepalive(void) {
+    // Send feature report - without this the phone asks to upgrade Office Communicator
+    // report id = 0x17, language (0x09 = EN)
+    unsigned char sendbuf[] = {0x17, 0x09, 0x04, 0x01, 0x02};
+    int status = hidDeviceDisplay.SubmitReport(HidDevice::E_REPORT_FEATURE, sendbuf[0], sendbuf+1, sizeof(sendbuf)-1,
+        WRITE_TIMEOUT, OnKeepaliveWritten, this);
+    if (status != 0) {
+        LOG("Phone #%u: error sending keepalive: %s", id, HidDevice::GetErrorDesc(status).c_str());
+    } else {
+        DET_LOG("Phone #%u: keepalive queued", id);
+    }
+    return status;
+}
+
+int PhoneSession::SetLed(const uint8_t *leds, bool voicemail) {
+    // According to Wireshark this sends 3 bytes, not 2.
+    // Python with cx300.py and hid/hidapi behaves the same way under Windows.
+    // WTF?
+    // it looks like third byte controls voicemail LED and speakerphone
+    uint8_t buf[sizeof(shadow.led)];
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, leds, sizeof(STATUS_LED_GREEN));
+    // buf[2]: 0x10 = mute, 0x06 = voicemail LED
+    if (voicemail) {
+        buf[2] |= 0x06;
+    }
+    if (shadow.ledValid && memcmp(shadow.led, buf, sizeof(shadow.led)) == 0) {
+        stats.outReportsSuppressed++;
+        return 0;
+    }
+    shadow.ledValid = false;
+    int status;
+#ifdef TARGET_WINDOWS7
+    HidDevice &dev = hidDevice;
+    status = WriteOut(dev, buf, sizeof(STATUS_LED_GREEN));
+#else
+    HidDevice &dev = hidDeviceDisplay;
+    status = WriteOut(dev, buf, sizeof(STATUS_LED_GREEN)+1);
+#endif // TARGET_WINDOWS7
+    if (status != 0) {
+        LOG("Phone #%u: SetLed status/error = %d", id, status);
+    } else {
+        memcpy(shadow.led, buf, sizeof(shadow.led));
+        shadow.ledValid = true;
+    }
+    return status;
+}
+
+int PhoneSession::UpdateLed(const HostState &state) {
+    ledGeneration = state.ledGeneration;
+    ledDue = false;
+    bool voicemail = (state.GetNewMessages(accountId) > 0);
+    int status = SetSpeakerLed((ringOutputs & RingCadence::OUT_SPEAKER_LED) != 0);
+    if (status != 0)
+        return status;
+    if (state.ringState) {
+        return SetLed((ringOutputs & RingCadence::OUT_LED) ? STATUS_LED_RED : STATUS_LED_OFF, voicemail);
+    }
+    if (state.regState)
+        return SetLed(STATUS_LED_GREEN, voicemail);
+    return SetLed(STATUS_LED_OFF, voicemail);
+}
+
+int PhoneSession::SetSpeakerLed(bool on) {
+    // written only when it has to change: cadences without speaker LED never touch it
+    if (shadow.speakerOn == on) {
+        return 0;
+    }
+#ifdef TARGET_WINDOWS7
+    HidDevice &dev = hidDevice;
+#else
+    HidDevice &dev = hidDeviceDisplay;
+#endif // TARGET_WINDOWS7
+    int status = WriteOut(dev, on ? SPEAKER_LED_ON : SPEAKER_LED_OFF, sizeof(SPEAKER_LED_ON));
+    if (status != 0) {
+        LOG("Phone #%u: SetSpeakerLed status/error = %d", id, status);
+    } else {
+        shadow.speakerOn = on;
+    }
+    return status;
+}
+
+void PhoneSession::Poll(const HostState &state) {
+    if (!IsOpened()) {
+        return;
+    }
+
+    int status = __atomic_exchange_n(&writeError, 0, __ATOMIC_ACQ_REL);
+    if (status != 0) {
+        LOG("Phone #%u: queued write failed: %s", id, HidDevice::GetErrorDesc(status).c_str());
+    }
+
+    if (status == 0) {
+        // continue frame spanning both interfaces, if previous part was written
+        status = PumpChain();
+    }
+
+    if (status == 0 && ringGeneration != state.ringGeneration) {
+        status = UpdateRing(state);
+    }
+
+    bool displayUpdate = (displayGeneration != state.displayGeneration);
+    if (displayDue) {
+        displayDue = false;
+        displayUpdate = true;
+    }
+    if (clockDue) {
+        // updating time; UpdateDisplay() schedules next update while clock is shown
+        clockDue = false;
+        displayUpdate = true;
+    }
+    if (marqueeDue) {
+        // next frame of pre-encoded text: only scrolled slot is written
+        marqueeDue = false;
+        for (unsigned int i=0; i<DisplayLayout::SLOT_COUNT; i++) {
+            if (marquee[i].IsScrolling()) {
+                marquee[i].Step();
+                stats.marqueeSteps++;
+            }
+        }
+        displayUpdate = true;
+    }
+
+    if (status == 0 && selfTestDue) {
+        selfTestDue = false;
+        status = SelfTestStep();
+    }
+
+    // LED state is shown after self-test is finished
+    if (status == 0 && selfTestStep < 0 && (ledDue || ledGeneration != state.ledGeneration)) {
+        status = UpdateLed(state);
+    }
+
+    if (status == 0 && keepaliveDue) {
+        keepaliveDue = false;
+        status = SendKeepalive();
+    }
+
+    if (readyPending && __atomic_load_n(&keepaliveWritten, __ATOMIC_ACQUIRE)) {
+        readyPending = false;
+        unsigned int readyMs = keepaliveWrittenMs > readerStartedMs ? keepaliveWrittenMs : readerStartedMs;
+        stats.AddPhoneReady(readyMs);
+        DET_LOG("Phone #%u: ready %u ms after detection (reader started after %u ms, keepalive written after %u ms)",
+            id, readyMs, readerStartedMs, keepaliveWrittenMs);
+    }
+
+    if (status == 0 && displayUpdate) {
+        status = UpdateDisplay(state);
+    }
+
+    macroPlayer.Poll();
+
+    if (status) {
+        LOG("Phone #%u: error updating, %s", id, HidDevice::GetErrorDesc(status).c_str());
+        CloseDevices();
+        return;
+    }
+
+    const HidReport *report;
+    while ((report = hidDevice.PeekReport()) != NULL) {
+        if (report->size >= static_cast<int>(decoder.GetMinReportSize())) {
+            DET_LOG("Phone #%u: REPORT_IN received: %s", id, ReportToString(report->GetData(), report->size).c_str());
+            HandleReportIn(report->GetData(), report->size, report->timestampUs, state);
+        } else {
+            LOG("Phone #%u: unexpected REPORT_IN size = %d", id, report->size);
+        }
+        hidDevice.ReleaseReport();
+    }
+    if (hidDevice.IsReadingFailed()) {
+        LOG("Phone #%u: error reading report", id);
+        CloseDevices();
+    }
+}
+
+void PhoneSession::Close(bool showClosed) {
+    if (showClosed && hidDevice.IsOpened() && hidDeviceDisplay.IsOpened()) {
+        int status;
+        status = SetDisplayTwoLines("Softphone closed", "");
+        if (status == 0) {
+			SetLed(STATUS_LED_OFF, false);
+        }
+    }
+    // last texts may still be chained behind frame of other interface
+    DrainChain(CLOSE_DRAIN_TIMEOUT);
+    CloseDevices();
+}
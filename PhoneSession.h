@@ -0,0 +1,413 @@
+/** \file
+    \brief Single connected CX300 phone: its HID interfaces and device state
+    \note All methods are called from comm thread.
+*/
+
+#ifndef PhoneSessionH
+#define PhoneSessionH
+
+#include "HidDevice.h"
+#include "ReportDecoder.h"
+#include "TimerWheel.h"
+#include "KeyMap.h"
+#include "KeyMacro.h"
+#include "ButtonTracker.h"
+#include "DisplayLayout.h"
+#include "Marquee.h"
+#include "DisplayCache.h"
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <map>
+
+class RingCadence;
+
+/** \brief State change reported by tSIP, passed from host thread to comm thread
+    \note Plain fixed-size data, so it is copied into command queue without allocation.
+*/
+struct HostCommand
+{
+    enum Type
+    {
+        REGISTRATION_STATE,
+        CALL_STATE,
+        RING,
+        MWI
+    };
+    enum { MAX_DISPLAY = 128 };
+    enum Type type;
+    int state;                      ///< registration/call/ring state
+    int accountId;                  ///< MWI
+    unsigned int newMessages;       ///< MWI
+    char display[MAX_DISPLAY];      ///< call display text (truncated), null-terminated
+};
+
+/** \brief State reported by tSIP, shared by all phones
+    \note Owned by comm thread, updated only with Apply().
+*/
+struct HostState
+{
+    int regState;
+    int callState;
+    int ringState;
+    std::string callDisplay;
+    uint64_t callStartUs;                       ///< timer wheel time when call state became non-zero, 0 without call
+    unsigned int displayGeneration;             ///< incremented when display content should be refreshed
+    unsigned int ringGeneration;                ///< incremented when ring state changes
+    unsigned int ledGeneration;                 ///< incremented when registration, ring or voicemail state changes
+    std::map<int, unsigned int> mwiNewMessages; ///< number of new voicemail messages by account ID
+    HostState(void);
+    /** \brief Update state, increment generations of affected outputs
+        \param nowUs current time of comm thread timer wheel
+    */
+    void Apply(const HostCommand &cmd, uint64_t nowUs);
+    /** \brief Number of new messages for account, for all accounts if accountId < 0
+    */
+    unsigned int GetNewMessages(int accountId) const;
+};
+
+class PhoneSession
+{
+public:
+    enum { VENDOR_ID = 0x095D };
+    enum { PRODUCT_ID = 0x9201 };
+    enum { BASIC_USAGE_PAGE = 0x0B };       ///< telephony interface: keys, hook, LED (Windows 7)
+    enum { DISPLAY_USAGE_PAGE = 0xFF99 };   ///< vendor interface: display, LED, keepalive
+
+    /** \param id number used in logs
+        \param deviceId USB device ID from HidDevice::Enumerate()
+        \param timers comm thread timer wheel used for periodic jobs (keepalive, clock, ring cadence, key macros)
+        \param keyMap actions of keys and buttons, must outlive phone
+        \param keyMacros macros started by keypad keys, must outlive phone
+        \param layout display screens, must outlive phone
+    */
+    PhoneSession(unsigned int id, const std::string &deviceId, TimerWheel &timers, const KeyMap &keyMap, const KeyMacroTable &keyMacros,
+        const DisplayLayout &layout);
+    ~PhoneSession(void);
+
+    unsigned int GetId(void) const {
+        return id;
+    }
+    const std::string& GetDeviceId(void) const {
+        return deviceId;
+    }
+
+    /** \brief Set account which voicemail indication is shown, -1 = all accounts
+    */
+    void SetAccountId(int accountId) {
+        this->accountId = accountId;
+    }
+    int GetAccountId(void) const {
+        return accountId;
+    }
+
+    /** \brief Open both interfaces and initialize phone (keepalive, display, LED test, input reading)
+        \param detectedUs time device was detected (arrival notification, plugin start, retry),
+        start of ready time counted in stats
+        \return 0 on success
+    */
+    int Open(const std::string &basicPath, const std::string &displayPath, uint64_t detectedUs);
+    /** \brief Open again using interface paths from last successful Open()
+    */
+    int Reopen(uint64_t detectedUs);
+    bool IsOpened(void) const;
+
+    /** \brief Phone was opened and not found missing since - worth reopening if it was closed after error
+    */
+    bool IsPresent(void) const {
+        return present;
+    }
+    void SetPresent(bool state) {
+        present = state;
+    }
+
+    /** \brief Update LED/display after host state change or timer expiry, handle received input reports
+    */
+    void Poll(const HostState &state);
+
+    /** \brief Close phone
+        \param showClosed display "Softphone closed" message and turn LED off before closing
+    */
+    void Close(bool showClosed);
+
+    /** \brief Event signaled when input report is received
+    */
+    Event& GetReportEvent(void) {
+        return hidDevice.GetReportEvent();
+    }
+
+    /** \brief Clock that report timestamps come from; latency is measured against it
+    */
+    typedef uint64_t (*TimeSource)(void);
+    void SetTimeSource(TimeSource source) {
+        timeSource = source;
+    }
+    /** \brief Wall clock shown by idle screen, Clock::GetWallTimeUs() by default;
+        has to advance at the same rate as timer wheel
+    */
+    void SetWallTimeSource(TimeSource source) {
+        wallTimeSource = source;
+    }
+
+    /** \brief Process single input report (without report ID)
+        \param timestampUs reception time, from time source (Clock::GetTimeUs() by default)
+    */
+    void HandleReportIn(const uint8_t *report, unsigned int size, uint64_t timestampUs, const HostState &state);
+
+    /** \brief Prepare closed phone for HandleReportIn() calls without device (report replay):
+        default input report layout, no key pressed, no macro running
+    */
+    void ResetInput(void);
+
+    /** \brief Run due key macro steps; done by Poll() for opened phone
+    */
+    void PollMacros(void) {
+        macroPlayer.Poll();
+    }
+
+private:
+    unsigned int id;
+    std::string deviceId;
+    int accountId;
+    bool present;
+    std::string basicPath, displayPath;
+    TimerWheel &timers;
+    const KeyMap &keyMap;
+    const KeyMacroTable &keyMacros;
+    const DisplayLayout &layout;
+    KeyMacroPlayer macroPlayer;
+
+    nsHidDevice::HidDevice hidDevice, hidDeviceDisplay;
+
+    /** Last error reported by write completion callback, 0 if none */
+    int writeError;
+
+    /** \brief Last state successfully written to device
+        \note Writes that would not change anything are skipped. Shadow is invalidated
+        when device is closed, display is cleared or write fails.
+    */
+    struct DeviceShadow
+    {
+        bool ledValid;
+        uint8_t led[3];                 ///< status LED report with voicemail/speaker byte
+        bool speakerOn;                 ///< speaker LED; assumed off after opening
+        int textMode;                   ///< DisplayLayout::Mode, -1 = unknown (e.g. after clear)
+        bool slotValid[DisplayLayout::SLOT_COUNT];
+        std::vector<uint8_t> slot[DisplayLayout::SLOT_COUNT];   ///< encoded text reports of each slot
+        DeviceShadow(void) {
+            Invalidate();
+        }
+        void Invalidate(void) {
+            ledValid = false;
+            speakerOn = false;
+            InvalidateText();
+        }
+        void InvalidateText(void) {
+            textMode = -1;
+            for (unsigned int i=0; i<DisplayLayout::SLOT_COUNT; i++) {
+                slotValid[i] = false;
+            }
+        }
+    } shadow;
+
+    /** \brief Idle screen (date and time), rendered incrementally
+        \note Date line is formatted and encoded only when day changes. localtime() is called
+        once a minute; seconds are patched into encoded time line with precomputed digit glyphs.
+        Whole time line fits into single text report, so each second only that report is sent.
+    */
+    struct IdleClock
+    {
+        time_t minuteStart;             ///< wall time of hh:mm:00 shown in time line, -1 if not rendered yet
+        int day;                        ///< tm_year * 1000 + tm_yday of date line, -1 if not rendered yet
+        unsigned int dateCells;         ///< slot width date line was encoded for
+        std::vector<uint8_t> line[2];   ///< encoded date and time lines
+        IdleClock(void):
+            minuteStart(-1),
+            day(-1),
+            dateCells(0)
+        {}
+    } idleClock;
+    /** Encoded call time, by slot (changes every second, not worth caching) */
+    std::vector<uint8_t> regionText[DisplayLayout::SLOT_COUNT];
+    /** Caller text of each slot, pre-encoded for scrolling */
+    Marquee marquee[DisplayLayout::SLOT_COUNT];
+    /** Encoded recurring texts: status, ring text, caller names that fit, ... */
+    DisplayCache displayCache;
+
+    /** \brief OUT reports of single update, submitted together
+    */
+    struct OutFrame
+    {
+        std::vector<uint8_t> data;
+        std::vector<int> lengths;
+        std::vector<nsHidDevice::HidDevice*> devs;
+        void Add(nsHidDevice::HidDevice &dev, const uint8_t *report, int len) {
+            data.insert(data.end(), report, report + len);
+            lengths.push_back(len);
+            devs.push_back(&dev);
+        }
+        void Append(const OutFrame &other) {
+            data.insert(data.end(), other.data.begin(), other.data.end());
+            lengths.insert(lengths.end(), other.lengths.begin(), other.lengths.end());
+            devs.insert(devs.end(), other.devs.begin(), other.devs.end());
+        }
+        void Clear(void) {
+            data.clear();
+            lengths.clear();
+            devs.clear();
+        }
+    };
+
+    /** \brief Reports waiting for earlier reports written to other interface
+        \note Frame spanning both interfaces (Windows 7: select reports go to telephony interface)
+        is split into runs of consecutive reports for one interface. Next run is queued by comm
+        thread when writer reports completion of previous one, so order between interfaces is kept
+        without blocking. Later frames are appended while chain is active.
+    */
+    struct WriteChain
+    {
+        OutFrame frame;
+        unsigned int next;          ///< first report of frame not queued yet
+        unsigned int dataPos;       ///< offset of that report in frame.data
+        int inFlight;               ///< run queued and not completed; cleared by writer thread
+        WriteChain(void):
+            next(0),
+            dataPos(0),
+            inFlight(0)
+        {}
+        bool IsActive(void) const {
+            return next < frame.lengths.size() || __atomic_load_n(&inFlight, __ATOMIC_ACQUIRE);
+        }
+        void Reset(void) {
+            frame.Clear();
+            next = dataPos = 0;
+            inFlight = 0;
+        }
+    } chain;
+
+    nsHidDevice::ReportDecoder decoder;
+    /** \brief Locations of controls in input report, resolved once when phone is opened
+    */
+    struct InputLayout
+    {
+        nsHidDevice::ReportDecoder::Location hook;
+        nsHidDevice::ReportDecoder::Location hold;
+        nsHidDevice::ReportDecoder::Location redial;
+        nsHidDevice::ReportDecoder::Location flash;
+        nsHidDevice::ReportDecoder::Location mute;
+        nsHidDevice::ReportDecoder::Location longPress;
+        int keypad;     ///< array field with phone keys
+    } input;
+
+    /** \brief Report dispatch tables, built from input layout when phone is opened
+        \note Keypad array index selects keypad control, mask of button bits selects button
+        control; actions are then taken from KeyMap.
+    */
+    struct Dispatch
+    {
+        enum
+        {
+            BUTTON_FLASH = 0x01,
+            BUTTON_REDIAL = 0x02,
+            BUTTON_HOLD = 0x04,
+            BUTTON_MUTE = 0x08,
+            BUTTON_LONG_PRESS = 0x10
+        };
+        enum { BUTTON_COUNT = 5 };
+        uint8_t keypad[256];                    ///< keypad array index -> KeyMap::Control
+        uint8_t buttons[1 << BUTTON_COUNT];     ///< button mask -> KeyMap::Control
+        int buttonByte;                         ///< report byte holding all button bits, -1 = decode buttons one by one
+        uint8_t buttonMask[256];                ///< buttonByte value -> button mask
+    } dispatch;
+
+    unsigned int lastControl;       ///< KeyMap::Control pressed in previous report
+    ButtonTracker buttonTracker;    ///< Dispatch button bits of previous report, press times
+    int pressedKeyCode;             ///< Key() sent as pressed for lastControl, released with it
+    bool lastOffHook;
+    uint64_t reportUs;              ///< read time of report being handled, 0 outside of HandleReportIn()
+    TimeSource timeSource;
+    TimeSource wallTimeSource;
+    unsigned int displayGeneration;
+    unsigned int ringGeneration;
+    unsigned int ledGeneration;
+
+    TimerWheel::TimerId keepaliveTimer;
+    TimerWheel::TimerId clockTimer;     ///< one-shot, just after next wall clock second
+    TimerWheel::TimerId ringTimer;      ///< end of current cadence step, running while phone is ringing
+    TimerWheel::TimerId selfTestTimer;  ///< end of current self-test LED pattern
+    TimerWheel::TimerId marqueeTimer;   ///< periodic, running while scrolled text is shown
+    /* set by timer callbacks, handled by Poll() */
+    bool keepaliveDue;
+    bool clockDue;
+    bool ledDue;
+    bool displayDue;
+    bool selfTestDue;
+    bool marqueeDue;
+
+    /** Next startup self-test LED pattern, -1 if self-test is not running */
+    int selfTestStep;
+
+    /* time from detection to ready (first keepalive written and reader started) */
+    uint64_t detectedUs;                ///< Open() parameter
+    unsigned int readerStartedMs;       ///< reader started, time from detection
+    unsigned int keepaliveWrittenMs;    ///< first keepalive written, time from detection (set by writer thread)
+    int keepaliveWritten;               ///< keepaliveWrittenMs is set (atomic, set by writer thread)
+    bool readyPending;                  ///< opened, not counted as ready yet
+
+    /* ring indication */
+    const RingCadence *cadence;
+    unsigned int ringStep;
+    uint64_t ringStepUs;                ///< start of current step, timer wheel time
+    uint8_t ringOutputs;                ///< RingCadence::Output flags of current step, 0 if not ringing
+
+    void CompileInputLayout(void);
+    void ResolveInputLayout(void);
+    void ResetInputState(void);
+    void CompileDispatch(void);
+    unsigned int GetButtons(const uint8_t *report, unsigned int size) const;
+    void PressControl(unsigned int control, const HostState &state);
+    void ReleaseControl(void);
+    /** \brief Key() callback, timed for LatencyStats */
+    void SendKey(int keyCode, int state);
+    void RunAction(const KeyAction &action);
+    int OpenDevices(const std::string &basicPath, const std::string &displayPath);
+    void CloseDevices(void);
+    void StartMacro(const KeyMacro &macro);
+    static void OnWriteDone(void *opaque, int status);
+    static void OnChainWriteDone(void *opaque, int status);
+    static void OnKeepaliveWritten(void *opaque, int status);
+    int PumpChain(void);
+    /** \brief Queue remaining chain runs, waiting for each to complete, until chain is empty or timeout [ms] passes
+    */
+    void DrainChain(unsigned int timeout);
+    int WriteOut(nsHidDevice::HidDevice &dev, const uint8_t *buffer, int len);
+    int SubmitFrame(const OutFrame &frame);
+    int ClearDisplay(void);
+    int SetDisplayTwoLines(const std::string &line1, const std::string &line2);
+    int WriteScreen(enum DisplayLayout::Mode mode, const std::vector<uint8_t>* const *encoded);
+    void RenderIdleClock(unsigned int dateCells);
+    const std::vector<uint8_t>* RenderRegion(unsigned int region, enum DisplayLayout::Mode mode, unsigned int slot, const HostState &state);
+    int UpdateDisplay(const HostState &state);
+    int UpdateRing(const HostState &state);
+    int UpdateLed(const HostState &state);
+    void StartTimers(void);
+    void StopTimers(void);
+    static void OnKeepaliveTimer(void *opaque);
+    static void OnClockTimer(void *opaque);
+    void ScheduleClock(void);
+    static void OnRingTimer(void *opaque);
+    static void OnSelfTestTimer(void *opaque);
+    static void OnMarqueeTimer(void *opaque);
+    int SelfTestStep(void);
+    void ScheduleRingStep(void);
+    void NextRingStep(void);
+    int SetSpeakerLed(bool on);
+    int SendKeepalive(void);
+    int SetLed(const uint8_t *leds, bool voicemail);
+
+    PhoneSession(const PhoneSession&);
+    PhoneSession& operator=(const PhoneSession&);
+};
+
+#endif // PhoneSessionH
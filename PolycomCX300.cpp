@@ -1,511 +1,348 @@
 #include "PolycomCX300.h"
+#include "PhoneSession.h"
 #include "HidDevice.h"
 #include "Log.h"
 #include "CustomConf.h"
-#include "Mutex.h"
-#include "ScopedLock.h"
-#include "..\tSIP\tSIP\phone\Phone.h"
-#include <time.h>
-
-void Key(int keyCode, int state);
-int RunScriptAsync(const char* script);
-int Redial(void);
+#include "CommandQueue.h"
+#include "Stats.h"
+#include "Latency.h"
+#include "HotplugMonitor.h"
+#include "Clock.h"
+#include "Event.h"
+#include "TimerWheel.h"
+#include "KeyMap.h"
+#include "KeyMacro.h"
+#include "DisplayLayout.h"
+#include <vector>
+#include <map>
+#include <string.h>
 
 using namespace nsHidDevice;
 
 namespace
 {
 
-const int VendorID = 0x095d;
-const int ProductID = 0x9201;
-const int BasicUsagePage = 0x0B;
-const int DisplayUsagePage = 0xFF99;
-
-/* https://github.com/probonopd/OpenPhone */
-const uint8_t STATUS_AVAILABLE[] = {0x16, 0x01};
-const uint8_t STATUS_BUSY[] = {0x16, 0x03};
-const uint8_t STATUS_BE_RIGHT_BACK[] = {0x16, 0x05};
-const uint8_t STATUS_AWAY[] = {0x16, 0x05};
-const uint8_t STATUS_DO_NOT_DISTURB[] = {0x16, 0x06};
-const uint8_t STATUS_OFF_WORK[] = {0x16, 0x07};
-
-const uint8_t STATUS_LED_GREEN[] = {0x16, 0x01};
-const uint8_t STATUS_LED_RED[] = {0x16, 0x03};
-const uint8_t STATUS_LED_ORANGE_RED[] = {0x16, 0x04};
-const uint8_t STATUS_LED_ORANGE[] = {0x16, 0x05};
-const uint8_t STATUS_LED_OFF[] = {0x16, 0x07};
-const uint8_t STATUS_LED_GREEN_ORANGE[] = {0x16, 0x08};
-
-const uint8_t SPEAKER_LED_OFF[] = {0x02, 0x00};
-const uint8_t SPEAKER_LED_ON[] = {0x02, 0x01};
-
-const uint8_t DISPLAY_CLEAR[] = {0x13, 0x00};
-
-const uint8_t TEXT_MODE_FOUR_CORNERS[] = {0x13, 0x0D};
-const uint8_t TEXT_TOP_LEFT[] = {0x14, 0x01, 0x80};
-const uint8_t TEXT_BOTTOM_LEFT[] = {0x14, 0x02, 0x80};
-const uint8_t TEXT_TOP_RIGHT[] = {0x14, 0x03, 0x80};
-const uint8_t TEXT_BOTTOM_RIGHT[] = {0x14, 0x04, 0x80};
-
-const uint8_t TEXT_MODE_TWO_LINES[] = {0x13, 0x15};
-const uint8_t TEXT_TOP_LINE[] = {0x14, 0x05, 0x80};
-const uint8_t TEXT_BOTTOM_LINE[] = {0x14, 0x0A, 0x80};
-const uint8_t TEXT_END[] = {0x80, 0x00};
-
-
-enum { REPORT_IN_SIZE = 8 };
-
-Mutex mutexState;
-int regState = 0;
-int callState = 0;
-int ringState = 0;
-std::string callDisplay;
-bool displayUpdateFlag = false;
-bool ringUpdateFlag = false;
-unsigned int mwiNewMessages = 0;
-
-HidDevice hidDevice, hidDeviceDisplay;
-
-const E_KEY KEY_NONE = static_cast<E_KEY>(-1);
-enum E_KEY lastKey = KEY_NONE;
-enum E_KEY lastLongKey = KEY_NONE;
-bool lastOffHook = false;
-
-#	define DET_LOG if (customConf.detailedLogging) LOG
-
-std::string GetCallDisplay(void) {
-    ScopedLock<Mutex> lock(mutexState);
-    return callDisplay;
-}
-
-/**
-    Third byte = 0x03 => phone is receiving audio
-    Fourth byte: type of audio device (handset/spkeaker/headset)
+/** Limited by number of events comm thread can wait for (64 on Windows) */
+enum { MAX_PHONES = 32 };
+/** Timer wheel resolution [ms] */
+enum { TIMER_RESOLUTION = 10 };
+/** Reopening phones closed after error, rescanning without device notifications [ms] */
+enum { RETRY_PERIOD = 10000 };
+/** Logging statistics, only with detailedLogging [ms] */
+enum { STATS_PERIOD = 30000 };
+/** Comm thread wakeup rate is averaged over at least this time [ms] */
+enum { WAKEUP_WINDOW = 60000 };
+
+/** State reported by tSIP, comm thread only */
+HostState hostState;
+
+/** Host state changes: posted from tSIP threads, applied by comm thread */
+enum { COMMAND_QUEUE_SIZE = 256 };
+CommandQueue<HostCommand, COMMAND_QUEUE_SIZE> commands;
+
+/** \brief Phone registry: connected phones, including ones closed after error (reopened by retry)
+    \note Phones are removed when their device disappears, so repeated replugging does not
+    use up MAX_PHONES.
 */
-void HandleReportIn(const uint8_t *report) {
-    enum E_KEY key = KEY_NONE;
-
-    switch (report[1])
-    {
-    case 0x01:
-        key = KEY_0;
-        break;
-    case 0x02:
-        key = KEY_1;
-        break;
-    case 0x03:
-        key = KEY_2;
-        break;
-    case 0x04:
-        key = KEY_3;
-        break;
-    case 0x05:
-        key = KEY_4;
-        break;
-    case 0x06:
-        key = KEY_5;
-        break;
-    case 0x07:
-        key = KEY_6;
-        break;
-    case 0x08:
-        key = KEY_7;
-        break;
-    case 0x09:
-        key = KEY_8;
-        break;
-    case 0x0A:
-        key = KEY_9;
-        break;
-    case 0x0B:
-        if (customConf.dialKey == "*") {
-            key = KEY_OK;
-        } else {
-            key = KEY_STAR;
-        }
-        break;
-    case 0x0C:
-        if (customConf.dialKey == "#") {
-            key = KEY_OK;
-        } else {
-            key = KEY_HASH;
-        }
-        break;
-    case 0x00:
-        // key up
-        break;
-
-    default:
-        LOG("Unhandled key code in HID report = 0x%02X", report[1]);
-        break;
-    }
+std::vector<PhoneSession*> phones;
+unsigned int nextPhoneId = 1;
+
+HotplugMonitor hotplug;
+/** Starting device notifications failed: polling until retry timer tries again */
+bool hotplugFailed = false;
+/** Device enumeration should be done: set on start and on device arrival/removal */
+bool rescanPending = true;
+/** Time rescan was requested: start of phone ready time */
+uint64_t rescanRequestUs = 0;
+
+/** Signaled by host calls (state changes) and on stop request, wakes comm thread */
+Event wakeEvent;
+
+TimerWheel timers(TIMER_RESOLUTION * 1000);
+TimerWheel::TimerId retryTimer = TimerWheel::INVALID_TIMER;
+TimerWheel::TimerId statsTimer = TimerWheel::INVALID_TIMER;
+bool retryDue = false;
+uint64_t wakeupWindowStartUs = 0;
+unsigned int wakeupWindowCount = 0;
+
+/* compiled from customConf when comm thread starts */
+KeyMap keyMap;
+KeyMacroTable keyMacros;
+DisplayLayout displayLayout;
 
-    const uint8_t REPORT0_OFF_HOOK = 0x01;
-    uint8_t report0WithoutHook = report[0] & ~REPORT0_OFF_HOOK;
-    switch (report0WithoutHook)
-    {
-    case 0x20:
-        if (ringState) {
-            key = KEY_CALL_HANGUP;
-        } else {
-            key = KEY_C;
-        }
-        break;
-    case 0x04:  // Redial key - first one in the top row
-        Redial();
-        break;
-    case 0x02:  // HOLD key
-        RunScriptAsync("ToggleHold()");
-        break;
-    default:
-        break;
-    }
+#	define DET_LOG if (customConf.detailedLogging) LOG
 
-    if (lastKey == KEY_NONE && key != KEY_NONE) {
-        DET_LOG("Key code = %d, active", key);
-        Key(key, 1);
-    } else if (lastKey != KEY_NONE && key == KEY_NONE) {
-        DET_LOG("Key code = %d, inactive", lastKey);
-        Key(lastKey, 0);
+void PostCommand(const HostCommand &cmd) {
+    if (!commands.Post(cmd)) {
+        // comm thread far behind (or not running), or command posted from comm thread itself
+        // (e.g. from within key callback) while queue is full
+        __atomic_fetch_add(&stats.hostCommandsOverflow, 1, __ATOMIC_RELAXED);
     }
+    PolycomCX300::Wake();
+}
 
-    if (key == lastKey && (report[0] & 0x08)) {
-        // long key press
-        DET_LOG("Key code = %d, long press", key);
-        if (key == KEY_1) {
-            if (lastLongKey != KEY_VOICEMAIL) {
-                Key(KEY_C, 1);
-                Sleep(50);
-                Key(KEY_C, 0);
-                Sleep(50);
-                Key(KEY_VOICEMAIL, 1);
-                Sleep(50);
-                Key(KEY_VOICEMAIL, 0);
-                Sleep(50);
-                lastLongKey = KEY_VOICEMAIL;
-            }
-        }
-    } else {
-        lastLongKey = KEY_NONE;
+struct ApplyCommand
+{
+    void operator()(const HostCommand &cmd) {
+        hostState.Apply(cmd, timers.GetTime());
     }
+};
 
-    lastKey = key;
+void ProcessCommands(void) {
+    ApplyCommand apply;
+    stats.hostCommands += commands.Drain(apply);
+}
 
-    bool offHook = report[0] & REPORT0_OFF_HOOK;
-    if (offHook != lastOffHook) {
-        DET_LOG("OFF HOOK = %d", static_cast<int>(offHook));
-        Key(KEY_HOOK, offHook ? 0 : 1); // tSIP: 1 = handset down
+void RequestRescan(void) {
+    if (!rescanPending) {
+        rescanPending = true;
+        rescanRequestUs = Clock::GetTimeUs();
     }
-    lastOffHook = offHook;
 }
 
-int ClearDisplay(void) {
-#ifdef TARGET_WINDOWS7
-    HidDevice &dev = hidDevice;
-#else
-    HidDevice &dev = hidDeviceDisplay;
-#endif // TARGET_WINDOWS7
-    return dev.WriteReportOut(DISPLAY_CLEAR, sizeof(DISPLAY_CLEAR));
+void OnRetryTimer(void *opaque) {
+    retryTimer = TimerWheel::INVALID_TIMER;
+    retryDue = true;
 }
 
-int SetDisplayTwoLines(const std::string &line1, const std::string &line2="") {
-    int status = 0;
-
-#ifdef TARGET_WINDOWS7
-    HidDevice &dev = hidDevice;
-    enum { LINE_SEL_SIZE = 2 };
-#else
-    HidDevice &dev = hidDeviceDisplay;
-    enum { LINE_SEL_SIZE = 3 };
-#endif // TARGET_WINDOWS7
-    status = dev.WriteReportOut(TEXT_MODE_TWO_LINES, sizeof(TEXT_MODE_TWO_LINES));
-    if (status != 0)
-        return status;
-
-    for (unsigned int i=0; i<2; i++) {
-        std::string text;
-        if (i == 0) {
-            text = line1;
-            status = dev.WriteReportOut(TEXT_TOP_LINE, LINE_SEL_SIZE);
-            if (status != 0) {
-                // when trying to write 3 bytes on Windows 7: GetLastError = 1784 (The supplied user buffer is not valid for the requested operation.)
-                // on Windows 10 this is fine
-                LOG("Error writing TEXT_TOP_LINE");
-                return status;
-            }
-        } else {
-            text = line2;
-            status = dev.WriteReportOut(TEXT_BOTTOM_LINE, LINE_SEL_SIZE);
-            if (status != 0) {
-                LOG("Error writing TEXT_BOTTOM_LINE");
-                return status;
-            }
-        }
-
-        enum { CHUNK_LENGTH = 8 };
-        for (unsigned int textPos = 0; textPos < text.length(); textPos += CHUNK_LENGTH) {
-            uint8_t buffer[1 + 1 + (2*CHUNK_LENGTH)];
-            uint8_t chunk[CHUNK_LENGTH];
-            unsigned int chunkLen = (text.length() - textPos >= CHUNK_LENGTH) ? CHUNK_LENGTH : (text.length() - textPos);
-            memcpy(chunk, &text[textPos], chunkLen);
-            if (8 - chunkLen > 0) {
-                memset(chunk + chunkLen, 0x00, 8 - chunkLen);
-            }
-
-            unsigned int pos = 0;
-            buffer[pos++] = 0x15;
-            buffer[pos++] = ((textPos + 8 < text.length()) ? 0x00 : 0x80); // continuation bit
-
-            for (unsigned int j = 0; j < CHUNK_LENGTH; j++) {
-                buffer[pos++] = chunk[j];
-                buffer[pos++] = 0x00;             // filler
-            }
-            status = hidDeviceDisplay.WriteReportOut(buffer, sizeof(buffer));
-            if (status != 0) {
-                LOG("Error trying to write whole buffer");
-                return status;
-            }
+/** \brief Run retry timer only while there is something to retry, so idle comm thread
+    is woken up only by phone timers (clock, keepalive), device events and host commands
+*/
+void UpdateRetryTimer(void) {
+    bool needed = !hotplug.IsRunning();     // polling for device
+    for (unsigned int i=0; i<phones.size(); i++) {
+        if (!phones[i]->IsOpened() && phones[i]->IsPresent()) {
+            needed = true;
         }
     }
-    return status;
+    if (needed && retryTimer == TimerWheel::INVALID_TIMER) {
+        retryTimer = timers.Schedule(RETRY_PERIOD * 1000ULL, 0, OnRetryTimer, NULL);
+    } else if (!needed && retryTimer != TimerWheel::INVALID_TIMER) {
+        timers.Cancel(retryTimer);
+        retryTimer = TimerWheel::INVALID_TIMER;
+    }
 }
 
-int UpdateDisplay(void) {
-    displayUpdateFlag = false;
-    std::string callDisplayVal = GetCallDisplay();
-    /** \note Do not clear display here - it is redundant and causes flickering */
-
-    char line1[32];
-    char line2[32];
-    memset(line1, 0, sizeof(line1));
-    memset(line2, 0, sizeof(line2));
-
-    if (callState == 0 && callDisplay.empty()) {
-        time_t rawtime;
-        struct tm * timeinfo;
-        time (&rawtime);
-        timeinfo = localtime (&rawtime);
-        strftime (line1, sizeof(line1), "%A %Y-%m-%d", timeinfo);
-        strftime (line2, sizeof(line2), "%H:%M:%S", timeinfo);
-    } else {
-        strncpy(line1, callDisplayVal.c_str(), sizeof(line1)-1);
-    }
-    if (line1[0] == '\0')
-        line1[0] = ' ';
-    if (line2[0] == '\0')
-        line2[0] = ' ';
-    int status = SetDisplayTwoLines(line1, line2);
-
-    if (status != 0) {
-        LOG("UpdateDisplay status/error = %d", status);
+void CountWakeup(void) {
+    uint64_t now = Clock::GetTimeUs();
+    stats.wakeups++;
+    wakeupWindowCount++;
+    uint64_t elapsed = now - wakeupWindowStartUs;
+    if (elapsed >= WAKEUP_WINDOW * 1000ULL) {
+        stats.wakeupsPerMinute = static_cast<unsigned int>(wakeupWindowCount * 60000000ULL / elapsed);
+        wakeupWindowStartUs = now;
+        wakeupWindowCount = 0;
     }
-    return status;
 }
 
-int UpdateRing(void) {
-    // Does CX300 has a ringer? Probably not.
-    DET_LOG("UpdateRing: state = %d, type = %u", ringState, customConf.ringType);
-    return 0;
+void OnStatsTimer(void *opaque) {
+    stats.commThreadCpuMs = static_cast<unsigned int>(Clock::GetThreadCpuTimeUs() / 1000);
+    DET_LOG("%s", stats.ToString().c_str());
+    DET_LOG("%s", latency.ToString().c_str());
 }
 
-
-int SendKeepalive(void) {
-    // Send feature report - without this the phone asks to upgrade Office Communicator
-    // report id = 0x17, language (0x09 = EN)
-    unsigned char sendbuf[] = {0x17, 0x09, 0x04, 0x01, 0x02};
-    int status = hidDeviceDisplay.WriteReport(HidDevice::E_REPORT_FEATURE, sendbuf[0], sendbuf+1, sizeof(sendbuf)-1);
-    if (status != 0) {
-        LOG("Error sending keepalive: %s", HidDevice::GetErrorDesc(status).c_str());
-    } else {
-        DET_LOG("Keepalive sent");
+PhoneSession* FindPhone(const std::string &deviceId) {
+    for (unsigned int i=0; i<phones.size(); i++) {
+        if (phones[i]->GetDeviceId() == deviceId) {
+            return phones[i];
+        }
     }
-    return status;
+    return NULL;
 }
 
-int SetLed(const uint8_t *leds, bool voicemail) {
-    // According to Wireshark this sends 3 bytes, not 2.
-    // Python with cx300.py and hid/hidapi behaves the same way under Windows.
-    // WTF?
-    // it looks like third byte controls voicemail LED and speakerphone
-    uint8_t buf[64];
-    memset(buf, 0, sizeof(buf));
-    memcpy(buf, leds, sizeof(STATUS_LED_GREEN));
-    // buf[2]: 0x10 = mute, 0x06 = voicemail LED
-    if (voicemail) {
-        buf[2] |= 0x06;
+/** \brief Enumerate phones once, open new/reconnected ones, free ones that are gone
+*/
+void Rescan(void) {
+    std::map<std::string, HidDevice::InterfaceMap> devices;
+    HidDevice::Enumerate(PhoneSession::VENDOR_ID, PhoneSession::PRODUCT_ID, devices);
+
+    for (unsigned int i=0; i<phones.size(); ) {
+        PhoneSession *phone = phones[i];
+        if (devices.find(phone->GetDeviceId()) == devices.end()) {
+            LOG("Phone #%u removed", phone->GetId());
+            phone->SetPresent(false);
+            phone->Close(false);
+            delete phone;
+            phones.erase(phones.begin() + i);
+        } else {
+            i++;
+        }
     }
-    int status;
-#ifdef TARGET_WINDOWS7
-    HidDevice &dev = hidDevice;
-    status = dev.WriteReportOut(buf, sizeof(STATUS_LED_GREEN));
-#else
-    HidDevice &dev = hidDeviceDisplay;
-    status = dev.WriteReportOut(buf, sizeof(STATUS_LED_GREEN)+1);
-#endif // TARGET_WINDOWS7
-    if (status != 0) {
-        LOG("SetLed status/error = %d", status);
+
+    for (std::map<std::string, HidDevice::InterfaceMap>::iterator iter = devices.begin(); iter != devices.end(); ++iter) {
+        const std::string &deviceId = iter->first;
+        HidDevice::InterfaceMap &interfaces = iter->second;
+        HidDevice::InterfaceMap::iterator basic = interfaces.find(PhoneSession::BASIC_USAGE_PAGE);
+        HidDevice::InterfaceMap::iterator display = interfaces.find(PhoneSession::DISPLAY_USAGE_PAGE);
+        if (basic == interfaces.end() || display == interfaces.end()) {
+            LOG("Not all HID interfaces of the phone %s found (%u found)", deviceId.c_str(), static_cast<unsigned int>(interfaces.size()));
+            continue;
+        }
+        PhoneSession *phone = FindPhone(deviceId);
+        if (phone == NULL) {
+            if (phones.size() >= MAX_PHONES) {
+                LOG("Phone %s ignored, limit of %u phones reached", deviceId.c_str(), MAX_PHONES);
+                continue;
+            }
+            phone = new PhoneSession(nextPhoneId++, deviceId, timers, keyMap, keyMacros, displayLayout);
+            phones.push_back(phone);
+        }
+        phone->SetAccountId(customConf.GetPhoneAccount(deviceId));
+        if (!phone->IsOpened()) {
+            LOG("Phone #%u: %s, account %d", phone->GetId(), deviceId.c_str(), phone->GetAccountId());
+            phone->Open(basic->second, display->second, rescanRequestUs);
+        }
     }
-    return status;
 }
 
 }   // namespace
 
 
 
-void PolycomCX300::Poll(void) {
-    static unsigned int loopCnt = 0;
-    if (!hidDevice.IsOpened()) {
-        if (loopCnt % 200 == 0) {
-            int status = hidDevice.Open(VendorID, ProductID, NULL, NULL, BasicUsagePage);
-            if (status == 0) {
-                LOG("HID device for telephony connected");
-                status = hidDeviceDisplay.Open(VendorID, ProductID, NULL, NULL, DisplayUsagePage);
-                if (status != 0) {
-                    LOG("Failed to open display HID device");
-                    hidDevice.Close();
-                } else {
-                    LOG("HID device for display connected");
-                }
-
-                if (customConf.detailedLogging) {
-                    static bool once = false;
-                    if (!once) {
-                        once = true;
-                        std::string dump;
-                        status = hidDevice.DumpCapabilities(dump);
-                        LOG("HID device: %s", dump.c_str());
-                        if (status == 0) {
-                            dump.clear();
-                            status = hidDeviceDisplay.DumpCapabilities(dump);
-                            LOG("HID display device: %s", dump.c_str());
-                        }
-                    }
-                }
+void PolycomCX300::Start(void) {
+    keyMap.Compile(customConf.keyMap, customConf.dialKey);
+    keyMacros.Compile(customConf.keyMacros);
+    displayLayout.Compile(customConf.screens);
+    timers.Advance(Clock::GetTimeUs());
+    if (customConf.detailedLogging) {
+        statsTimer = timers.Schedule(STATS_PERIOD * 1000ULL, STATS_PERIOD * 1000ULL, OnStatsTimer, NULL);
+    }
+    wakeupWindowStartUs = Clock::GetTimeUs();
+    wakeupWindowCount = 0;
+    hotplugFailed = false;
+    rescanRequestUs = Clock::GetTimeUs();
+}
 
-                status = SendKeepalive();
-                if (status != 0) {
-                    hidDevice.Close();
-                    hidDeviceDisplay.Close();
-                } else {
-                    ClearDisplay();
-
-                    const uint8_t* leds[] = {   STATUS_LED_GREEN, STATUS_LED_RED, STATUS_LED_ORANGE_RED,
-                                                STATUS_LED_ORANGE, STATUS_LED_GREEN_ORANGE, STATUS_LED_OFF  };
-                    for (unsigned int i=0; i<sizeof(leds)/sizeof(leds[0]); i++) {
-                        //LOG("Writing LED pattern #%u", i);
-                        status = SetLed(leds[i], false);
-                        if (status != 0) {
-                            LOG("Error writing LED pattern #%u", i);
-                            hidDevice.Close();
-                            hidDeviceDisplay.Close();
-                            break;
-                        }
-                        Sleep(300);
-                    }
-                }
-            } else {
-                LOG("Error opening HID device: %s", HidDevice::GetErrorDesc(status).c_str());
-            }
-        }
-    } else {
-        int status = 0;
-        if (callState == 0) {
-            if ((loopCnt & 0x03) == 0) {
-                // updating time
-                displayUpdateFlag = true;
-            }
+void PolycomCX300::Poll(void) {
+    timers.Advance(Clock::GetTimeUs());
+    if (retryDue && !hotplug.IsRunning()) {
+        // notifications may be available now (e.g. failure was transient)
+        hotplugFailed = false;
+    }
+    if (!hotplug.IsRunning() && !hotplugFailed) {
+        if (hotplug.Start(PhoneSession::VENDOR_ID, PhoneSession::PRODUCT_ID) != 0) {
+            LOG("Device notifications not available, polling for device");
+            hotplugFailed = true;
+        } else if (retryDue) {
+            LOG("Device notifications started");
         }
+    }
+    if (hotplug.TakeArrival()) {
+        DET_LOG("Device arrival notification");
+        RequestRescan();
+    }
+    if (hotplug.TakeRemoval()) {
+        DET_LOG("Device removal notification");
+        RequestRescan();
+    }
 
-        if ((loopCnt & 0x03) == 0) {
-            bool voicemail = (mwiNewMessages > 0);
-            if (ringState) {
-                if ((loopCnt & 0x07) == 0) {
-                    status = SetLed(STATUS_LED_RED, voicemail);
-                } else {
-                    status = SetLed(STATUS_LED_OFF, voicemail);
+    if (retryDue) {
+        retryDue = false;
+        // without notifications or after error: retry every ~10 s
+        bool retry = !hotplug.IsRunning();
+        for (unsigned int i=0; i<phones.size(); i++) {
+            PhoneSession *phone = phones[i];
+            if (!phone->IsOpened() && phone->IsPresent()) {
+                // closed after error - try paths remembered from last connection first
+                if (phone->Reopen(Clock::GetTimeUs()) != 0) {
+                    retry = true;
                 }
-            } else {
-                if (regState)
-                    status = SetLed(STATUS_LED_GREEN, voicemail);
-                else
-                    status = SetLed(STATUS_LED_OFF, voicemail);
             }
         }
-
-        if (status == 0 && ((loopCnt & 0x1FF) == 0)) {
-            status = SendKeepalive();
+        if (retry) {
+            RequestRescan();
         }
+    }
+    if (rescanPending) {
+        rescanPending = false;
+        Rescan();
+    }
 
-        if (status == 0 && displayUpdateFlag) {
-            status = UpdateDisplay();
-        }
+    ProcessCommands();
+    for (unsigned int i=0; i<phones.size(); i++) {
+        phones[i]->Poll(hostState);
+    }
+    UpdateRetryTimer();
+}
 
-        if (status == 0 && ringUpdateFlag) {
-            status = UpdateRing();
+void PolycomCX300::Wait(void) {
+    uint64_t now = Clock::GetTimeUs();
+    uint64_t deadline = timers.GetNextDeadline();
+    unsigned int timeout = Event::INFINITE_TIMEOUT;
+    if (deadline != TimerWheel::NO_DEADLINE) {
+        if (deadline <= now) {
+            return;
         }
+        timeout = static_cast<unsigned int>((deadline - now + 999) / 1000);
+    }
 
-        if (status) {
-            LOG("Error updating, %s", HidDevice::GetErrorDesc(status).c_str());
-            hidDevice.Close();
-            hidDeviceDisplay.Close();
-        } else {
-            unsigned char rcvbuf[REPORT_IN_SIZE];
-            memset(rcvbuf, 0, sizeof(rcvbuf));
-            int size = sizeof(rcvbuf);
-            int status = hidDevice.ReadReport(HidDevice::E_REPORT_IN, 0, (char*)rcvbuf, &size, 10);
-            if (status == 0) {
-                if (size == sizeof(rcvbuf)) {
-                    DET_LOG("REPORT_IN received: %02X %02X %02X %02X %02X %02X %02X %02X",
-                        rcvbuf[0], rcvbuf[1], rcvbuf[2], rcvbuf[3], rcvbuf[4], rcvbuf[5], rcvbuf[6], rcvbuf[7]
-                    );
-                    HandleReportIn(rcvbuf);
-                } else {
-                    LOG("Unexpected REPORT_IN size = %d", size);
-                }
-            } else if (status != HidDevice::E_ERR_TIMEOUT) {
-                LOG("Error reading report");
-                hidDevice.Close();
-                hidDeviceDisplay.Close();
-            }
+    Event* events[MAX_PHONES + 2];
+    int count = 0;
+    events[count++] = &wakeEvent;
+    events[count++] = &hotplug.GetEvent();
+    for (unsigned int i=0; i<phones.size(); i++) {
+        if (phones[i]->IsOpened()) {
+            events[count++] = &phones[i]->GetReportEvent();
         }
     }
-    loopCnt++;
+    Event::WaitAny(events, count, timeout);
+    CountWakeup();
+}
+
+void PolycomCX300::Wake(void) {
+    wakeEvent.Set();
 }
 
 void PolycomCX300::Close(void) {
-    if (hidDevice.IsOpened() && hidDeviceDisplay.IsOpened()) {
-        int status;
-        status = SetDisplayTwoLines("Softphone closed", "");
-        if (status == 0) {
-			SetLed(STATUS_LED_OFF, false);
-        }
+    for (unsigned int i=0; i<phones.size(); i++) {
+        phones[i]->Close(true);
+        delete phones[i];
     }
-    hidDevice.Close();
-    hidDeviceDisplay.Close();
+    phones.clear();
+    timers.Cancel(retryTimer);
+    timers.Cancel(statsTimer);
+    retryTimer = statsTimer = TimerWheel::INVALID_TIMER;
+    retryDue = false;
+    hotplug.Stop();
+    rescanPending = true;
+    stats.commThreadCpuMs = static_cast<unsigned int>(Clock::GetThreadCpuTimeUs() / 1000);
+    LOG("%s", stats.ToString().c_str());
+    LOG("%s", latency.ToString().c_str());
 }
 
 
 void UpdateCallState(int state, const char* display) {
-    ScopedLock<Mutex> lock(mutexState);
-    callState = state;
-    callDisplay = display;
-    displayUpdateFlag = true;
+    HostCommand cmd;
+    cmd.type = HostCommand::CALL_STATE;
+    cmd.state = state;
+    cmd.display[0] = '\0';
+    if (display) {
+        strncpy(cmd.display, display, sizeof(cmd.display) - 1);
+        cmd.display[sizeof(cmd.display) - 1] = '\0';
+    }
+    PostCommand(cmd);
 }
 
 void UpdateRing(int state) {
-    if (ringState != state) {
-        ringState = state;
-        ringUpdateFlag = true;
-    }
+    HostCommand cmd;
+    cmd.type = HostCommand::RING;
+    cmd.state = state;
+    PostCommand(cmd);
     //LOG("ringState = %d", ringState);
 }
 
 void UpdateMwi(int accountId, unsigned int newMsg, unsigned int oldMsg) {
-    mwiNewMessages = newMsg;
+    HostCommand cmd;
+    cmd.type = HostCommand::MWI;
+    cmd.accountId = accountId;
+    cmd.newMessages = newMsg;
+    PostCommand(cmd);
 }
 
 void UpdateRegistrationState(int state) {
-    regState = state;
+    HostCommand cmd;
+    cmd.type = HostCommand::REGISTRATION_STATE;
+    cmd.state = state;
+    PostCommand(cmd);
     //LOG("regState = %d", regState);
-    displayUpdateFlag = true;
 }
@@ -3,7 +3,20 @@
 
 namespace PolycomCX300
 {
+    /** \brief Prepare for Poll() loop: compile configuration, start periodic jobs
+    */
+    void Start(void);
+    /** \brief Handle everything that is pending: device changes, host state changes,
+        input reports and expired timers
+    */
     void Poll(void);
+    /** \brief Sleep until there is work for Poll(): input report, device notification,
+        Wake() call or expiry of next timer
+    */
+    void Wait(void);
+    /** \brief Interrupt Wait(), can be called from any thread
+    */
+    void Wake(void);
     void Close(void);
 }
 
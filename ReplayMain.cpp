@@ -0,0 +1,274 @@
+/** \file
+    \brief Report replay tool ("Replay Linux" target): decodes captured input reports without phone
+
+    Usage: replay [options] <log or capture file>
+           replay -t text [-b count]
+    -c file     plugin configuration (JSON with "customConf" section, as PhonePolycomCX300.cfg)
+    -e file     expected calls (lines as printed by replay); exit code 1 if calls differ
+    -b count    benchmark: decode all reports count times, print reports/s
+    -w file     save reports as binary capture
+    -r          replay while phone is ringing (host ring state = 1)
+    -s time     record display and LED reports written by phone; time: wall clock at first report,
+                local time "YYYY-MM-DD hh:mm:ss"
+    -t text     benchmark display text encoding (UTF-8) against plain byte copy, print encoded reports
+    -v          log details (detailedLogging)
+
+    Recorded Key(), RunScriptAsync() and Redial() calls (and display/LED writes with -s) are printed
+    one per line (time [s] from first report, call), so output of good run can be used as expected file.
+*/
+
+#include "ReportReplay.h"
+#include "HostPhone.h"
+#include "KeyMap.h"
+#include "KeyMacro.h"
+#include "CustomConf.h"
+#include "DisplayText.h"
+#include "Clock.h"
+#include <json/json.h>
+#include <fstream>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void Log(char* txt)
+{
+    fputs(txt, stderr);
+}
+
+void Key(int keyCode, int state)
+{
+    ReportReplay::OnKey(keyCode, state);
+}
+
+int RunScriptAsync(const char* script)
+{
+    ReportReplay::OnScript(script);
+    return 0;
+}
+
+int Redial(void)
+{
+    ReportReplay::OnRedial();
+    return 0;
+}
+
+namespace
+{
+
+void Usage(void)
+{
+    fprintf(stderr, "Usage: replay [-c config] [-e expected] [-b count] [-w capture] [-r] [-s time] [-v] <log or capture file>\n");
+    fprintf(stderr, "       replay -t text [-b count]\n");
+}
+
+/** \brief Text encoding used before DisplayText: each byte as one character, high byte 0
+*/
+void EncodeLineBytes(const std::string &text, std::vector<uint8_t> &encoded)
+{
+    encoded.clear();
+    for (unsigned int textPos = 0; textPos < text.length(); textPos += DisplayText::CHUNK_LENGTH)
+    {
+        uint8_t buffer[DisplayText::REPORT_SIZE];
+        uint8_t chunk[DisplayText::CHUNK_LENGTH];
+        unsigned int chunkLen = (text.length() - textPos >= DisplayText::CHUNK_LENGTH) ? DisplayText::CHUNK_LENGTH : (text.length() - textPos);
+        memcpy(chunk, &text[textPos], chunkLen);
+        memset(chunk + chunkLen, 0x00, DisplayText::CHUNK_LENGTH - chunkLen);
+        unsigned int pos = 0;
+        buffer[pos++] = DisplayText::REPORT_ID;
+        buffer[pos++] = (textPos + DisplayText::CHUNK_LENGTH < text.length()) ? 0x00 : DisplayText::LAST_CHUNK;
+        for (unsigned int j = 0; j < DisplayText::CHUNK_LENGTH; j++)
+        {
+            buffer[pos++] = chunk[j];
+            buffer[pos++] = 0x00;
+        }
+        encoded.insert(encoded.end(), buffer, buffer + sizeof(buffer));
+    }
+}
+
+int BenchmarkText(const std::string &text, unsigned int count)
+{
+    std::vector<uint8_t> encoded;
+    unsigned int cells = DisplayText::EncodeLine(text, DisplayText::MAX_LINE_CELLS, encoded);
+    printf("%u characters, %u bytes:", cells, static_cast<unsigned int>(text.length()));
+    for (unsigned int i=0; i<encoded.size(); i++)
+    {
+        printf("%s%02X", (i % DisplayText::REPORT_SIZE) ? " " : "\n", encoded[i]);
+    }
+    printf("\n");
+
+    // whole text, as before (byte copy was cut to line length by caller)
+    std::string line = text.substr(0, DisplayText::MAX_LINE_CELLS);
+    uint64_t startUs = Clock::GetTimeUs();
+    for (unsigned int i=0; i<count; i++)
+    {
+        EncodeLineBytes(line, encoded);
+    }
+    uint64_t bytesUs = Clock::GetTimeUs() - startUs;
+    startUs = Clock::GetTimeUs();
+    for (unsigned int i=0; i<count; i++)
+    {
+        DisplayText::EncodeLine(text, DisplayText::MAX_LINE_CELLS, encoded);
+    }
+    uint64_t utf8Us = Clock::GetTimeUs() - startUs;
+    fprintf(stderr, "%u lines: byte copy %.0f lines/s, UTF-8 encoder %.0f lines/s\n", count,
+        count * 1e6 / (bytesUs ? bytesUs : 1), count * 1e6 / (utf8Us ? utf8Us : 1));
+    return 0;
+}
+
+int LoadConfig(const char *fileName)
+{
+    std::ifstream ifs(fileName);
+    if (!ifs)
+        return -1;
+    std::string strConfig((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    Json::Value root;
+    Json::Reader reader;
+    if (!reader.parse(strConfig, root))
+        return -1;
+    customConf.fromJson(root["customConf"]);
+    return 0;
+}
+
+}   // namespace
+
+int main(int argc, char **argv)
+{
+    const char *expectedFile = NULL;
+    const char *captureFile = NULL;
+    const char *inputFile = NULL;
+    unsigned int benchmark = 0;
+    bool ringing = false;
+    const char *outputTime = NULL;
+    const char *benchmarkText = NULL;
+
+    for (int i=1; i<argc; i++)
+    {
+        const char *arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (strcmp(arg, "-c") == 0 && hasValue)
+        {
+            if (LoadConfig(argv[++i]) != 0)
+            {
+                fprintf(stderr, "Failed to load configuration from %s\n", argv[i]);
+                return 2;
+            }
+        }
+        else if (strcmp(arg, "-e") == 0 && hasValue)
+        {
+            expectedFile = argv[++i];
+        }
+        else if (strcmp(arg, "-b") == 0 && hasValue)
+        {
+            benchmark = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(arg, "-w") == 0 && hasValue)
+        {
+            captureFile = argv[++i];
+        }
+        else if (strcmp(arg, "-t") == 0 && hasValue)
+        {
+            benchmarkText = argv[++i];
+        }
+        else if (strcmp(arg, "-s") == 0 && hasValue)
+        {
+            outputTime = argv[++i];
+        }
+        else if (strcmp(arg, "-r") == 0)
+        {
+            ringing = true;
+        }
+        else if (strcmp(arg, "-v") == 0)
+        {
+            customConf.detailedLogging = true;
+        }
+        else if (arg[0] != '-' && inputFile == NULL)
+        {
+            inputFile = arg;
+        }
+        else
+        {
+            Usage();
+            return 2;
+        }
+    }
+    if (benchmarkText)
+    {
+        return BenchmarkText(benchmarkText, benchmark ? benchmark : 1000000);
+    }
+    if (inputFile == NULL)
+    {
+        Usage();
+        return 2;
+    }
+
+    std::vector<ReplayReport> reports;
+    int status = ReportReplay::Load(inputFile, reports);
+    if (status != 0)
+    {
+        if (status > 0)
+            fprintf(stderr, "%s:%d: malformed REPORT_IN or HOST line\n", inputFile, status);
+        else
+            fprintf(stderr, "Failed to read %s\n", inputFile);
+        return 2;
+    }
+    if (captureFile && ReportReplay::SaveCapture(captureFile, reports) != 0)
+    {
+        fprintf(stderr, "Failed to write %s\n", captureFile);
+        return 2;
+    }
+
+    KeyMap keyMap;
+    keyMap.Compile(customConf.keyMap, customConf.dialKey);
+    KeyMacroTable keyMacros;
+    keyMacros.Compile(customConf.keyMacros);
+    ReportReplay replay(keyMap, keyMacros);
+    replay.GetHostState().ringState = ringing ? 1 : 0;
+    if (outputTime)
+    {
+        uint64_t wallTimeUs;
+        if (ReportReplay::ParseWallTime(outputTime, wallTimeUs) != 0)
+        {
+            fprintf(stderr, "Invalid time \"%s\", expected YYYY-MM-DD hh:mm:ss\n", outputTime);
+            return 2;
+        }
+        replay.RecordOutput(wallTimeUs);
+    }
+
+    replay.Run(reports);
+    const std::vector<ReplayCall> &calls = replay.GetCalls();
+    for (unsigned int i=0; i<calls.size(); i++)
+    {
+        printf("%s\n", calls[i].ToString(replay.GetStartTime()).c_str());
+    }
+
+    int result = 0;
+    if (expectedFile)
+    {
+        std::ifstream expected(expectedFile);
+        std::string error;
+        if (!expected)
+        {
+            fprintf(stderr, "Failed to read %s\n", expectedFile);
+            result = 2;
+        }
+        else if (replay.Check(expected, error) != 0)
+        {
+            fprintf(stderr, "%s: %s\n", expectedFile, error.c_str());
+            result = 1;
+        }
+        else
+        {
+            fprintf(stderr, "%u calls as expected\n", static_cast<unsigned int>(calls.size()));
+        }
+    }
+
+    if (benchmark)
+    {
+        customConf.detailedLogging = false;
+        double rate = replay.Benchmark(reports, benchmark);
+        fprintf(stderr, "%u reports x %u: %.0f reports/s (%.0f ns/report)\n",
+            static_cast<unsigned int>(reports.size()), benchmark, rate, (rate > 0) ? 1e9 / rate : 0.0);
+    }
+    return result;
+}
@@ -0,0 +1,513 @@
+#include "ReportDecoder.h"
+#include "HidDevice.h"
+#include "Log.h"
+
+#ifdef _WIN32
+extern "C"
+{
+#include <ddk/hidsdi.h>
+}
+#endif
+#include <sstream>
+#include <iomanip>
+#include <string.h>
+
+using namespace nsHidDevice;
+
+namespace
+{
+
+/** Limit for array usages expanded from Usage Minimum/Maximum */
+enum { MAX_ARRAY_USAGES = 1024 };
+
+unsigned int ItemData(const uint8_t *data, int size)
+{
+    unsigned int value = 0;
+    for (int i=0; i<size; i++)
+        value |= static_cast<unsigned int>(data[i]) << (8*i);
+    return value;
+}
+
+int32_t SignedItemData(const uint8_t *data, int size)
+{
+    unsigned int value = ItemData(data, size);
+    switch (size)
+    {
+    case 1:
+        return static_cast<int8_t>(value);
+    case 2:
+        return static_cast<int16_t>(value);
+    default:
+        return static_cast<int32_t>(value);
+    }
+}
+
+/** \brief Global items state of descriptor parser
+*/
+struct Globals
+{
+    unsigned int usagePage;
+    int32_t logicalMin;
+    unsigned int reportSize;
+    unsigned int reportCount;
+    unsigned int reportId;
+};
+
+}   // namespace
+
+
+ReportDecoder::ReportDecoder(void):
+    minReportSize(0)
+{
+}
+
+void ReportDecoder::Clear(void)
+{
+    fields.clear();
+    minReportSize = 0;
+}
+
+void ReportDecoder::AddField(const Field &field)
+{
+    fields.push_back(field);
+    unsigned int bytes = (field.bitOffset + field.bitSize + 7) / 8;
+    if (minReportSize < bytes)
+        minReportSize = bytes;
+}
+
+void ReportDecoder::AddVariable(uint32_t usage, unsigned int bitOffset, unsigned int bitSize, int32_t logicalMin)
+{
+    Field f;
+    f.usage = usage;
+    f.logicalMin = logicalMin;
+    f.bitOffset = bitOffset;
+    f.bitSize = bitSize;
+    f.array = false;
+    AddField(f);
+}
+
+void ReportDecoder::AddArray(const std::vector<uint32_t> &usages, int32_t logicalMin, unsigned int bitOffset, unsigned int bitSize)
+{
+    Field f;
+    f.usage = 0;
+    f.usages = usages;
+    f.logicalMin = logicalMin;
+    f.bitOffset = bitOffset;
+    f.bitSize = bitSize;
+    f.array = true;
+    AddField(f);
+}
+
+ReportDecoder::Location ReportDecoder::Resolve(uint32_t usage) const
+{
+    Location loc;
+    for (unsigned int i=0; i<fields.size(); i++)
+    {
+        const Field &f = fields[i];
+        if (!f.array)
+        {
+            if (f.usage == usage)
+            {
+                loc.field = i;
+                return loc;
+            }
+        }
+        else
+        {
+            for (unsigned int j=0; j<f.usages.size(); j++)
+            {
+                if (f.usages[j] == usage)
+                {
+                    loc.field = i;
+                    loc.value = f.logicalMin + j;
+                    return loc;
+                }
+            }
+        }
+    }
+    return loc;
+}
+
+unsigned int ReportDecoder::GetActiveUsages(const uint8_t *report, unsigned int size, uint32_t *usages, unsigned int maxCount) const
+{
+    unsigned int count = 0;
+    for (unsigned int i=0; i<fields.size() && count < maxCount; i++)
+    {
+        const Field &f = fields[i];
+        uint32_t value = Extract(report, size, f.bitOffset, f.bitSize);
+        if (!f.array)
+        {
+            if (value != 0)
+                usages[count++] = f.usage;
+        }
+        else
+        {
+            uint32_t index = value - f.logicalMin;
+            if (index < f.usages.size() && f.usages[index] != 0)
+                usages[count++] = f.usages[index];
+        }
+    }
+    return count;
+}
+
+int ReportDecoder::CompileDescriptor(const uint8_t *desc, unsigned int size)
+{
+    Globals globals;
+    memset(&globals, 0, sizeof(globals));
+    std::vector<Globals> stack;
+
+    // local items, cleared after each main item
+    std::vector<uint32_t> usages;       ///< with usage page if specified with 4-byte item, otherwise page = 0
+    std::vector<bool> extended;
+    bool rangeMinSet = false;
+    unsigned int usageMin = 0;
+    bool rangeExtended = false;
+
+    std::vector<unsigned int> bitPos(256, 0);
+    int inputReportId = -1;
+
+    Clear();
+
+    for (unsigned int i=0; i<size; )
+    {
+        uint8_t prefix = desc[i];
+        if (prefix == 0xFE)
+        {
+            // long item: prefix, size, tag, data
+            if (i + 1 >= size)
+                break;
+            i += 3 + desc[i+1];
+            continue;
+        }
+        int itemSize = prefix & 0x03;
+        if (itemSize == 3)
+            itemSize = 4;
+        if (i + 1 + itemSize > size)
+            break;
+        int type = (prefix >> 2) & 0x03;
+        int tag = (prefix >> 4) & 0x0F;
+        const uint8_t *data = &desc[i+1];
+        unsigned int value = ItemData(data, itemSize);
+        i += 1 + itemSize;
+
+        if (type == 0)          // main
+        {
+            if (tag == 0x08)    // input
+            {
+                unsigned int id = globals.reportId;
+                unsigned int bits = globals.reportSize * globals.reportCount;
+                bool constant = value & 0x01;
+                bool variable = value & 0x02;
+                if (inputReportId < 0 && !constant)
+                    inputReportId = id;
+                // resolve usages with current usage page
+                for (unsigned int u=0; u<usages.size(); u++)
+                {
+                    if (!extended[u])
+                        usages[u] = MakeUsage(globals.usagePage, usages[u]);
+                }
+                if (!constant && static_cast<int>(id) == inputReportId && globals.reportSize > 0 && globals.reportSize <= 32 && !usages.empty())
+                {
+                    if (variable)
+                    {
+                        for (unsigned int n=0; n<globals.reportCount; n++)
+                        {
+                            // last usage applies to remaining fields
+                            uint32_t usage = usages[(n < usages.size()) ? n : (usages.size() - 1)];
+                            AddVariable(usage, bitPos[id] + n * globals.reportSize, globals.reportSize, globals.logicalMin);
+                        }
+                    }
+                    else
+                    {
+                        std::vector<uint32_t> arrayUsages;
+                        arrayUsages.swap(usages);
+                        for (unsigned int n=0; n<globals.reportCount; n++)
+                        {
+                            AddArray(arrayUsages, globals.logicalMin, bitPos[id] + n * globals.reportSize, globals.reportSize);
+                        }
+                    }
+                }
+                bitPos[id] += bits;
+            }
+            usages.clear();
+            extended.clear();
+            rangeMinSet = false;
+        }
+        else if (type == 1)     // global
+        {
+            switch (tag)
+            {
+            case 0x00:
+                globals.usagePage = value;
+                break;
+            case 0x01:
+                globals.logicalMin = SignedItemData(data, itemSize);
+                break;
+            case 0x07:
+                globals.reportSize = value;
+                break;
+            case 0x08:
+                globals.reportId = value & 0xFF;
+                break;
+            case 0x09:
+                globals.reportCount = value;
+                break;
+            case 0x0A:
+                stack.push_back(globals);
+                break;
+            case 0x0B:
+                if (!stack.empty())
+                {
+                    globals = stack.back();
+                    stack.pop_back();
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        else if (type == 2)     // local
+        {
+            switch (tag)
+            {
+            case 0x00:
+                usages.push_back(value);
+                extended.push_back(itemSize == 4);
+                break;
+            case 0x01:
+                usageMin = value;
+                rangeExtended = (itemSize == 4);
+                rangeMinSet = true;
+                break;
+            case 0x02:
+                if (rangeMinSet)
+                {
+                    unsigned int usageMax = value;
+                    unsigned int idMin = usageMin & 0xFFFF, idMax = usageMax & 0xFFFF;
+                    for (unsigned int id = idMin; id <= idMax && usages.size() < MAX_ARRAY_USAGES; id++)
+                    {
+                        usages.push_back(rangeExtended ? ((usageMin & 0xFFFF0000) | id) : id);
+                        extended.push_back(rangeExtended);
+                    }
+                    rangeMinSet = false;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    return fields.empty() ? HidDevice::E_ERR_NOTFOUND : 0;
+}
+
+#ifdef _WIN32
+
+namespace
+{
+
+/** \brief Find bits changed by setting control in report initialized with HidP_InitializeReportForID
+    \return true if any bit was changed
+*/
+bool ChangedBits(const std::vector<char> &base, const std::vector<char> &probe, unsigned int &lowBit, unsigned int &highBit)
+{
+    bool found = false;
+    // byte 0: report ID
+    for (unsigned int i=1; i<base.size(); i++)
+    {
+        uint8_t diff = static_cast<uint8_t>(base[i] ^ probe[i]);
+        for (unsigned int b=0; b<8; b++)
+        {
+            if (diff & (1 << b))
+            {
+                unsigned int bit = i*8 + b;
+                if (!found)
+                    lowBit = bit;
+                highBit = bit;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+}   // namespace
+
+int ReportDecoder::Compile(HidDevice &dev)
+{
+    /* Preparsed data does not tell bit positions of controls - each usage is written
+       with HidP_SetUsages/HidP_SetUsageValue into empty report and position is taken
+       from changed bits.
+    */
+    PHIDP_PREPARSED_DATA pp = dev.GetPreparsedData();
+    Clear();
+    if (pp == NULL)
+        return HidDevice::E_ERR_INV_PARAM;
+
+    HIDP_CAPS caps;
+    if (HidP_GetCaps(pp, &caps) != HIDP_STATUS_SUCCESS)
+        return HidDevice::E_ERR_IO;
+    ULONG len = caps.InputReportByteLength;
+    if (len < 2)
+        return HidDevice::E_ERR_NOTFOUND;
+
+    int reportId = -1;
+    std::vector<char> base(len), probe(len);
+
+    USHORT count = caps.NumberInputButtonCaps;
+    if (count > 0)
+    {
+        std::vector<HIDP_BUTTON_CAPS> buttonCaps(count);
+        if (HidP_GetButtonCaps(HidP_Input, &buttonCaps[0], &count, pp) != HIDP_STATUS_SUCCESS)
+            return HidDevice::E_ERR_IO;
+        for (unsigned int i=0; i<count; i++)
+        {
+            const HIDP_BUTTON_CAPS &bc = buttonCaps[i];
+            if (reportId < 0)
+                reportId = bc.ReportID;
+            else if (bc.ReportID != reportId)
+                continue;
+            if (HidP_InitializeReportForID(HidP_Input, bc.ReportID, pp, &base[0], len) != HIDP_STATUS_SUCCESS)
+                continue;
+            USAGE first = bc.IsRange ? bc.Range.UsageMin : bc.NotRange.Usage;
+            USAGE last = bc.IsRange ? bc.Range.UsageMax : bc.NotRange.Usage;
+            bool array = !(bc.BitField & 0x02);
+
+            std::vector<uint32_t> probedUsages, probedValues;
+            unsigned int arrayLow = 0xFFFFFFFF, arrayHigh = 0;
+            for (unsigned int usage = first; usage <= last && probedUsages.size() < MAX_ARRAY_USAGES; usage++)
+            {
+                probe = base;
+                USAGE u = usage;
+                ULONG n = 1;
+                if (HidP_SetUsages(HidP_Input, bc.UsagePage, bc.LinkCollection, &u, &n, pp, &probe[0], len) != HIDP_STATUS_SUCCESS)
+                    continue;
+                unsigned int low, high;
+                if (!ChangedBits(base, probe, low, high))
+                    continue;
+                if (!array)
+                {
+                    AddVariable(MakeUsage(bc.UsagePage, usage), low - 8, 1);
+                }
+                else
+                {
+                    probedUsages.push_back(MakeUsage(bc.UsagePage, usage));
+                    if (low < arrayLow)
+                        arrayLow = low;
+                    if (high > arrayHigh)
+                        arrayHigh = high;
+                }
+            }
+            if (array && !probedUsages.empty())
+            {
+                // field spans all bits changed by any of the usages (array indexes are contiguous),
+                // values are read once span is known
+                unsigned int bitOffset = arrayLow - 8;
+                unsigned int bitSize = arrayHigh - arrayLow + 1;
+                int32_t minValue = 0x7FFFFFFF;
+                probedValues.resize(probedUsages.size());
+                for (unsigned int j=0; j<probedUsages.size(); j++)
+                {
+                    probe = base;
+                    USAGE u = probedUsages[j] & 0xFFFF;
+                    ULONG n = 1;
+                    HidP_SetUsages(HidP_Input, bc.UsagePage, bc.LinkCollection, &u, &n, pp, &probe[0], len);
+                    probedValues[j] = Extract(reinterpret_cast<const uint8_t*>(&probe[1]), len - 1, bitOffset, bitSize);
+                    if (static_cast<int32_t>(probedValues[j]) < minValue)
+                        minValue = probedValues[j];
+                }
+                // value 0 is usually "no control"
+                if (minValue > 0)
+                    minValue = 0;
+                std::vector<uint32_t> usages;
+                for (unsigned int j=0; j<probedUsages.size(); j++)
+                {
+                    unsigned int index = probedValues[j] - minValue;
+                    if (index >= MAX_ARRAY_USAGES)
+                        continue;
+                    if (usages.size() <= index)
+                        usages.resize(index + 1, 0);
+                    usages[index] = probedUsages[j];
+                }
+                AddArray(usages, minValue, bitOffset, bitSize);
+            }
+        }
+    }
+
+    count = caps.NumberInputValueCaps;
+    if (count > 0)
+    {
+        std::vector<HIDP_VALUE_CAPS> valueCaps(count);
+        if (HidP_GetValueCaps(HidP_Input, &valueCaps[0], &count, pp) != HIDP_STATUS_SUCCESS)
+            return HidDevice::E_ERR_IO;
+        for (unsigned int i=0; i<count; i++)
+        {
+            const HIDP_VALUE_CAPS &vc = valueCaps[i];
+            if (reportId < 0)
+                reportId = vc.ReportID;
+            else if (vc.ReportID != reportId)
+                continue;
+            if (vc.BitSize == 0 || vc.BitSize > 32)
+                continue;
+            if (HidP_InitializeReportForID(HidP_Input, vc.ReportID, pp, &base[0], len) != HIDP_STATUS_SUCCESS)
+                continue;
+            USAGE first = vc.IsRange ? vc.Range.UsageMin : vc.NotRange.Usage;
+            USAGE last = vc.IsRange ? vc.Range.UsageMax : vc.NotRange.Usage;
+            ULONG allOnes = (vc.BitSize >= 32) ? 0xFFFFFFFF : ((1UL << vc.BitSize) - 1);
+            for (unsigned int usage = first; usage <= last; usage++)
+            {
+                probe = base;
+                if (HidP_SetUsageValue(HidP_Input, vc.UsagePage, vc.LinkCollection, usage, allOnes, pp, &probe[0], len) != HIDP_STATUS_SUCCESS)
+                    continue;
+                unsigned int low, high;
+                if (!ChangedBits(base, probe, low, high))
+                    continue;
+                AddVariable(MakeUsage(vc.UsagePage, usage), low - 8, vc.BitSize, vc.LogicalMin);
+            }
+        }
+    }
+
+    return fields.empty() ? HidDevice::E_ERR_NOTFOUND : 0;
+}
+
+#else
+
+int ReportDecoder::Compile(HidDevice &dev)
+{
+    std::vector<uint8_t> desc;
+    int status = dev.GetReportDescriptor(desc);
+    if (status != 0)
+    {
+        Clear();
+        return status;
+    }
+    return CompileDescriptor(&desc[0], desc.size());
+}
+
+#endif
+
+std::string ReportDecoder::ToString(void) const
+{
+    std::stringstream stream;
+    stream << std::hex << std::setfill('0');
+    for (unsigned int i=0; i<fields.size(); i++)
+    {
+        const Field &f = fields[i];
+        stream << "bit " << std::dec << f.bitOffset << ", size " << f.bitSize << std::hex << ": ";
+        if (!f.array)
+        {
+            stream << "0x" << std::setw(4) << (f.usage >> 16) << ":0x" << std::setw(4) << (f.usage & 0xFFFF);
+        }
+        else
+        {
+            stream << "array of " << std::dec << f.usages.size() << std::hex;
+            if (!f.usages.empty())
+            {
+                uint32_t last = f.usages.back();
+                stream << " (up to 0x" << std::setw(4) << (last >> 16) << ":0x" << std::setw(4) << (last & 0xFFFF) << ")";
+            }
+        }
+        stream << "\n";
+    }
+    return stream.str();
+}
@@ -0,0 +1,154 @@
+/** \file
+    \brief Input report decoding table compiled from HID report descriptor
+    \note Table is compiled once (when device is opened); decoding usage is then
+    a bit field extraction at precomputed location.
+    Only first input report ID present in descriptor is handled.
+*/
+
+#ifndef ReportDecoderH
+#define ReportDecoderH
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace nsHidDevice {
+
+    class HidDevice;
+
+    class ReportDecoder
+    {
+    public:
+        /** \brief Usage with usage page in upper 16 bits, as in 32-bit Usage item
+        */
+        static uint32_t MakeUsage(unsigned int page, unsigned int id) {
+            return (static_cast<uint32_t>(page) << 16) | (id & 0xFFFF);
+        }
+
+        /** \brief Single input item: variable (one usage) or array slot (usage selected by value)
+        */
+        struct Field
+        {
+            uint32_t usage;                 ///< variable field usage, 0 for array
+            std::vector<uint32_t> usages;   ///< array field: usage for value - logicalMin, 0 = none
+            int32_t logicalMin;
+            uint16_t bitOffset;             ///< in report data without report ID
+            uint8_t bitSize;
+            bool array;
+        };
+
+        /** \brief Resolved usage location
+        */
+        struct Location
+        {
+            int field;          ///< index in field table, -1 if usage is not present
+            uint32_t value;     ///< array field: value indicating usage
+            Location(void):
+                field(-1),
+                value(0)
+            {}
+            bool IsValid(void) const {
+                return field >= 0;
+            }
+        };
+
+        ReportDecoder(void);
+        void Clear(void);
+
+        /** \brief Compile table for device (preparsed data on Windows, report descriptor on Linux)
+            \return 0 on success
+        */
+        int Compile(HidDevice &dev);
+
+        /** \brief Compile table from raw report descriptor
+            \return 0 on success
+        */
+        int CompileDescriptor(const uint8_t *desc, unsigned int size);
+
+        void AddField(const Field &field);
+        void AddVariable(uint32_t usage, unsigned int bitOffset, unsigned int bitSize, int32_t logicalMin = 0);
+        void AddArray(const std::vector<uint32_t> &usages, int32_t logicalMin, unsigned int bitOffset, unsigned int bitSize);
+
+        /** \brief Find usage location; done once, location is used for decoding
+        */
+        Location Resolve(uint32_t usage) const;
+
+        /** \brief Check if usage is active: non-zero variable or array slot with value selecting usage
+        */
+        bool IsActive(const uint8_t *report, unsigned int size, const Location &loc) const {
+            if (loc.field < 0)
+                return false;
+            const Field &f = fields[loc.field];
+            uint32_t value = Extract(report, size, f.bitOffset, f.bitSize);
+            return f.array ? (value == loc.value) : (value != 0);
+        }
+
+        /** \brief Get raw value of field
+        */
+        uint32_t GetValue(const uint8_t *report, unsigned int size, const Location &loc) const {
+            if (loc.field < 0)
+                return 0;
+            const Field &f = fields[loc.field];
+            return Extract(report, size, f.bitOffset, f.bitSize);
+        }
+
+        /** \brief Get usage currently selected in array field
+            \return 0 if none
+        */
+        uint32_t GetArrayUsage(const uint8_t *report, unsigned int size, int field) const {
+            if (field < 0)
+                return 0;
+            const Field &f = fields[field];
+            uint32_t index = GetArrayIndex(report, size, field);
+            return (index < f.usages.size()) ? f.usages[index] : 0;
+        }
+
+        /** \brief Get index of selected usage in Field::usages (value - logicalMin), for table lookup
+        */
+        uint32_t GetArrayIndex(const uint8_t *report, unsigned int size, int field) const {
+            const Field &f = fields[field];
+            return Extract(report, size, f.bitOffset, f.bitSize) - f.logicalMin;
+        }
+
+        /** \brief Decode all controls: list usages of non-zero variables and selected array items
+            \return number of usages written
+        */
+        unsigned int GetActiveUsages(const uint8_t *report, unsigned int size, uint32_t *usages, unsigned int maxCount) const;
+
+        const Field& GetField(int index) const {
+            return fields[index];
+        }
+
+        /** \brief Report data size (without report ID) needed to decode all fields
+        */
+        unsigned int GetMinReportSize(void) const {
+            return minReportSize;
+        }
+
+        unsigned int GetFieldCount(void) const {
+            return fields.size();
+        }
+
+        std::string ToString(void) const;
+
+        static uint32_t Extract(const uint8_t *report, unsigned int size, unsigned int bitOffset, unsigned int bitSize) {
+            unsigned int first = bitOffset >> 3;
+            unsigned int bytes = ((bitOffset & 0x07) + bitSize + 7) >> 3;
+            uint64_t raw = 0;
+            for (unsigned int i=0; i<bytes && first + i < size; i++) {
+                raw |= static_cast<uint64_t>(report[first + i]) << (8*i);
+            }
+            raw >>= (bitOffset & 0x07);
+            if (bitSize < 32)
+                raw &= (static_cast<uint64_t>(1) << bitSize) - 1;
+            return static_cast<uint32_t>(raw);
+        }
+
+    private:
+        std::vector<Field> fields;
+        unsigned int minReportSize;
+    };
+
+};
+
+#endif // ReportDecoderH
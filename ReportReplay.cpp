@@ -0,0 +1,694 @@
+#include "ReportReplay.h"
+#include "KeyMap.h"
+#include "HidDevice.h"
+#include "Clock.h"
+#include "CustomConf.h"
+#include "DisplayText.h"
+#include "ScopedLock.h"
+#include <fstream>
+#include <sstream>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <time.h>
+
+ReportReplay *ReportReplay::active = NULL;
+
+namespace
+{
+
+const char REPORT_TAG[] = "REPORT_IN received:";
+const char HOST_TAG[] = "HOST ";
+const char CAPTURE_SIGNATURE[] = "CX300RPL";
+enum { SIGNATURE_SIZE = 8 };
+/** Same as comm thread timer wheel */
+enum { TIMER_RESOLUTION = 10 };
+const uint64_t DAY_US = 24ULL * 3600 * 1000000;
+/** Time for writer threads to pass queued reports to simulated interfaces [ms] */
+enum { FLUSH_TIMEOUT = 1000 };
+
+/** \brief Host command names in log, by HostCommand::Type */
+const char* const HOST_COMMANDS[] = { "REGISTRATION_STATE", "CALL_STATE", "RING", "MWI" };
+
+/* Display OUT reports (PhoneSession) */
+enum { REPORT_TEXT_MODE = 0x13, REPORT_TEXT_SELECT = 0x14 };
+
+/* Simulated phone interfaces, report lengths as from HidP_GetCaps (_doc/notes.txt) */
+const char TELEPHONY_PATH[] = "replay/telephony";
+const char DISPLAY_PATH[] = "replay/display";
+
+/** Telephony interface: input report as observed on CX300 (_doc/logs.txt) */
+const uint8_t TELEPHONY_DESCRIPTOR[] = {
+    0x05, 0x0B,                     // Usage Page (Telephony)
+    0x09, 0x01,                     // Usage (Phone)
+    0xA1, 0x01,                     // Collection (Application)
+    0x15, 0x00, 0x25, 0x01,         //   Logical Minimum (0), Logical Maximum (1)
+    0x75, 0x01, 0x95, 0x01,         //   Report Size (1), Report Count (1)
+    0x09, 0x20, 0x81, 0x02,         //   Usage (Hook Switch), Input (Data, Variable)
+    0x09, 0x23, 0x81, 0x02,         //   Usage (Hold)
+    0x09, 0x24, 0x81, 0x02,         //   Usage (Redial)
+    0x0B, 0x01, 0x00, 0xFF, 0xFF,   //   Usage (0xFFFF:0x0001): long press flag
+    0x81, 0x02,
+    0x09, 0x2F, 0x81, 0x02,         //   Usage (Phone Mute)
+    0x09, 0x21, 0x81, 0x02,         //   Usage (Flash)
+    0x95, 0x02, 0x81, 0x01,         //   Report Count (2), Input (Constant)
+    0x75, 0x08, 0x95, 0x01,         //   Report Size (8), Report Count (1)
+    0x15, 0x01, 0x25, 0x0C,         //   Logical Minimum (1), Logical Maximum (12)
+    0x19, 0xB0, 0x29, 0xBB,         //   Usage Minimum (Phone Key 0), Usage Maximum (Phone Key Pound)
+    0x81, 0x00,                     //   Input (Data, Array)
+    0x95, 0x05, 0x81, 0x01,         //   Report Count (5), Input (Constant)
+    0x95, 0x01, 0x91, 0x01,         //   Report Count (1), Output (Constant)
+    0x95, 0x3F, 0xB1, 0x01,         //   Report Count (63), Feature (Constant)
+    0xC0                            // End Collection
+};
+
+/** Display interface: text, LED and keepalive reports */
+const uint8_t DISPLAY_DESCRIPTOR[] = {
+    0x06, 0x99, 0xFF,               // Usage Page (vendor)
+    0x09, 0x01,                     // Usage (1)
+    0xA1, 0x01,                     // Collection (Application)
+    0x15, 0x00, 0x26, 0xFF, 0x00,   //   Logical Minimum (0), Logical Maximum (255)
+    0x75, 0x08,                     //   Report Size (8)
+    0x85, DisplayText::REPORT_ID,   //   Report ID (text)
+    0x95, DisplayText::REPORT_SIZE - 1,
+    0x09, 0x02, 0x91, 0x02,         //   Usage (2), Output (Data, Variable)
+    0x85, 0x17,                     //   Report ID (keepalive)
+    0x95, 0x04,                     //   Report Count (4)
+    0x09, 0x03, 0xB1, 0x02,         //   Usage (3), Feature (Data, Variable)
+    0xC0                            // End Collection
+};
+
+struct NamedByte
+{
+    uint8_t value;
+    const char *name;
+};
+const NamedByte TEXT_MODES[] = {
+    { 0x00, "clear" }, { 0x15, "mode two lines" }, { 0x0D, "mode four corners" }
+};
+const NamedByte TEXT_SLOTS[] = {
+    { 0x05, "top" }, { 0x0A, "bottom" },
+    { 0x01, "top left" }, { 0x02, "bottom left" }, { 0x03, "top right" }, { 0x04, "bottom right" }
+};
+
+const char* FindName(const NamedByte *names, unsigned int count, uint8_t value)
+{
+    for (unsigned int i=0; i<count; i++)
+    {
+        if (names[i].value == value)
+            return names[i].name;
+    }
+    return NULL;
+}
+
+std::string ReportToHex(const uint8_t *report, int len)
+{
+    std::string text;
+    char buf[4];
+    for (int i=0; i<len; i++)
+    {
+        snprintf(buf, sizeof(buf), i ? " %02X" : "%02X", report[i]);
+        text += buf;
+    }
+    return text;
+}
+
+/** \brief Display glyph (UCS-2) as UTF-8 */
+void AppendUtf8(std::string &text, uint16_t glyph)
+{
+    if (glyph < 0x80)
+    {
+        text += static_cast<char>(glyph);
+    }
+    else if (glyph < 0x800)
+    {
+        text += static_cast<char>(0xC0 | (glyph >> 6));
+        text += static_cast<char>(0x80 | (glyph & 0x3F));
+    }
+    else
+    {
+        text += static_cast<char>(0xE0 | (glyph >> 12));
+        text += static_cast<char>(0x80 | ((glyph >> 6) & 0x3F));
+        text += static_cast<char>(0x80 | (glyph & 0x3F));
+    }
+}
+
+/** \brief Parse host command following HOST_TAG
+    \return 0 on success, -1 if text is not host command, 1 if command is malformed
+*/
+int ParseHostCommand(const char *p, HostCommand &cmd)
+{
+    int type = -1;
+    for (unsigned int i=0; i<sizeof(HOST_COMMANDS)/sizeof(HOST_COMMANDS[0]); i++)
+    {
+        size_t len = strlen(HOST_COMMANDS[i]);
+        if (strncmp(p, HOST_COMMANDS[i], len) == 0 && isspace(static_cast<unsigned char>(p[len])))
+        {
+            type = i;
+            p += len;
+            break;
+        }
+    }
+    if (type < 0)
+        return -1;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = static_cast<HostCommand::Type>(type);
+    int consumed = 0;
+    if (cmd.type == HostCommand::MWI)
+        return (sscanf(p, "%d %u", &cmd.accountId, &cmd.newMessages) == 2) ? 0 : 1;
+    if (sscanf(p, "%d%n", &cmd.state, &consumed) != 1)
+        return 1;
+    p += consumed;
+    if (cmd.type == HostCommand::CALL_STATE && *p == ' ')
+    {
+        // rest of line is display text
+        std::string display(p + 1);
+        while (!display.empty() && (display[display.size() - 1] == '\r' || display[display.size() - 1] == '\n'))
+            display.erase(display.size() - 1);
+        snprintf(cmd.display, sizeof(cmd.display), "%s", display.c_str());
+    }
+    return 0;
+}
+
+int HexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+/** \brief Parse "HH:MM:SS.mmm" at start of line
+    \return false if line does not start with timestamp
+*/
+bool ParseTime(const std::string &line, uint64_t &timeUs)
+{
+    unsigned int h, m, s, ms;
+    char c;
+    if (sscanf(line.c_str(), "%2u:%2u:%2u.%3u%c", &h, &m, &s, &ms, &c) != 5 || !isspace(static_cast<unsigned char>(c)))
+        return false;
+    timeUs = ((h * 3600ULL + m * 60 + s) * 1000 + ms) * 1000;
+    return true;
+}
+
+}   // namespace
+
+
+std::string ReplayCall::ToString(uint64_t startUs) const
+{
+    uint64_t ms = (timeUs - startUs) / 1000;
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%u.%03u ", static_cast<unsigned int>(ms / 1000), static_cast<unsigned int>(ms % 1000));
+    std::string text = buf;
+    switch (type)
+    {
+    case KEY:
+    {
+        const char *name = KeyMap::GetKeyName(keyCode);
+        if (name)
+        {
+            text += std::string("Key ") + name;
+        }
+        else
+        {
+            snprintf(buf, sizeof(buf), "Key %d", keyCode);
+            text += buf;
+        }
+        text += state ? " down" : " up";
+        break;
+    }
+    case SCRIPT:
+        text += "Script " + script;
+        break;
+    case REDIAL:
+        text += "Redial";
+        break;
+    case DISPLAY:
+        text += "Display " + this->text;
+        break;
+    case OUTPUT:
+        text += "Output " + this->text;
+        break;
+    }
+    return text;
+}
+
+
+int ReportReplay::ParseLog(std::istream &stream, std::vector<ReplayReport> &reports)
+{
+    reports.clear();
+    std::string line;
+    unsigned int lineNumber = 0;
+    uint64_t offset = 0;
+    uint64_t lastUs = 0;
+    while (std::getline(stream, line))
+    {
+        lineNumber++;
+        size_t pos = line.find(REPORT_TAG);
+        ReplayReport report;
+        report.line = lineNumber;
+        if (pos == std::string::npos)
+        {
+            size_t hostPos = line.find(HOST_TAG);
+            if (hostPos == std::string::npos)
+                continue;
+            int status = ParseHostCommand(line.c_str() + hostPos + strlen(HOST_TAG), report.command);
+            if (status < 0)
+                continue;
+            if (status > 0)
+                return lineNumber;
+            report.host = true;
+        }
+
+        uint64_t logUs = 0;
+        if (!ParseTime(line, logUs) && !reports.empty())
+        {
+            report.timeUs = lastUs;
+        }
+        else
+        {
+            report.timeUs = logUs + offset;
+            if (!reports.empty() && report.timeUs < lastUs)
+            {
+                if (lastUs - report.timeUs > DAY_US / 2)
+                    offset += DAY_US;
+                else
+                    offset += lastUs - report.timeUs + LOG_GAP * 1000ULL;
+                report.timeUs = logUs + offset;
+            }
+        }
+
+        if (report.host)
+        {
+            lastUs = report.timeUs;
+            reports.push_back(report);
+            continue;
+        }
+
+        const char *p = line.c_str() + pos + strlen(REPORT_TAG);
+        for (;;)
+        {
+            while (*p == ' ' || *p == '\t')
+                p++;
+            int hi = HexDigit(p[0]);
+            int lo = (hi >= 0) ? HexDigit(p[1]) : -1;
+            if (lo < 0 || (p[2] != '\0' && !isspace(static_cast<unsigned char>(p[2]))))
+                break;
+            report.data.push_back(static_cast<uint8_t>((hi << 4) | lo));
+            p += 2;
+        }
+        const char *comment = strstr(p, "//");
+        if (comment)
+        {
+            report.comment = comment + 2;
+            while (!report.comment.empty() && isspace(static_cast<unsigned char>(report.comment[0])))
+                report.comment.erase(0, 1);
+        }
+        else if (*p != '\0' && *p != '\r')
+        {
+            return lineNumber;
+        }
+        if (report.data.empty())
+            return lineNumber;
+
+        lastUs = report.timeUs;
+        reports.push_back(report);
+    }
+    return 0;
+}
+
+int ReportReplay::Load(const std::string &fileName, std::vector<ReplayReport> &reports)
+{
+    reports.clear();
+    std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+    if (!file)
+        return -1;
+    char signature[SIGNATURE_SIZE];
+    if (!file.read(signature, sizeof(signature)) || memcmp(signature, CAPTURE_SIGNATURE, SIGNATURE_SIZE) != 0)
+    {
+        file.clear();
+        file.seekg(0);
+        return ParseLog(file, reports);
+    }
+    for (;;)
+    {
+        uint8_t header[9];
+        if (!file.read(reinterpret_cast<char*>(header), sizeof(header)))
+            return file.gcount() ? -1 : 0;
+        ReplayReport report;
+        for (unsigned int i=0; i<8; i++)
+            report.timeUs |= static_cast<uint64_t>(header[i]) << (8*i);
+        report.data.resize(header[8]);
+        if (!report.data.empty() && !file.read(reinterpret_cast<char*>(&report.data[0]), report.data.size()))
+            return -1;
+        if (!reports.empty() && report.timeUs < reports.back().timeUs)
+            return -1;
+        reports.push_back(report);
+    }
+}
+
+int ReportReplay::SaveCapture(const std::string &fileName, const std::vector<ReplayReport> &reports)
+{
+    std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file)
+        return -1;
+    file.write(CAPTURE_SIGNATURE, SIGNATURE_SIZE);
+    for (unsigned int i=0; i<reports.size(); i++)
+    {
+        const ReplayReport &report = reports[i];
+        if (report.host)
+            continue;       // capture holds reports only
+        uint8_t header[9];
+        for (unsigned int j=0; j<8; j++)
+            header[j] = static_cast<uint8_t>(report.timeUs >> (8*j));
+        unsigned int size = (report.data.size() > 0xFF) ? 0xFF : report.data.size();
+        header[8] = static_cast<uint8_t>(size);
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        if (size)
+            file.write(reinterpret_cast<const char*>(&report.data[0]), size);
+    }
+    return file ? 0 : -1;
+}
+
+int ReportReplay::ParseWallTime(const std::string &text, uint64_t &wallTimeUs)
+{
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(text.c_str(), "%d-%d-%d %d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+            &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6)
+        return -1;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    time_t t = mktime(&tm);
+    if (t == static_cast<time_t>(-1))
+        return -1;
+    wallTimeUs = static_cast<uint64_t>(t) * 1000000;
+    return 0;
+}
+
+
+ReportReplay::Interface::Interface(ReportReplay &replay, const uint8_t *descriptor, unsigned int size):
+    replay(replay),
+    descriptor(descriptor, descriptor + size)
+{
+}
+
+void ReportReplay::Interface::GetReportDescriptor(std::vector<uint8_t> &desc) const
+{
+    desc = descriptor;
+}
+
+int ReportReplay::Interface::Write(enum nsHidDevice::HidDevice::E_REPORT_TYPE type, const uint8_t *report, int len)
+{
+    // feature reports (keepalive) are not recorded
+    if (type == nsHidDevice::HidDevice::E_REPORT_OUT)
+    {
+        ScopedLock<Mutex> lock(replay.writtenMutex);
+        replay.written.push_back(std::vector<uint8_t>(report, report + len));
+    }
+    return 0;
+}
+
+
+ReportReplay::ReportReplay(const KeyMap &keyMap, const KeyMacroTable &keyMacros):
+    timers(TIMER_RESOLUTION * 1000),
+    phone(0, "replay", timers, keyMap, keyMacros, layout),
+    recording(false),
+    startUs(0),
+    telephony(*this, TELEPHONY_DESCRIPTOR, sizeof(TELEPHONY_DESCRIPTOR)),
+    display(*this, DISPLAY_DESCRIPTOR, sizeof(DISPLAY_DESCRIPTOR)),
+    outputEnabled(false),
+    outputWallUs(0),
+    wallOffsetUs(0)
+{
+    active = this;
+    layout.Compile(customConf.screens);
+    phone.SetTimeSource(GetVirtualTime);
+    phone.SetWallTimeSource(GetVirtualWallTime);
+    phone.ResetInput();
+}
+
+uint64_t ReportReplay::GetVirtualTime(void)
+{
+    return active ? active->timers.GetTime() : 0;
+}
+
+uint64_t ReportReplay::GetVirtualWallTime(void)
+{
+    return active ? active->timers.GetTime() + active->wallOffsetUs : 0;
+}
+
+ReportReplay::~ReportReplay(void)
+{
+    recording = false;
+    phone.ResetInput();     // stops macros, while callbacks still come here
+    if (active == this)
+        active = NULL;
+}
+
+void ReportReplay::AdvanceTo(uint64_t timeUs)
+{
+    // step through each expiry, so macro steps are recorded with their own time
+    uint64_t deadline;
+    while ((deadline = timers.GetNextDeadline()) <= timeUs && deadline > timers.GetTime())
+    {
+        timers.Advance(deadline);
+        PollPhone();
+    }
+    timers.Advance(timeUs);
+    PollPhone();
+}
+
+void ReportReplay::PollPhone(void)
+{
+    if (outputEnabled && recording)
+    {
+        phone.Poll(hostState);
+        CollectOutput();
+    }
+    else
+    {
+        phone.PollMacros();
+    }
+}
+
+void ReportReplay::RecordOutput(uint64_t wallTimeUs)
+{
+    outputEnabled = true;
+    outputWallUs = wallTimeUs;
+}
+
+void ReportReplay::Run(const std::vector<ReplayReport> &reports)
+{
+    calls.clear();
+    phone.ResetInput();
+    startUs = timers.GetTime() + TIMER_RESOLUTION * 1000;
+    if (reports.empty())
+        return;
+    if (outputEnabled)
+    {
+        // display is written from first report on, as by phone opened just before it
+        wallOffsetUs = outputWallUs - startUs;
+        displaySlot.clear();
+        displayGlyphs.clear();
+        nsHidDevice::HidDevice::AddSimulated(TELEPHONY_PATH, &telephony);
+        nsHidDevice::HidDevice::AddSimulated(DISPLAY_PATH, &display);
+        if (phone.Open(TELEPHONY_PATH, DISPLAY_PATH, Clock::GetTimeUs()) != 0)
+            outputEnabled = false;
+        CollectOutput();
+    }
+    // virtual time continues from previous run; timer wheel time cannot go back
+    uint64_t firstUs = reports[0].timeUs;
+    recording = true;
+    for (unsigned int i=0; i<reports.size(); i++)
+    {
+        const ReplayReport &report = reports[i];
+        uint64_t timeUs = startUs + (report.timeUs - firstUs);
+        AdvanceTo(timeUs);
+        if (report.host)
+        {
+            hostState.Apply(report.command, timers.GetTime());
+            PollPhone();
+            continue;
+        }
+        phone.HandleReportIn(report.data.empty() ? NULL : &report.data[0], report.data.size(), timeUs, hostState);
+    }
+    AdvanceTo(timers.GetTime() + TAIL * 1000ULL);
+    recording = false;
+    if (outputEnabled)
+    {
+        phone.Close(false);
+        CollectOutput();
+        nsHidDevice::HidDevice::RemoveSimulated(TELEPHONY_PATH);
+        nsHidDevice::HidDevice::RemoveSimulated(DISPLAY_PATH);
+    }
+}
+
+double ReportReplay::Benchmark(const std::vector<ReplayReport> &reports, unsigned int repeat)
+{
+    if (reports.empty() || repeat == 0)
+        return 0;
+    uint64_t firstUs = reports[0].timeUs;
+    uint64_t beginUs = Clock::GetTimeUs();
+    for (unsigned int r=0; r<repeat; r++)
+    {
+        phone.ResetInput();
+        uint64_t baseUs = timers.GetTime() + TIMER_RESOLUTION * 1000;
+        for (unsigned int i=0; i<reports.size(); i++)
+        {
+            const ReplayReport &report = reports[i];
+            if (report.host)
+                continue;
+            uint64_t timeUs = baseUs + (report.timeUs - firstUs);
+            AdvanceTo(timeUs);
+            phone.HandleReportIn(report.data.empty() ? NULL : &report.data[0], report.data.size(), timeUs, hostState);
+        }
+    }
+    uint64_t elapsedUs = Clock::GetTimeUs() - beginUs;
+    if (elapsedUs == 0)
+        elapsedUs = 1;
+    return static_cast<double>(reports.size()) * repeat * 1000000.0 / elapsedUs;
+}
+
+int ReportReplay::Check(std::istream &expected, std::string &error) const
+{
+    std::string line;
+    unsigned int index = 0;
+    unsigned int lineNumber = 0;
+    while (std::getline(expected, line))
+    {
+        lineNumber++;
+        while (!line.empty() && isspace(static_cast<unsigned char>(line[line.size() - 1])))
+            line.erase(line.size() - 1);
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::stringstream stream;
+        if (index >= calls.size())
+        {
+            stream << "line " << lineNumber << ": expected \"" << line << "\", no more calls";
+            error = stream.str();
+            return -1;
+        }
+        std::string actual = calls[index].ToString(startUs);
+        if (actual != line)
+        {
+            stream << "line " << lineNumber << ": expected \"" << line << "\", got \"" << actual << "\"";
+            error = stream.str();
+            return -1;
+        }
+        index++;
+    }
+    if (index < calls.size())
+    {
+        error = "unexpected call \"" + calls[index].ToString(startUs) + "\"";
+        return -1;
+    }
+    return 0;
+}
+
+void ReportReplay::Record(ReplayCall &call)
+{
+    if (!recording)
+        return;
+    call.timeUs = timers.GetTime();
+    calls.push_back(call);
+}
+
+void ReportReplay::CollectOutput(void)
+{
+    Interface* const interfaces[] = { &telephony, &display };
+    for (unsigned int i=0; i<sizeof(interfaces)/sizeof(interfaces[0]); i++)
+    {
+        nsHidDevice::HidDevice *dev = interfaces[i]->GetDevice();
+        if (dev)
+            dev->Flush(FLUSH_TIMEOUT);
+    }
+    std::vector<std::vector<uint8_t> > reports;
+    {
+        ScopedLock<Mutex> lock(writtenMutex);
+        reports.swap(written);
+    }
+    for (unsigned int i=0; i<reports.size(); i++)
+        DecodeOutput(&reports[i][0], reports[i].size());
+}
+
+void ReportReplay::DecodeOutput(const uint8_t *report, int len)
+{
+    if (len < 2)
+        return;
+    ReplayCall call;
+    call.type = ReplayCall::DISPLAY;
+    const char *name;
+    switch (report[0])
+    {
+    case REPORT_TEXT_MODE:
+        name = FindName(TEXT_MODES, sizeof(TEXT_MODES)/sizeof(TEXT_MODES[0]), report[1]);
+        call.text = name ? name : "mode " + ReportToHex(report + 1, len - 1);
+        Record(call);
+        return;
+    case REPORT_TEXT_SELECT:
+        name = FindName(TEXT_SLOTS, sizeof(TEXT_SLOTS)/sizeof(TEXT_SLOTS[0]), report[1]);
+        displaySlot = name ? name : "slot " + ReportToHex(report + 1, 1);
+        displayGlyphs.clear();
+        return;
+    case DisplayText::REPORT_ID:
+        for (int pos = DisplayText::REPORT_HEADER; pos + 1 < len; pos += 2)
+        {
+            uint16_t glyph = static_cast<uint16_t>(report[pos] | (report[pos + 1] << 8));
+            if (glyph != 0)
+                displayGlyphs.push_back(glyph);
+        }
+        if (report[1] & DisplayText::LAST_CHUNK)
+        {
+            call.text = displaySlot + " \"";
+            for (unsigned int i=0; i<displayGlyphs.size(); i++)
+                AppendUtf8(call.text, displayGlyphs[i]);
+            call.text += "\"";
+            displayGlyphs.clear();
+            Record(call);
+        }
+        return;
+    default:
+        call.type = ReplayCall::OUTPUT;
+        call.text = ReportToHex(report, len);
+        Record(call);
+        return;
+    }
+}
+
+void ReportReplay::OnKey(int keyCode, int state)
+{
+    if (active)
+    {
+        ReplayCall call;
+        call.type = ReplayCall::KEY;
+        call.keyCode = keyCode;
+        call.state = state;
+        active->Record(call);
+    }
+}
+
+void ReportReplay::OnScript(const char *script)
+{
+    if (active)
+    {
+        ReplayCall call;
+        call.type = ReplayCall::SCRIPT;
+        call.script = script ? script : "";
+        active->Record(call);
+    }
+}
+
+void ReportReplay::OnRedial(void)
+{
+    if (active)
+    {
+        ReplayCall call;
+        call.type = ReplayCall::REDIAL;
+        active->Record(call);
+    }
+}
@@ -0,0 +1,208 @@
+/** \file
+    \brief Replay of captured input reports through phone report handling, without device
+    \note Reports are taken from REPORT_IN log lines
+    ("13:27:31.892 PhonePolycomCX300.dll: REPORT_IN received: 00 01 00 00 D5 5A 00 00")
+    or from binary capture and passed to PhoneSession::HandleReportIn() with original timing.
+    Log may also hold tSIP state changes ("00:00:05.000 HOST CALL_STATE 1 John Smith"), applied
+    to host state at their time. Timers (key macros, display) run on virtual clock, so replay
+    does not wait.
+    Key(), RunScriptAsync() and Redial() calls made by phone are recorded - host functions
+    have to forward them to ReportReplay::OnKey(), OnScript() and OnRedial(). Optionally phone
+    is opened with simulated interfaces (nsHidDevice::SimulatedDevice) and display and LED
+    reports it writes are recorded too, decoded (RecordOutput()).
+    Phone measures latency on virtual clock too, so report -> Key() latency of replay is 0;
+    Key() callback duration is real.
+*/
+
+#ifndef ReportReplayH
+#define ReportReplayH
+
+#include "PhoneSession.h"
+#include "DisplayLayout.h"
+#include "TimerWheel.h"
+#include "Mutex.h"
+#include <stdint.h>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+class KeyMap;
+class KeyMacroTable;
+
+struct ReplayReport
+{
+    uint64_t timeUs;            ///< virtual reception time
+    std::vector<uint8_t> data;  ///< report without report ID
+    unsigned int line;          ///< log line number, 0 for binary capture
+    std::string comment;        ///< text after "//" in log line
+    bool host;                  ///< host state change instead of report
+    HostCommand command;        ///< host: state change, as posted by tSIP
+    ReplayReport(void):
+        timeUs(0),
+        line(0),
+        host(false),
+        command()
+    {}
+};
+
+/** \brief Host function called by phone during replay
+*/
+struct ReplayCall
+{
+    enum Type
+    {
+        KEY,
+        SCRIPT,
+        REDIAL,
+        DISPLAY,                ///< display text written to slot, mode set or display cleared
+        OUTPUT                  ///< other OUT report (LED)
+    };
+    enum Type type;
+    uint64_t timeUs;            ///< virtual time of call
+    int keyCode;                ///< KEY: E_KEY
+    int state;                  ///< KEY: 1 = pressed
+    std::string script;         ///< SCRIPT
+    std::string text;           ///< DISPLAY: slot and its text or mode, OUTPUT: report bytes
+    ReplayCall(void):
+        type(KEY),
+        timeUs(0),
+        keyCode(-1),
+        state(0)
+    {}
+    /** \brief One line: time [s] since startUs and call, e.g. "7.104 Key 1 down", "9.000 Script ToggleHold()",
+        "12.300 Redial", "14.010 Display bottom \"00:00:03\"", "14.010 Display mode four corners", "15.000 Output 16 01 00"
+    */
+    std::string ToString(uint64_t startUs) const;
+};
+
+class ReportReplay
+{
+public:
+    /** Virtual time inserted where log timestamps go back (separately captured parts) [ms] */
+    enum { LOG_GAP = 1000 };
+    /** Virtual time run after last report, so started macros can finish [ms] */
+    enum { TAIL = 5000 };
+
+    /** \brief Parse REPORT_IN and HOST log lines, other lines are skipped
+        \note Line without timestamp gets time of previous report. Time going back by
+        more than 12 hours is taken as midnight, otherwise as start of next capture (LOG_GAP).
+        Host lines: "HOST REGISTRATION_STATE state", "HOST CALL_STATE state [display text]",
+        "HOST RING state", "HOST MWI accountId newMessages".
+        \return 0 on success, number of malformed line otherwise
+    */
+    static int ParseLog(std::istream &stream, std::vector<ReplayReport> &reports);
+
+    /** \brief Load binary capture (written by SaveCapture()) or log file, recognized by content
+        \return 0 on success
+    */
+    static int Load(const std::string &fileName, std::vector<ReplayReport> &reports);
+
+    /** \brief Write binary capture: "CX300RPL" signature, then for each report 8-byte little endian
+        time [us], 1-byte size and report data
+        \return 0 on success
+    */
+    static int SaveCapture(const std::string &fileName, const std::vector<ReplayReport> &reports);
+
+    /** \brief Parse local time "YYYY-MM-DD hh:mm:ss" as wall clock time [us], for RecordOutput()
+        \return 0 on success
+    */
+    static int ParseWallTime(const std::string &text, uint64_t &wallTimeUs);
+
+    /** \param keyMap, keyMacros compiled configuration used by replayed phone, must outlive replay
+    */
+    ReportReplay(const KeyMap &keyMap, const KeyMacroTable &keyMacros);
+    ~ReportReplay(void);
+
+    /** \brief Host state seen by phone, e.g. ringState for keys acting differently while ringing
+    */
+    HostState& GetHostState(void) {
+        return hostState;
+    }
+
+    /** \brief Open phone with simulated interfaces for next Run() and record reports it writes
+        \param wallTimeUs wall clock shown by phone at first report (from ParseWallTime())
+    */
+    void RecordOutput(uint64_t wallTimeUs);
+
+    /** \brief Feed reports to phone with their timing, record calls (previous recording is cleared)
+    */
+    void Run(const std::vector<ReplayReport> &reports);
+
+    const std::vector<ReplayCall>& GetCalls(void) const {
+        return calls;
+    }
+    /** \brief Time of first replayed report, reference for ReplayCall::ToString() */
+    uint64_t GetStartTime(void) const {
+        return startUs;
+    }
+
+    /** \brief Compare recorded calls with expected lines (as from ReplayCall::ToString();
+        empty lines and lines starting with '#' are skipped)
+        \param error description of first difference
+        \return 0 if calls match
+    */
+    int Check(std::istream &expected, std::string &error) const;
+
+    /** \brief Feed reports repeatedly, without recording (host lines are skipped)
+        \return decoded reports per second (wall clock)
+    */
+    double Benchmark(const std::vector<ReplayReport> &reports, unsigned int repeat);
+
+    /* to be called by host functions */
+    static void OnKey(int keyCode, int state);
+    static void OnScript(const char *script);
+    static void OnRedial(void);
+
+private:
+    /** \brief Phone interface simulated at HidDevice level: OUT reports written by phone
+        are kept for recording
+    */
+    class Interface : public nsHidDevice::SimulatedDevice
+    {
+    public:
+        Interface(ReportReplay &replay, const uint8_t *descriptor, unsigned int size);
+        virtual void GetReportDescriptor(std::vector<uint8_t> &desc) const;
+        virtual int Write(enum nsHidDevice::HidDevice::E_REPORT_TYPE type, const uint8_t *report, int len);
+    private:
+        ReportReplay &replay;
+        std::vector<uint8_t> descriptor;
+    };
+    friend class Interface;
+
+    static ReportReplay *active;
+    TimerWheel timers;
+    DisplayLayout layout;       ///< screens from customConf
+    PhoneSession phone;
+    HostState hostState;
+    std::vector<ReplayCall> calls;
+    bool recording;
+    uint64_t startUs;
+
+    /* RecordOutput() */
+    Interface telephony, display;
+    Mutex writtenMutex;
+    std::vector<std::vector<uint8_t> > written;     ///< reports written by writer threads, not decoded yet
+    bool outputEnabled;
+    uint64_t outputWallUs;      ///< wall clock at startUs
+    uint64_t wallOffsetUs;      ///< wall clock - virtual time
+    std::string displaySlot;    ///< slot selected by last select report
+    std::vector<uint16_t> displayGlyphs;    ///< glyphs of text reports since select report
+
+    void AdvanceTo(uint64_t timeUs);
+    /** \brief Let phone handle expired timers: full Poll() with output, key macros only without */
+    void PollPhone(void);
+    /** \brief Virtual time of active replay: time source of replayed phone */
+    static uint64_t GetVirtualTime(void);
+    /** \brief Virtual wall clock of active replay: wall time source of replayed phone */
+    static uint64_t GetVirtualWallTime(void);
+    void Record(ReplayCall &call);
+    /** \brief Wait until phone reports are written to interfaces, record them */
+    void CollectOutput(void);
+    /** \brief Decode report into DISPLAY or OUTPUT call */
+    void DecodeOutput(const uint8_t *report, int len);
+
+    ReportReplay(const ReportReplay&);
+    ReportReplay& operator=(const ReportReplay&);
+};
+
+#endif // ReportReplayH
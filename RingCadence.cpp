@@ -0,0 +1,92 @@
+#include "RingCadence.h"
+
+namespace
+{
+
+enum
+{
+    LED = RingCadence::OUT_LED,
+    SPK = RingCadence::OUT_SPEAKER_LED,
+    DSP = RingCadence::OUT_DISPLAY
+};
+
+/* Cadence definitions, index = ringType */
+
+/** 0: fast blinking of status LED (original behavior) */
+const RingCadence::Segment BLINK[] = {
+    { 200, LED }, { 200, 0 }
+};
+/** 1: North American ring: 2 s on, 4 s off */
+const RingCadence::Segment LONG[] = {
+    { 2000, LED | DSP }, { 4000, 0 }
+};
+/** 2: UK double ring */
+const RingCadence::Segment DOUBLE[] = {
+    { 400, LED | DSP }, { 200, 0 }, { 400, LED | DSP }, { 2000, 0 }
+};
+/** 3: European ring: 1 s on, 4 s off */
+const RingCadence::Segment EUROPEAN[] = {
+    { 1000, LED | DSP }, { 4000, 0 }
+};
+/** 4: triple short burst with speaker LED */
+const RingCadence::Segment TRIPLE[] = {
+    { 200, LED | SPK | DSP }, { 200, DSP }, { 200, LED | SPK | DSP }, { 200, DSP },
+    { 200, LED | SPK | DSP }, { 1400, 0 }
+};
+/** 5: status and speaker LEDs alternating, display blinking */
+const RingCadence::Segment ALTERNATING[] = {
+    { 250, LED | DSP }, { 250, SPK }
+};
+
+#define CADENCE(name, segments) RingCadence(name, segments, sizeof(segments)/sizeof(segments[0]))
+
+}   // namespace
+
+
+RingCadence::RingCadence(const char *name, const Segment *segments, unsigned int count):
+    name(name),
+    cycleMs(0)
+{
+    for (unsigned int i=0; i<count; i++)
+    {
+        if (segments[i].durationMs == 0)
+            continue;
+        if (!steps.empty() && steps.back().outputs == segments[i].outputs)
+        {
+            steps.back().durationMs += segments[i].durationMs;
+        }
+        else
+        {
+            Step step;
+            step.offsetMs = cycleMs;
+            step.durationMs = segments[i].durationMs;
+            step.outputs = segments[i].outputs;
+            steps.push_back(step);
+        }
+        cycleMs += segments[i].durationMs;
+    }
+    if (steps.empty())
+    {
+        Step step;
+        step.offsetMs = 0;
+        step.durationMs = 1000;
+        step.outputs = 0;
+        steps.push_back(step);
+        cycleMs = step.durationMs;
+    }
+}
+
+const RingCadence& RingCadence::Get(unsigned int ringType)
+{
+    static const RingCadence cadences[TYPE_COUNT] = {
+        CADENCE("blink", BLINK),
+        CADENCE("long", LONG),
+        CADENCE("double", DOUBLE),
+        CADENCE("european", EUROPEAN),
+        CADENCE("triple", TRIPLE),
+        CADENCE("alternating", ALTERNATING)
+    };
+    if (ringType >= TYPE_COUNT)
+        ringType = 0;
+    return cadences[ringType];
+}
@@ -0,0 +1,70 @@
+/** \file
+    \brief Ring indication cadences
+    \note Each ring type (customConf.ringType) is compiled once into a cycle of steps with
+    exact offsets; phone only switches outputs when its cadence timer moves to next step.
+*/
+
+#ifndef RingCadenceH
+#define RingCadenceH
+
+#include <stdint.h>
+#include <vector>
+
+class RingCadence
+{
+public:
+    /** \brief Outputs active during step */
+    enum Output
+    {
+        OUT_LED = 0x01,             ///< status LED red (off otherwise)
+        OUT_SPEAKER_LED = 0x02,     ///< speaker LED on
+        OUT_DISPLAY = 0x04          ///< incoming call text on bottom display line
+    };
+
+    struct Step
+    {
+        unsigned int offsetMs;      ///< from start of cycle
+        unsigned int durationMs;
+        uint8_t outputs;            ///< Output flags
+    };
+
+    enum { TYPE_COUNT = 6 };
+
+    /** \brief Get compiled cadence
+        \param ringType 0...TYPE_COUNT-1, type 0 is used for values out of range
+    */
+    static const RingCadence& Get(unsigned int ringType);
+
+    const char* GetName(void) const {
+        return name;
+    }
+    unsigned int GetStepCount(void) const {
+        return steps.size();
+    }
+    const Step& GetStep(unsigned int index) const {
+        return steps[index];
+    }
+    /** \brief Length of whole cycle [ms] */
+    unsigned int GetCycleMs(void) const {
+        return cycleMs;
+    }
+
+    /** \brief Cadence segment as defined in table, before compilation */
+    struct Segment
+    {
+        unsigned int durationMs;
+        uint8_t outputs;
+    };
+
+    /** \brief Build step cycle from segments: offsets are accumulated, adjacent segments
+        with the same outputs are merged, zero-length segments are dropped
+    */
+    RingCadence(const char *name, const Segment *segments, unsigned int count);
+
+private:
+    const char *name;
+    std::vector<Step> steps;
+    unsigned int cycleMs;
+};
+
+#endif // RingCadenceH
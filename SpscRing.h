@@ -0,0 +1,96 @@
+/** \file
+    \brief Bounded single-producer/single-consumer ring buffer
+    \note Exactly one thread may call Push() and exactly one (other) thread may call Pop().
+    Capacity N must be a power of 2.
+*/
+
+#ifndef SpscRingH
+#define SpscRingH
+
+template <typename T, unsigned int N>
+class SpscRing
+{
+public:
+    SpscRing(void):
+        head(0),
+        tail(0)
+    {
+    }
+
+    /** \brief Add item (producer side)
+        \return false if ring is full
+    */
+    bool Push(const T &item) {
+        unsigned int h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        unsigned int t = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+        if (h - t >= N)
+            return false;
+        items[h & (N - 1)] = item;
+        __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    /** \brief Take oldest item (consumer side)
+        \return false if ring is empty
+    */
+    bool Pop(T &item) {
+        unsigned int t = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+        unsigned int h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+        if (h == t)
+            return false;
+        item = items[t & (N - 1)];
+        __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    /** \brief Get free slot to be filled in place (producer side), publish it with Commit()
+        \return NULL if ring is full
+    */
+    T* Reserve(void) {
+        unsigned int h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        unsigned int t = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+        if (h - t >= N)
+            return NULL;
+        return &items[h & (N - 1)];
+    }
+
+    /** \brief Publish slot obtained with Reserve() (producer side)
+    */
+    void Commit(void) {
+        __atomic_store_n(&head, __atomic_load_n(&head, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+    }
+
+    /** \brief Access oldest item in place (consumer side), release it with Release()
+        \return NULL if ring is empty
+    */
+    const T* Front(void) const {
+        unsigned int t = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+        unsigned int h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+        if (h == t)
+            return NULL;
+        return &items[t & (N - 1)];
+    }
+
+    /** \brief Free slot returned by Front() (consumer side)
+    */
+    void Release(void) {
+        __atomic_store_n(&tail, __atomic_load_n(&tail, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+    }
+
+    /** \brief Drop all items; call only when producer is not running
+    */
+    void Clear(void) {
+        __atomic_store_n(&tail, __atomic_load_n(&head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    }
+
+private:
+    enum { CAPACITY_CHECK = 1 / ((N & (N - 1)) == 0 ? 1 : 0) };   ///< N must be power of 2
+    unsigned int head;  ///< written by producer
+    unsigned int tail;  ///< written by consumer
+    T items[N];
+
+    SpscRing(const SpscRing&);
+    SpscRing& operator=(const SpscRing&);
+};
+
+#endif // SpscRingH
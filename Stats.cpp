@@ -0,0 +1,58 @@
+#include "Stats.h"
+#include <sstream>
+
+Stats stats;
+
+Stats::Stats(void):
+    outReportsSubmitted(0),
+    outReportsSuppressed(0),
+    writeErrors(0),
+    writeTimeouts(0),
+    hostCommands(0),
+    hostCommandsOverflow(0),
+    clockTicks(0),
+    clockDateRenders(0),
+    marqueeSteps(0),
+    marqueeRenders(0),
+    displayCacheHits(0),
+    displayCacheMisses(0),
+    displayCacheEvictions(0),
+    displayCacheBytes(0),
+    displayCacheBudget(0),
+    keyMacrosStarted(0),
+    keyMacrosDropped(0),
+    phonesReady(0),
+    readyMsMin(0),
+    readyMsMax(0),
+    commThreadCpuMs(0),
+    wakeups(0),
+    wakeupsPerMinute(0)
+{
+
+}
+
+void Stats::AddPhoneReady(unsigned int readyMs)
+{
+    if (phonesReady == 0 || readyMs < readyMsMin)
+        readyMsMin = readyMs;
+    if (readyMs > readyMsMax)
+        readyMsMax = readyMs;
+    phonesReady++;
+}
+
+std::string Stats::ToString(void) const
+{
+    std::stringstream stream;
+    stream << "OUT reports: submitted " << outReportsSubmitted << ", suppressed " << outReportsSuppressed;
+    stream << ", write errors " << writeErrors << ", timeouts " << writeTimeouts;
+    stream << "; host commands " << hostCommands << " (overflow " << hostCommandsOverflow << ")";
+    stream << "; clock ticks " << clockTicks << ", date renders " << clockDateRenders;
+    stream << "; marquee steps " << marqueeSteps << ", renders " << marqueeRenders;
+    stream << "; display cache hits " << displayCacheHits << ", misses " << displayCacheMisses;
+    stream << ", evictions " << displayCacheEvictions << ", " << displayCacheBytes << "/" << displayCacheBudget << " B";
+    stream << "; key macros " << keyMacrosStarted << " (dropped " << keyMacrosDropped << ")";
+    stream << "; phones ready " << phonesReady << ", after detection " << readyMsMin << "..." << readyMsMax << " ms";
+    stream << "; comm thread CPU " << commThreadCpuMs << " ms";
+    stream << ", wakeups " << wakeups << " (" << wakeupsPerMinute << "/min)";
+    return stream.str();
+}
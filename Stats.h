@@ -0,0 +1,43 @@
+/** \file
+    \brief Plugin statistics (counters)
+*/
+
+#ifndef StatsH
+#define StatsH
+
+#include <string>
+
+struct Stats
+{
+    unsigned int outReportsSubmitted;   ///< OUT reports queued for writing
+    unsigned int outReportsSuppressed;  ///< OUT reports skipped because device state would not change
+    unsigned int writeErrors;           ///< failed queued writes (updated from writer threads)
+    unsigned int writeTimeouts;         ///< queued writes that missed their deadline
+    unsigned int hostCommands;          ///< state changes received from tSIP
+    unsigned int hostCommandsOverflow;  ///< host commands passed through overflow list because queue was full (updated from host threads)
+    unsigned int clockTicks;            ///< idle clock updates (once per second while idle)
+    unsigned int clockDateRenders;      ///< idle date line formatted and encoded (once per day)
+    unsigned int marqueeSteps;          ///< scroll steps of text longer than display slot
+    unsigned int marqueeRenders;        ///< scrolled texts encoded into frames (once per text)
+    unsigned int displayCacheHits;      ///< display texts sent from cache of encoded texts
+    unsigned int displayCacheMisses;    ///< display texts not found in cache (encoded)
+    unsigned int displayCacheEvictions; ///< least recently used texts dropped from cache to stay within budget
+    unsigned int displayCacheBytes;     ///< memory used by cached texts, all phones
+    unsigned int displayCacheBudget;    ///< cache memory limit, all phones
+    unsigned int keyMacrosStarted;      ///< key macros queued for execution
+    unsigned int keyMacrosDropped;      ///< key macros dropped because too many were queued
+    unsigned int phonesReady;           ///< phones opened and ready (first keepalive written, reader started)
+    unsigned int readyMsMin;            ///< shortest time from device detection (arrival, plugin start or retry) to phone ready
+    unsigned int readyMsMax;            ///< longest time from device detection to phone ready
+    unsigned int commThreadCpuMs;       ///< CPU time used by comm thread, sampled when stats are logged
+    unsigned int wakeups;               ///< comm thread returns from waiting (timer, device or host event)
+    unsigned int wakeupsPerMinute;      ///< comm thread wakeup rate, averaged over last minute (or longer, if thread was idle)
+    Stats(void);
+    /** \brief Count phone that became ready \param readyMs time from detection [ms] */
+    void AddPhoneReady(unsigned int readyMs);
+    std::string ToString(void) const;
+};
+
+extern Stats stats;
+
+#endif // StatsH
@@ -0,0 +1,237 @@
+#include "TimerWheel.h"
+#include <stddef.h>
+#include <assert.h>
+
+const uint64_t TimerWheel::NO_DEADLINE = 0xFFFFFFFFFFFFFFFFULL;
+
+namespace
+{
+
+/** Entry limit: index is stored in lower 16 bits of TimerId */
+enum { MAX_TIMERS = 0xFFFF };
+
+}   // namespace
+
+
+TimerWheel::TimerWheel(uint64_t resolutionUs, uint64_t startUs):
+    resolutionUs(resolutionUs ? resolutionUs : 1),
+    nowUs(startUs),
+    current(startUs / this->resolutionUs),
+    count(0),
+    freeList(NONE),
+    nextExpiry(NO_DEADLINE),
+    nextExpiryValid(true)
+{
+    for (int i=0; i<LEVELS * SLOTS; i++)
+        slots[i] = NONE;
+}
+
+TimerWheel::TimerId TimerWheel::Schedule(uint64_t delayUs, uint64_t periodUs, Callback callback, void *opaque)
+{
+    if (callback == NULL)
+        return INVALID_TIMER;
+    int index = freeList;
+    if (index != NONE)
+    {
+        freeList = timers[index].next;
+    }
+    else
+    {
+        if (timers.size() >= MAX_TIMERS)
+            return INVALID_TIMER;
+        Timer t;
+        t.sequence = 0;
+        timers.push_back(t);
+        index = timers.size() - 1;
+    }
+
+    Timer &t = timers[index];
+    t.expires = (nowUs + delayUs + resolutionUs - 1) / resolutionUs;
+    if (t.expires <= current)
+        t.expires = current + 1;
+    t.period = (periodUs + resolutionUs - 1) / resolutionUs;
+    if (periodUs && t.period == 0)
+        t.period = 1;
+    t.callback = callback;
+    t.opaque = opaque;
+    t.active = true;
+    count++;
+    Insert(index);
+    return (static_cast<uint32_t>(t.sequence) << 16) | static_cast<uint32_t>(index + 1);
+}
+
+bool TimerWheel::Cancel(TimerId id)
+{
+    int index = static_cast<int>(id & 0xFFFF) - 1;
+    if (index < 0 || index >= static_cast<int>(timers.size()))
+        return false;
+    Timer &t = timers[index];
+    if (!t.active || t.sequence != (id >> 16))
+        return false;
+    Unlink(index);
+    Free(index);
+    return true;
+}
+
+void TimerWheel::Free(int index)
+{
+    Timer &t = timers[index];
+    t.active = false;
+    t.sequence++;
+    t.next = freeList;
+    freeList = index;
+    count--;
+}
+
+void TimerWheel::Insert(int index)
+{
+    Timer &t = timers[index];
+    // expires >= current here: due timers of cascaded slot go to slot of current tick
+    uint64_t expires = t.expires;
+    uint64_t delta = expires - current;
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (static_cast<uint64_t>(1) << (SLOT_BITS * (level + 1))))
+        level++;
+    if (delta >= (static_cast<uint64_t>(1) << (SLOT_BITS * LEVELS)))
+    {
+        // beyond wheel range: park in last slot of top level, reinserted with real expiry on cascade
+        expires = current + (static_cast<uint64_t>(1) << (SLOT_BITS * LEVELS)) - 1;
+    }
+    int slot = level * SLOTS + static_cast<int>((expires >> (SLOT_BITS * level)) & (SLOTS - 1));
+
+    t.slot = slot;
+    t.prev = NONE;
+    t.next = slots[slot];
+    if (t.next != NONE)
+        timers[t.next].prev = index;
+    slots[slot] = index;
+
+    if (nextExpiryValid && t.expires < nextExpiry)
+        nextExpiry = t.expires;
+}
+
+void TimerWheel::Unlink(int index)
+{
+    Timer &t = timers[index];
+    if (t.prev != NONE)
+        timers[t.prev].next = t.next;
+    else
+        slots[t.slot] = t.next;
+    if (t.next != NONE)
+        timers[t.next].prev = t.prev;
+    t.prev = t.next = NONE;
+    if (t.expires == nextExpiry)
+        nextExpiryValid = false;
+}
+
+void TimerWheel::Cascade(int level)
+{
+    int slot = level * SLOTS + static_cast<int>((current >> (SLOT_BITS * level)) & (SLOTS - 1));
+    int index = slots[slot];
+    slots[slot] = NONE;
+    while (index != NONE)
+    {
+        int next = timers[index].next;
+        Insert(index);
+        index = next;
+    }
+}
+
+void TimerWheel::Rebuild(void)
+{
+    for (int i=0; i<LEVELS * SLOTS; i++)
+        slots[i] = NONE;
+    for (unsigned int i=0; i<timers.size(); i++)
+    {
+        if (timers[i].active)
+            Insert(i);
+    }
+}
+
+uint64_t TimerWheel::NextExpiry(void) const
+{
+    if (!nextExpiryValid)
+    {
+        nextExpiry = NO_DEADLINE;
+        for (unsigned int i=0; i<timers.size(); i++)
+        {
+            if (timers[i].active && timers[i].expires < nextExpiry)
+                nextExpiry = timers[i].expires;
+        }
+        nextExpiryValid = true;
+    }
+    return nextExpiry;
+}
+
+unsigned int TimerWheel::Advance(uint64_t nowUs)
+{
+    if (nowUs <= this->nowUs)
+        return 0;
+    this->nowUs = nowUs;
+    uint64_t target = nowUs / resolutionUs;
+    unsigned int fired = 0;
+
+    while (current < target)
+    {
+        uint64_t next = NextExpiry();
+        if (next == NO_DEADLINE)
+        {
+            current = target;
+            break;
+        }
+        if (next > current + SLOTS)
+        {
+            // nothing expires for a while: jump over idle ticks instead of stepping through them
+            uint64_t last = (next - 1 < target) ? next - 1 : target;
+            if (last - current >= SLOTS)
+            {
+                current = last;
+                Rebuild();
+                continue;
+            }
+        }
+
+        current++;
+        for (int level = 1; level < LEVELS; level++)
+        {
+            if ((current & ((static_cast<uint64_t>(1) << (SLOT_BITS * level)) - 1)) != 0)
+                break;
+            Cascade(level);
+        }
+
+        int slot = static_cast<int>(current & (SLOTS - 1));
+        while (slots[slot] != NONE)
+        {
+            int index = slots[slot];
+            Unlink(index);
+            Timer &t = timers[index];
+            assert(t.expires == current);
+            Callback callback = t.callback;
+            void *opaque = t.opaque;
+            if (t.period)
+            {
+                // keep schedule, skip periods missed while thread was blocked
+                uint64_t expires = t.expires + t.period;
+                if (expires <= target)
+                    expires += ((target - expires) / t.period + 1) * t.period;
+                t.expires = expires;
+                Insert(index);
+            }
+            else
+            {
+                Free(index);
+            }
+            fired++;
+            callback(opaque);
+        }
+    }
+    return fired;
+}
+
+uint64_t TimerWheel::GetNextDeadline(void) const
+{
+    uint64_t next = NextExpiry();
+    if (next == NO_DEADLINE)
+        return NO_DEADLINE;
+    return next * resolutionUs;
+}
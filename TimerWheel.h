@@ -0,0 +1,103 @@
+/** \file
+    \brief Hierarchical timer wheel for periodic and one-shot jobs
+    \note Wheel has no clock of its own: time is passed to Advance(), so it runs
+    on Clock::GetTimeUs() as well as on virtual time (e.g. fast-forwarding hours
+    of operation in a test). Not thread-safe - all calls (including callbacks)
+    are made from single thread.
+*/
+
+#ifndef TimerWheelH
+#define TimerWheelH
+
+#include <stdint.h>
+#include <vector>
+
+class TimerWheel
+{
+public:
+    /** \brief Timer callback, called from Advance()
+        \note Callback may schedule and cancel timers, including the one being called.
+    */
+    typedef void (*Callback)(void *opaque);
+    typedef uint32_t TimerId;
+    enum { INVALID_TIMER = 0 };
+    static const uint64_t NO_DEADLINE;     ///< returned by GetNextDeadline() if there is no timer
+
+    /** \param resolutionUs tick length; timers are rounded up to whole ticks
+        \param startUs initial time
+    */
+    explicit TimerWheel(uint64_t resolutionUs, uint64_t startUs = 0);
+
+    /** \brief Add timer
+        \param delayUs time from current wheel time (last Advance()) to first expiry
+        \param periodUs period for periodic timer, 0 for one-shot timer
+        \return timer ID, INVALID_TIMER on invalid parameter
+    */
+    TimerId Schedule(uint64_t delayUs, uint64_t periodUs, Callback callback, void *opaque);
+
+    /** \brief Remove pending timer; IDs of expired one-shot or cancelled timers are ignored
+        \return true if timer was pending
+    */
+    bool Cancel(TimerId id);
+
+    /** \brief Move wheel time forward and call callbacks of expired timers
+        \note Periodic timer fires once even if more than one period passed (e.g. thread
+        was blocked); its next expiry stays aligned to its schedule.
+        \return number of callbacks called
+    */
+    unsigned int Advance(uint64_t nowUs);
+
+    /** \brief Time at which next timer expires, NO_DEADLINE if there is no timer
+    */
+    uint64_t GetNextDeadline(void) const;
+
+    /** \brief Wheel time: time passed to last Advance()
+    */
+    uint64_t GetTime(void) const {
+        return nowUs;
+    }
+
+    unsigned int GetCount(void) const {
+        return count;
+    }
+
+private:
+    enum { LEVELS = 4 };
+    enum { SLOT_BITS = 6 };
+    enum { SLOTS = 1 << SLOT_BITS };
+    enum { NONE = -1 };
+
+    struct Timer
+    {
+        uint64_t expires;       ///< [ticks]
+        uint64_t period;        ///< [ticks], 0 = one-shot
+        Callback callback;
+        void *opaque;
+        uint16_t sequence;      ///< distinguishes reused entries, part of TimerId
+        bool active;
+        int prev, next;         ///< slot list links (or free list link)
+        int slot;               ///< level * SLOTS + index
+    };
+
+    uint64_t resolutionUs;
+    uint64_t nowUs;
+    uint64_t current;           ///< last processed tick
+    unsigned int count;
+    std::vector<Timer> timers;
+    int freeList;
+    int slots[LEVELS * SLOTS];  ///< list heads
+    mutable uint64_t nextExpiry;        ///< earliest expiry [ticks], cached
+    mutable bool nextExpiryValid;
+
+    void Insert(int index);
+    void Unlink(int index);
+    void Free(int index);
+    void Cascade(int level);
+    void Rebuild(void);
+    uint64_t NextExpiry(void) const;
+
+    TimerWheel(const TimerWheel&);
+    TimerWheel& operator=(const TimerWheel&);
+};
+
+#endif // TimerWheelH
@@ -4,11 +4,16 @@
 //---------------------------------------------------------------------------
 
 #include "Utils.h"
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
 #include <assert.h>
 
 //---------------------------------------------------------------------------
 
+#ifdef _WIN32
 
 HMODULE Utils::GetCurrentModule(void)
 {
@@ -33,6 +38,19 @@ std::string Utils::GetDllPath(void)
 	return szPath;
 }
 
+#else
+
+std::string Utils::GetDllPath(void)
+{
+	Dl_info info;
+	static int dummy;
+	if (dladdr(&dummy, &info) == 0 || info.dli_fname == NULL)
+		return "";
+	return info.dli_fname;
+}
+
+#endif
+
 
 std::string Utils::ReplaceFileExtension(std::string filename, std::string ext)
 {
@@ -51,7 +69,7 @@ std::string Utils::ReplaceFileExtension(std::string filename, std::string ext)
 
 std::string Utils::ExtractFileName(std::string path)
 {
-	unsigned int bslash = path.rfind('\\');
+	unsigned int bslash = path.find_last_of("\\/");
 	if (bslash != std::string::npos)
 	{
 		return path.substr(bslash+1, path.length() - bslash - 1);
@@ -61,7 +79,7 @@ std::string Utils::ExtractFileName(std::string path)
 
 std::string Utils::ExtractFileNameWithoutExtension(std::string path)
 {
-	unsigned int bslash = path.rfind('\\');
+	unsigned int bslash = path.find_last_of("\\/");
 	if (bslash != std::string::npos)
 	{
 		std::string tmp = path.substr(bslash+1, path.length() - bslash - 1);
@@ -6,14 +6,18 @@
 #define UtilsH
 //---------------------------------------------------------------------------
 #include <string>
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <algorithm>
 
 namespace Utils
 {
+#ifdef _WIN32
 	/** \brief Get current module handle
 	*/
 	HMODULE GetCurrentModule(void);
+#endif
 
 	/** \brief Get Dll or module path + name
 		\return path + name
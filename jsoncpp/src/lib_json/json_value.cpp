@@ -9,7 +9,7 @@
 #include <stdexcept>
 #include <cstring>
 #include <cassert>
-#include <mem.h>
+#include <string.h>
 #ifdef JSON_USE_CPPTL
 # include <cpptl/conststring.h>
 #endif
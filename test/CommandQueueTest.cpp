@@ -0,0 +1,161 @@
+#include "SelfTest.h"
+#include "../CommandQueue.h"
+#include "../PhoneSession.h"
+#include "../Clock.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+
+enum { PRODUCERS = 4 };
+enum { COMMANDS_PER_PRODUCER = 2000000 };
+/** Same as comm thread queue */
+enum { QUEUE_SIZE = 256 };
+/** Producers post in bursts, as host callbacks do, so consumer can catch up and fast path is used again */
+enum { BURST = 16 };
+/** Consumer stalls (as comm thread blocked by I/O) after this many drains, so queue fills up */
+enum { STALL_PERIOD = 1024 };
+enum { STALL_MS = 1 };
+/** Consumer posts command itself (as from key callback) after this many received commands */
+enum { SELF_POST_PERIOD = 1000 };
+/** No command received for this long: something was lost [ms] */
+enum { PROGRESS_TIMEOUT = 10000 };
+
+/** Posting thread id in accountId, sequence number in newMessages */
+CommandQueue<HostCommand, QUEUE_SIZE> queue;
+unsigned int overflowCount = 0;
+
+void* ProducerThread(void *opaque)
+{
+    int id = static_cast<int>(reinterpret_cast<long>(opaque));
+    HostCommand cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = HostCommand::CALL_STATE;
+    cmd.accountId = id;
+    snprintf(cmd.display, sizeof(cmd.display), "producer %d", id);
+    for (unsigned int seq=0; seq<COMMANDS_PER_PRODUCER; seq++)
+    {
+        cmd.newMessages = seq;
+        if (!queue.Post(cmd))
+            __atomic_fetch_add(&overflowCount, 1, __ATOMIC_RELAXED);
+        if (seq % BURST == BURST - 1)
+            sched_yield();
+    }
+    return NULL;
+}
+
+/** Consumer: checks order of each producer, including itself (id PRODUCERS) */
+struct Checker
+{
+    unsigned int next[PRODUCERS + 1];
+    unsigned int received;
+    unsigned int selfPosted;
+    unsigned int errors;
+
+    Checker(void):
+        received(0),
+        selfPosted(0),
+        errors(0)
+    {
+        memset(next, 0, sizeof(next));
+    }
+
+    void operator()(const HostCommand &cmd) {
+        if (cmd.accountId < 0 || cmd.accountId > PRODUCERS)
+        {
+            if (errors++ < 10)
+                printf("torn command: producer %d\n", cmd.accountId);
+            return;
+        }
+        if (cmd.newMessages != next[cmd.accountId])
+        {
+            if (errors++ < 10)
+                printf("producer %d: received #%u, expected #%u\n", cmd.accountId, cmd.newMessages, next[cmd.accountId]);
+        }
+        next[cmd.accountId] = cmd.newMessages + 1;
+        received++;
+        if (cmd.accountId < PRODUCERS && received % SELF_POST_PERIOD == 0)
+        {
+            HostCommand self;
+            memset(&self, 0, sizeof(self));
+            self.type = HostCommand::RING;
+            self.accountId = PRODUCERS;
+            self.newMessages = selfPosted++;
+            if (!queue.Post(self))
+                __atomic_fetch_add(&overflowCount, 1, __ATOMIC_RELAXED);
+        }
+    }
+};
+
+}   // namespace
+
+int TestCommandQueue(void)
+{
+    const unsigned int total = PRODUCERS * COMMANDS_PER_PRODUCER;
+    Checker checker;
+    pthread_t threads[PRODUCERS];
+    uint64_t startUs = Clock::GetTimeUs();
+    for (long i=0; i<PRODUCERS; i++)
+    {
+        if (pthread_create(&threads[i], NULL, ProducerThread, reinterpret_cast<void*>(i)) != 0)
+        {
+            printf("failed to start producer thread\n");
+            return 1;
+        }
+    }
+
+    unsigned int drains = 0;
+    uint64_t progressUs = Clock::GetTimeUs();
+    while (checker.received < total + checker.selfPosted)
+    {
+        if (queue.Drain(checker) > 0)
+        {
+            progressUs = Clock::GetTimeUs();
+        }
+        else
+        {
+            if (Clock::GetTimeUs() - progressUs > PROGRESS_TIMEOUT * 1000ULL)
+            {
+                printf("no command received for %u ms: %u of %u commands lost\n", PROGRESS_TIMEOUT,
+                    total + checker.selfPosted - checker.received, total + checker.selfPosted);
+                checker.errors++;
+                break;
+            }
+            sched_yield();
+        }
+        if (++drains % STALL_PERIOD == 0)
+            Clock::SleepMs(STALL_MS);
+    }
+    uint64_t elapsedUs = Clock::GetTimeUs() - startUs;
+    for (int i=0; i<PRODUCERS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    // nothing may arrive after last expected command
+    if (queue.Drain(checker) != 0)
+    {
+        printf("commands received after all expected ones\n");
+        checker.errors++;
+    }
+    for (int i=0; i<PRODUCERS; i++)
+    {
+        if (checker.next[i] != COMMANDS_PER_PRODUCER)
+        {
+            printf("producer %d: %u of %u commands received in order\n", i, checker.next[i], COMMANDS_PER_PRODUCER);
+            checker.errors++;
+        }
+    }
+
+    printf("%u producers + consumer: %u commands (%u from consumer thread) in %.2f s, %.0f commands/s, %u through overflow list\n",
+        PRODUCERS, checker.received, checker.selfPosted, elapsedUs / 1e6,
+        checker.received * 1e6 / (elapsedUs ? elapsedUs : 1), overflowCount);
+    if (overflowCount == 0)
+    {
+        printf("overflow list not used, slow path not tested\n");
+        checker.errors++;
+    }
+    return (checker.errors == 0) ? 0 : 1;
+}
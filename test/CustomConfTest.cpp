@@ -0,0 +1,66 @@
+#include "SelfTest.h"
+#include "../CustomConf.h"
+#include <stdio.h>
+
+namespace
+{
+
+unsigned int errors = 0;
+
+void Expect(int account, int expected, const char *deviceId)
+{
+    if (account != expected && errors++ < 10)
+    {
+        printf("%s: account %d, expected %d\n", deviceId, account, expected);
+    }
+}
+
+void Bind(CustomConf &conf, const char *device, int accountId)
+{
+    CustomConf::PhoneBinding binding;
+    binding.device = device;
+    binding.accountId = accountId;
+    conf.phones.push_back(binding);
+}
+
+/** \brief Linux: USB device name (bus-port) must match as a whole */
+void TestLinux(void)
+{
+    CustomConf conf;
+    Bind(conf, "1-2", 0);
+    Bind(conf, "1-2.4", 1);
+    Expect(conf.GetPhoneAccount("1-2"), 0, "1-2");
+    Expect(conf.GetPhoneAccount("1-2.4"), 1, "1-2.4");
+    // phones behind hub on port 1-2 or on other bus
+    Expect(conf.GetPhoneAccount("1-2.4.1"), -1, "1-2.4.1");
+    Expect(conf.GetPhoneAccount("1-2.1"), -1, "1-2.1");
+    Expect(conf.GetPhoneAccount("11-2"), -1, "11-2");
+}
+
+/** \brief Windows: whole instance ID or one of its components, case-insensitive */
+void TestWindows(void)
+{
+    CustomConf conf;
+    Bind(conf, "5&1A2B3C4&0&2", 0);
+    Bind(conf, "usb\\vid_095d&pid_9201\\6&55aa&0&1", 1);
+    Bind(conf, "2", 2);
+    Expect(conf.GetPhoneAccount("USB\\VID_095D&PID_9201\\5&1A2B3C4&0&2"), 0, "USB\\VID_095D&PID_9201\\5&1A2B3C4&0&2");
+    Expect(conf.GetPhoneAccount("USB\\VID_095D&PID_9201\\5&1a2b3c4&0&2"), 0, "USB\\VID_095D&PID_9201\\5&1a2b3c4&0&2");
+    Expect(conf.GetPhoneAccount("USB\\VID_095D&PID_9201\\6&55AA&0&1"), 1, "USB\\VID_095D&PID_9201\\6&55AA&0&1");
+    // other port of the same hub, binding that is only part of component
+    Expect(conf.GetPhoneAccount("USB\\VID_095D&PID_9201\\5&1A2B3C4&0&3"), -1, "USB\\VID_095D&PID_9201\\5&1A2B3C4&0&3");
+    Expect(conf.GetPhoneAccount("USB\\VID_095D&PID_9201\\5&1A2B3C4&0&22"), -1, "USB\\VID_095D&PID_9201\\5&1A2B3C4&0&22");
+    // device path used when parent device is not known
+    Expect(conf.GetPhoneAccount("\\\\?\\hid#vid_095d&pid_9201&mi_03#5&1a2b3c4&0&2#{4d1e55b2-f16f-11cf-88cb-001111000030}"),
+        0, "\\\\?\\hid#vid_095d&pid_9201&mi_03#5&1a2b3c4&0&2#{...}");
+}
+
+}   // namespace
+
+int TestCustomConf(void)
+{
+    errors = 0;
+    TestLinux();
+    TestWindows();
+    return errors ? 1 : 0;
+}
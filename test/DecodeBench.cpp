@@ -0,0 +1,113 @@
+#include "SelfTest.h"
+#include "../PhoneSession.h"
+#include "../HidDevice.h"
+#include "../SpscRing.h"
+#include "../KeyMap.h"
+#include "../KeyMacro.h"
+#include "../DisplayLayout.h"
+#include "../TimerWheel.h"
+#include "../CustomConf.h"
+#include "../Clock.h"
+#include <stdio.h>
+#include <string.h>
+
+using nsHidDevice::HidReport;
+
+namespace
+{
+
+enum { TIMER_RESOLUTION = 10 };
+enum { REPORTS = 2000000 };
+enum { REPORT_SIZE = 8 };
+/** Keys 0...9, *, # pressed and released in turn (as in _doc/logs.txt) */
+enum { KEY_COUNT = 12 };
+/** Reports are taken out as soon as they are put in, as by comm thread keeping up with reader */
+enum { RING_SIZE = 16 };
+
+/** \brief Report as stored by reader before ring slots were filled in place */
+struct CopiedReport
+{
+    uint8_t data[HidReport::MAX_SIZE];
+    int size;
+    uint64_t timestampUs;
+};
+
+/** \brief Pass key reports through reader ring into HandleReportIn()
+    \param copy pass reports as reader did before ring slots were filled in place: read into
+    cleared 65-byte buffer, copy to report, copy into and out of ring
+    \return average time [ns/report]
+*/
+double Run(PhoneSession &phone, const HostState &state, bool copy, unsigned int count)
+{
+    SpscRing<HidReport, RING_SIZE> ring;
+    SpscRing<CopiedReport, RING_SIZE> copyRing;
+    const uint8_t keyReport[REPORT_SIZE] = { 0x00, 0x00, 0x00, 0x00, 0xD5, 0x5A, 0x00, 0x00 };
+    uint64_t beginUs = Clock::GetTimeUs();
+    for (unsigned int i=0; i<count; i++)
+    {
+        uint8_t key = (i & 1) ? 0 : static_cast<uint8_t>(1 + (i / 2) % KEY_COUNT);
+        if (copy)
+        {
+            // reader thread
+            uint8_t rcvbuf[1 + HidReport::MAX_SIZE];
+            memset(rcvbuf, 0, sizeof(rcvbuf));
+            memcpy(rcvbuf + 1, keyReport, REPORT_SIZE);
+            rcvbuf[2] = key;
+            CopiedReport copied;
+            copied.timestampUs = beginUs;
+            copied.size = REPORT_SIZE;
+            memcpy(copied.data, rcvbuf + 1, REPORT_SIZE);
+            copyRing.Push(copied);
+            // comm thread
+            CopiedReport received;
+            while (copyRing.Pop(received))
+            {
+                phone.HandleReportIn(received.data, received.size, received.timestampUs, state);
+            }
+        }
+        else
+        {
+            HidReport *slot = ring.Reserve();
+            slot->raw[0] = 0;
+            memcpy(slot->raw + 1, keyReport, REPORT_SIZE);
+            slot->raw[2] = key;
+            slot->size = REPORT_SIZE;
+            slot->timestampUs = beginUs;
+            ring.Commit();
+            const HidReport *received;
+            while ((received = ring.Front()) != NULL)
+            {
+                phone.HandleReportIn(received->GetData(), received->size, received->timestampUs, state);
+                ring.Release();
+            }
+        }
+    }
+    uint64_t elapsedUs = Clock::GetTimeUs() - beginUs;
+    return elapsedUs * 1000.0 / count;
+}
+
+}   // namespace
+
+int BenchmarkDecode(void)
+{
+    KeyMap keyMap;
+    keyMap.Compile(customConf.keyMap, customConf.dialKey);
+    KeyMacroTable keyMacros;
+    keyMacros.Compile(customConf.keyMacros);
+    DisplayLayout layout;
+    TimerWheel timers(TIMER_RESOLUTION * 1000);
+    HostState state;
+    PhoneSession phone(1, "bench", timers, keyMap, keyMacros, layout);
+    phone.ResetInput();
+
+    // warm-up
+    Run(phone, state, false, REPORTS / 10);
+    for (unsigned int i=0; i<3; i++)
+    {
+        double copyNs = Run(phone, state, true, REPORTS);
+        double inPlaceNs = Run(phone, state, false, REPORTS);
+        printf("%u reports: copied %.1f ns/report, in place %.1f ns/report\n", REPORTS, copyNs, inPlaceNs);
+    }
+    phone.ResetInput();
+    return 0;
+}
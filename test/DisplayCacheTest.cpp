@@ -0,0 +1,107 @@
+#include "SelfTest.h"
+#include "../DisplayCache.h"
+#include "../DisplayText.h"
+#include "../Stats.h"
+#include <stdio.h>
+
+namespace
+{
+
+typedef DisplayLayout L;
+
+unsigned int errors = 0;
+
+void Error(const char *what)
+{
+    if (errors++ < 10)
+    {
+        printf("%s\n", what);
+    }
+}
+
+void Expect(bool condition, const char *what)
+{
+    if (!condition)
+        Error(what);
+}
+
+/** \brief Repeated texts are encoded once; key is mode, slot and text */
+void TestHits(void)
+{
+    DisplayCache cache;
+    unsigned int hits = stats.displayCacheHits;
+    unsigned int misses = stats.displayCacheMisses;
+
+    const std::vector<uint8_t> *first = cache.Get(L::TWO_LINES, 0, "Registered");
+    std::vector<uint8_t> encoded;
+    DisplayText::EncodeLine("Registered", L::GetSlotCells(L::TWO_LINES), encoded);
+    Expect(first != NULL && *first == encoded, "cached text differs from encoded text");
+    Expect(cache.Get(L::TWO_LINES, 0, "Registered") == first, "repeated text not sent from cache");
+    cache.Get(L::TWO_LINES, 1, "Registered");
+    cache.Get(L::FOUR_CORNERS, 0, "Registered");
+    Expect(stats.displayCacheHits - hits == 1, "expected 1 hit");
+    Expect(stats.displayCacheMisses - misses == 3, "expected 3 misses (new text, other slot, other mode)");
+
+    // corner is narrower: text is cut
+    const std::vector<uint8_t> *corner = cache.Find(L::FOUR_CORNERS, 0, "Registered");
+    Expect(corner != NULL, "inserted text not found");
+    const std::string longText = "Customer Support Line";
+    DisplayText::EncodeLine(longText, L::GetSlotCells(L::FOUR_CORNERS), encoded);
+    Expect(*cache.Get(L::FOUR_CORNERS, 0, longText) == encoded, "text not cut to corner width");
+}
+
+/** \brief Memory stays within budget, least recently used texts are dropped first */
+void TestBudget(void)
+{
+    enum { BUDGET = 2048, TEXTS = 200 };
+    unsigned int evictions = stats.displayCacheEvictions;
+    unsigned int bytes = stats.displayCacheBytes;
+    unsigned int budget = stats.displayCacheBudget;
+    {
+        DisplayCache cache(BUDGET);
+        Expect(stats.displayCacheBudget - budget == BUDGET, "budget not counted in statistics");
+        char text[32];
+        for (unsigned int i=0; i<TEXTS; i++)
+        {
+            // "Registered" is shown again and again while callers change
+            cache.Get(L::TWO_LINES, 1, "Registered");
+            snprintf(text, sizeof(text), "Caller %u", i);
+            cache.Get(L::TWO_LINES, 0, text);
+            Expect(cache.GetBytes() <= BUDGET, "cache over budget");
+        }
+        Expect(stats.displayCacheBytes - bytes == cache.GetBytes(), "memory used not counted in statistics");
+        Expect(stats.displayCacheEvictions > evictions, "no texts dropped");
+        Expect(cache.Find(L::TWO_LINES, 0, "Caller 0") == NULL, "least recently used text kept");
+        Expect(cache.Find(L::TWO_LINES, 0, "Caller 199") != NULL, "most recently used text dropped");
+        Expect(cache.Find(L::TWO_LINES, 1, "Registered") != NULL, "recurring text dropped");
+    }
+    Expect(stats.displayCacheBytes == bytes, "memory not released");
+    Expect(stats.displayCacheBudget == budget, "budget not released");
+
+    // texts of one screen are kept even if they alone exceed budget
+    DisplayCache cache(0);
+    const std::vector<uint8_t> *slots[L::SLOT_COUNT];
+    const char *texts[L::SLOT_COUNT] = { "Alice", "Registered", "0:01", "2 new messages" };
+    for (unsigned int i=0; i<L::SLOT_COUNT; i++)
+    {
+        slots[i] = cache.Get(L::FOUR_CORNERS, i, texts[i]);
+    }
+    for (unsigned int i=0; i<L::SLOT_COUNT; i++)
+    {
+        Expect(cache.Find(L::FOUR_CORNERS, i, texts[i]) == slots[i], "text of current screen dropped");
+    }
+    cache.Get(L::FOUR_CORNERS, 2, "0:02");
+    Expect(cache.Find(L::FOUR_CORNERS, 0, "Alice") == NULL, "oldest text kept over budget");
+}
+
+}   // namespace
+
+int TestDisplayCache(void)
+{
+    errors = 0;
+    TestHits();
+    TestBudget();
+    printf("display cache: %u hits, %u misses, %u evictions\n",
+        stats.displayCacheHits, stats.displayCacheMisses, stats.displayCacheEvictions);
+    return errors ? 1 : 0;
+}
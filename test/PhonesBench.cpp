@@ -0,0 +1,96 @@
+#include "SelfTest.h"
+#include "../PhoneSession.h"
+#include "../KeyMap.h"
+#include "../KeyMacro.h"
+#include "../DisplayLayout.h"
+#include "../TimerWheel.h"
+#include "../CustomConf.h"
+#include "../Latency.h"
+#include "../Clock.h"
+#include <stdio.h>
+#include <vector>
+
+namespace
+{
+
+/** Same as comm thread */
+enum { MAX_PHONES = 32 };
+enum { TIMER_RESOLUTION = 10 };
+enum { REPORTS_PER_PHONE = 20000 };
+enum { REPORT_SIZE = 8 };
+/** Keys 0...9, *, # pressed and released in turn (as in _doc/logs.txt) */
+enum { KEY_COUNT = 12 };
+
+void ResetLatency(void)
+{
+    for (int i=0; i<LatencyStats::STAGE_COUNT; i++)
+    {
+        latency.stages[i].Reset();
+    }
+}
+
+/** \brief Feed reports to phones in turn, as comm thread serving all of them
+    \param burst all phones report at the same time (reception time taken once per round),
+    otherwise reception time is taken just before each report
+    \return average handling time [ns/report]
+*/
+double Run(std::vector<PhoneSession*> &phones, const HostState &state, bool burst)
+{
+    uint8_t report[REPORT_SIZE] = { 0x00, 0x00, 0x00, 0x00, 0xD5, 0x5A, 0x00, 0x00 };
+    unsigned int rounds = REPORTS_PER_PHONE;
+    uint64_t beginUs = Clock::GetTimeUs();
+    for (unsigned int r=0; r<rounds; r++)
+    {
+        // odd rounds release key pressed in previous round
+        report[1] = (r & 1) ? 0 : static_cast<uint8_t>(1 + (r / 2) % KEY_COUNT);
+        uint64_t roundUs = Clock::GetTimeUs();
+        for (unsigned int i=0; i<phones.size(); i++)
+        {
+            phones[i]->HandleReportIn(report, sizeof(report), burst ? roundUs : Clock::GetTimeUs(), state);
+        }
+    }
+    uint64_t elapsedUs = Clock::GetTimeUs() - beginUs;
+    return elapsedUs * 1000.0 / (static_cast<double>(rounds) * phones.size());
+}
+
+}   // namespace
+
+int BenchmarkPhones(void)
+{
+    KeyMap keyMap;
+    keyMap.Compile(customConf.keyMap, customConf.dialKey);
+    KeyMacroTable keyMacros;
+    keyMacros.Compile(customConf.keyMacros);
+    DisplayLayout layout;
+    TimerWheel timers(TIMER_RESOLUTION * 1000);
+    HostState state;
+    std::vector<PhoneSession*> phones;
+
+    for (unsigned int count=1; count<=MAX_PHONES; count*=2)
+    {
+        while (phones.size() < count)
+        {
+            char deviceId[16];
+            snprintf(deviceId, sizeof(deviceId), "bench-%u", static_cast<unsigned int>(phones.size()));
+            PhoneSession *phone = new PhoneSession(phones.size() + 1, deviceId, timers, keyMap, keyMacros, layout);
+            phone->ResetInput();
+            phones.push_back(phone);
+        }
+        // warm-up
+        Run(phones, state, false);
+
+        ResetLatency();
+        double ns = Run(phones, state, false);
+        printf("%2u phones: %.0f ns/report; %s\n", count, ns, latency.ToString().c_str());
+        ResetLatency();
+        ns = Run(phones, state, true);
+        printf("%2u phones, all pressing at once: %.0f ns/report; %s\n", count, ns, latency.ToString().c_str());
+    }
+
+    for (unsigned int i=0; i<phones.size(); i++)
+    {
+        delete phones[i];
+    }
+    ResetLatency();
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "SelfTest.h"
+#include "../ReportReplay.h"
+#include "../KeyMap.h"
+#include "../KeyMacro.h"
+#include "../CustomConf.h"
+#include "../Stats.h"
+#include <json/json.h>
+#include <fstream>
+#include <string>
+#include <stdio.h>
+
+namespace
+{
+
+/** \brief Replay cases in test/replay, same as
+    replay [-r] [-s <wall time>] [-c <config>] -e <expected> <input>
+    run from project directory
+*/
+struct Case
+{
+    const char *input;
+    const char *config;     ///< NULL: default configuration
+    const char *expected;
+    bool ringing;
+    const char *wallTime;   ///< NULL: display and LED are not recorded
+};
+
+const Case cases[] = {
+    { "../../_doc/logs.txt", NULL, "logs.expected", false, NULL },
+    { "keymap.log", "keymap.cfg", "keymap.expected", false, NULL },
+    { "keymap.log", "keymap.cfg", "keymap-ringing.expected", true, NULL },
+    { "buttons.log", NULL, "buttons.expected", false, NULL },
+    { "macros.log", "macros.cfg", "macros.expected", false, NULL },
+    { "idle.log", NULL, "idle.expected", false, "2024-02-28 23:59:56" },
+    { "corners.log", "corners.cfg", "corners.expected", false, "2024-02-28 12:00:00" },
+    { "marquee.log", "marquee.cfg", "marquee.expected", false, "2024-02-28 12:00:00" },
+    { "repeat.log", "corners.cfg", "repeat.expected", false, "2024-02-28 12:00:00" },
+};
+
+const std::string DIR = "test/replay/";
+
+int LoadConfig(const std::string &fileName)
+{
+    customConf = CustomConf();
+    if (fileName.empty())
+        return 0;
+    std::ifstream ifs(fileName.c_str());
+    if (!ifs)
+        return -1;
+    std::string strConfig((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    Json::Value root;
+    Json::Reader reader;
+    if (!reader.parse(strConfig, root))
+        return -1;
+    customConf.fromJson(root["customConf"]);
+    return 0;
+}
+
+int RunCase(const Case &c)
+{
+    if (LoadConfig(c.config ? DIR + c.config : "") != 0)
+    {
+        printf("%s: failed to load configuration\n", c.config);
+        return 1;
+    }
+    std::vector<ReplayReport> reports;
+    if (ReportReplay::Load(DIR + c.input, reports) != 0)
+    {
+        printf("%s: failed to load\n", c.input);
+        return 1;
+    }
+    std::ifstream expected((DIR + c.expected).c_str());
+    if (!expected)
+    {
+        printf("%s: failed to read\n", c.expected);
+        return 1;
+    }
+
+    KeyMap keyMap;
+    keyMap.Compile(customConf.keyMap, customConf.dialKey);
+    KeyMacroTable keyMacros;
+    keyMacros.Compile(customConf.keyMacros);
+    ReportReplay replay(keyMap, keyMacros);
+    replay.GetHostState().ringState = c.ringing ? 1 : 0;
+    if (c.wallTime)
+    {
+        uint64_t wallTimeUs;
+        if (ReportReplay::ParseWallTime(c.wallTime, wallTimeUs) != 0)
+        {
+            printf("%s: invalid time %s\n", c.expected, c.wallTime);
+            return 1;
+        }
+        replay.RecordOutput(wallTimeUs);
+    }
+    unsigned int phonesReady = stats.phonesReady;
+    replay.Run(reports);
+    if (c.wallTime && stats.phonesReady == phonesReady)
+    {
+        // simulated phone: keepalive written as soon as it is queued
+        printf("%s: phone not counted as ready\n", c.expected);
+        return 1;
+    }
+
+    std::string error;
+    if (replay.Check(expected, error) != 0)
+    {
+        printf("%s: %s\n", c.expected, error.c_str());
+        return 1;
+    }
+    printf("%s: %u calls as expected\n", c.expected, static_cast<unsigned int>(replay.GetCalls().size()));
+    return 0;
+}
+
+}   // namespace
+
+int TestReplay(void)
+{
+    int result = 0;
+    for (unsigned int i=0; i<sizeof(cases)/sizeof(cases[0]); i++)
+    {
+        if (RunCase(cases[i]) != 0)
+            result = 1;
+    }
+    customConf = CustomConf();
+    return result;
+}
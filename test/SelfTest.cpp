@@ -0,0 +1,106 @@
+/** \file
+    \brief Self-test runner ("Test Linux" target)
+
+    Usage: selftest [test...]
+    Without arguments all tests are run; benchmarks are run only when named.
+    Exit code is 1 if any test failed, 2 on unknown test name.
+*/
+
+#include "SelfTest.h"
+#include "../HostPhone.h"
+#include "../ReportReplay.h"
+#include <stdio.h>
+#include <string.h>
+
+void Log(char* txt)
+{
+    fputs(txt, stderr);
+}
+
+/* host calls are recorded by active replay, ignored otherwise */
+void Key(int keyCode, int state)
+{
+    ReportReplay::OnKey(keyCode, state);
+}
+
+int RunScriptAsync(const char* script)
+{
+    ReportReplay::OnScript(script);
+    return 0;
+}
+
+int Redial(void)
+{
+    ReportReplay::OnRedial();
+    return 0;
+}
+
+namespace
+{
+
+struct Test
+{
+    const char *name;
+    int (*run)(void);
+    bool benchmark;
+};
+
+const Test tests[] = {
+    { "phones", BenchmarkPhones, true },
+    { "decode", BenchmarkDecode, true },
+    { "timers", TestTimerWheel, false },
+    { "queue", TestCommandQueue, false },
+    { "replay", TestReplay, false },
+    { "cache", TestDisplayCache, false },
+    { "conf", TestCustomConf, false },
+};
+
+}   // namespace
+
+int main(int argc, char **argv)
+{
+    int result = 0;
+    for (int i=1; i<argc; i++)
+    {
+        bool found = false;
+        for (unsigned int j=0; j<sizeof(tests)/sizeof(tests[0]); j++)
+        {
+            if (strcmp(argv[i], tests[j].name) == 0)
+                found = true;
+        }
+        if (!found)
+        {
+            fprintf(stderr, "Unknown test %s, available:", argv[i]);
+            for (unsigned int j=0; j<sizeof(tests)/sizeof(tests[0]); j++)
+            {
+                fprintf(stderr, " %s%s", tests[j].name, tests[j].benchmark ? " (benchmark)" : "");
+            }
+            fprintf(stderr, "\n");
+            return 2;
+        }
+    }
+
+    for (unsigned int j=0; j<sizeof(tests)/sizeof(tests[0]); j++)
+    {
+        bool selected = (argc == 1) && !tests[j].benchmark;
+        for (int i=1; i<argc; i++)
+        {
+            if (strcmp(argv[i], tests[j].name) == 0)
+                selected = true;
+        }
+        if (!selected)
+            continue;
+        printf("[%s]\n", tests[j].name);
+        fflush(stdout);
+        if (tests[j].run() != 0)
+        {
+            printf("[%s] FAILED\n", tests[j].name);
+            result = 1;
+        }
+        else
+        {
+            printf("[%s] OK\n", tests[j].name);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,45 @@
+/** \file
+    \brief Self-tests and benchmarks of "Test Linux" target
+    \note Each test prints its results and returns 0 on success, 1 on failure.
+*/
+
+#ifndef SelfTestH
+#define SelfTestH
+
+/** \brief Drive 1...32 phones (PhoneSession without device) from one thread with key reports,
+    print handling time and LatencyStats for each number of phones
+*/
+int BenchmarkPhones(void);
+
+/** \brief Pass key reports through reader ring into report handling of one phone (without
+    device and timers), print ns/report with ring slot filled in place and with copies as before
+*/
+int BenchmarkDecode(void);
+
+/** \brief Fast-forward timer wheel through 2.3 days of virtual time: expiries at level boundaries
+    and beyond wheel range, random and re-armed timers, cancelling (also from callbacks and of
+    timers parked beyond range), periodic timers after stall, idle jumps
+*/
+int TestTimerWheel(void);
+
+/** \brief Several producer threads and consumer pass millions of commands through CommandQueue,
+    including overflow list; checks that nothing is lost or reordered per producer
+*/
+int TestCommandQueue(void);
+
+/** \brief Replay cases from test/replay (input reports, configuration) and compare calls with
+    expected files
+*/
+int TestReplay(void);
+
+/** \brief DisplayCache: repeated texts sent from cache, hit/miss/eviction counters, memory within
+    budget with least recently used texts dropped first, texts of current screen kept
+*/
+int TestDisplayCache(void);
+
+/** \brief CustomConf: phone bound to account only by whole USB device name (Linux) or whole
+    component of device instance ID (Windows)
+*/
+int TestCustomConf(void);
+
+#endif // SelfTestH
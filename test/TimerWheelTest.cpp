@@ -0,0 +1,315 @@
+#include "SelfTest.h"
+#include "../TimerWheel.h"
+#include "../Clock.h"
+#include <stdio.h>
+#include <vector>
+
+namespace
+{
+
+/** Same as comm thread */
+enum { RESOLUTION_US = 10000 };
+const uint64_t SECOND_US = 1000000;
+const uint64_t DAY_US = 24 * 3600 * SECOND_US;
+/** Longer than wheel range (64^4 ticks, 1.94 days at 10 ms), so far timers are parked */
+const uint64_t SIMULATED_US = 23 * DAY_US / 10;
+enum { RANDOM_TIMERS = 1000 };
+/** Delays [ticks] at and around level boundaries: 64, 64^2, 64^3, wheel range 64^4 */
+const uint64_t EDGE_TICKS[] = {
+    1, 63, 64, 65, 4095, 4096, 4097, 262143, 262144, 262145,
+    16777215, 16777216, 16777217, 19000000
+};
+
+unsigned int errors = 0;
+
+void Error(const char *what, uint64_t expectedUs, uint64_t actualUs)
+{
+    if (errors++ < 10)
+    {
+        printf("%s: expected at %.2f s, at %.2f s\n", what, expectedUs / 1e6, actualUs / 1e6);
+    }
+}
+
+uint32_t randomState = 12345;
+/** xorshift, same sequence on every platform */
+uint32_t Random(void)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+TimerWheel *wheel = NULL;
+
+struct OneShot
+{
+    uint64_t dueUs;
+    TimerWheel::TimerId id;
+    bool cancelled;
+    unsigned int fired;
+};
+std::vector<OneShot> oneShots;
+
+void OnOneShot(void *opaque)
+{
+    OneShot &t = oneShots[reinterpret_cast<long>(opaque)];
+    t.fired++;
+    if (t.cancelled)
+        Error("cancelled timer fired", 0, wheel->GetTime());
+    else if (wheel->GetTime() != t.dueUs)
+        Error("one-shot timer", t.dueUs, wheel->GetTime());
+}
+
+void AddOneShot(uint64_t delayUs)
+{
+    OneShot t;
+    t.dueUs = wheel->GetTime() + delayUs;
+    t.cancelled = false;
+    t.fired = 0;
+    oneShots.push_back(t);
+    oneShots.back().id = wheel->Schedule(delayUs, 0, OnOneShot, reinterpret_cast<void*>(static_cast<long>(oneShots.size() - 1)));
+}
+
+void Cancel(unsigned int index)
+{
+    OneShot &t = oneShots[index];
+    if (t.cancelled || t.fired)
+        return;
+    if (!wheel->Cancel(t.id))
+        Error("pending timer not cancelled", t.dueUs, wheel->GetTime());
+    t.cancelled = true;
+}
+
+struct Periodic
+{
+    uint64_t nextUs;
+    uint64_t periodUs;
+    unsigned int fired;
+};
+
+void OnPeriodic(void *opaque)
+{
+    Periodic &p = *static_cast<Periodic*>(opaque);
+    if (wheel->GetTime() != p.nextUs)
+        Error("periodic timer", p.nextUs, wheel->GetTime());
+    p.nextUs += p.periodUs;
+    p.fired++;
+}
+
+/** \brief Re-armed one-shot with random delay, as idle clock timer */
+struct Chain
+{
+    uint64_t dueUs;
+    unsigned int fired;
+};
+
+void OnChain(void *opaque)
+{
+    Chain &c = *static_cast<Chain*>(opaque);
+    if (wheel->GetTime() != c.dueUs)
+        Error("re-armed timer", c.dueUs, wheel->GetTime());
+    c.fired++;
+    uint64_t delayUs = (1 + Random() % 100000) * static_cast<uint64_t>(RESOLUTION_US);
+    c.dueUs = wheel->GetTime() + delayUs;
+    wheel->Schedule(delayUs, 0, OnChain, opaque);
+}
+
+/** \brief Ringing: periodic LED blink faster than level 0 of wheel is started for an hour every
+    four hours, so wheel steps through every tick (cascading) instead of jumping over idle ticks
+*/
+enum { BLINK_US = 200000 };
+struct Ring
+{
+    Periodic blink;
+    TimerWheel::TimerId blinkId;
+    unsigned int rings;
+};
+
+void OnRingStop(void *opaque)
+{
+    Ring &r = *static_cast<Ring*>(opaque);
+    if (!wheel->Cancel(r.blinkId))
+        Error("blink timer not cancelled", 0, wheel->GetTime());
+}
+
+void OnRingStart(void *opaque)
+{
+    Ring &r = *static_cast<Ring*>(opaque);
+    r.rings++;
+    r.blink.nextUs = wheel->GetTime() + BLINK_US;
+    r.blinkId = wheel->Schedule(BLINK_US, BLINK_US, OnPeriodic, &r.blink);
+    wheel->Schedule(3600 * SECOND_US + BLINK_US / 2, 0, OnRingStop, opaque);
+}
+
+/** \brief Hourly job cancelling some pending random timers, from callback */
+void OnCanceller(void *opaque)
+{
+    unsigned int first = reinterpret_cast<long>(opaque);
+    for (unsigned int i=0; i<10; i++)
+    {
+        Cancel(first + Random() % RANDOM_TIMERS);
+    }
+}
+
+/** \brief Step through every deadline until end of simulated time
+    \return number of Advance() calls
+*/
+unsigned int FastForward(uint64_t endUs)
+{
+    unsigned int steps = 0;
+    uint64_t deadline;
+    while ((deadline = wheel->GetNextDeadline()) <= endUs)
+    {
+        if (deadline <= wheel->GetTime())
+        {
+            Error("deadline not after wheel time", wheel->GetTime() + 1, deadline);
+            break;
+        }
+        if (wheel->Advance(deadline) == 0)
+            Error("nothing expired at deadline", deadline, wheel->GetTime());
+        steps++;
+    }
+    wheel->Advance(endUs);
+    return steps;
+}
+
+void TestSchedule(void)
+{
+    TimerWheel timers(RESOLUTION_US);
+    wheel = &timers;
+    oneShots.clear();
+
+    Periodic keepalive = { SECOND_US, SECOND_US, 0 };
+    timers.Schedule(keepalive.periodUs, keepalive.periodUs, OnPeriodic, &keepalive);
+    Periodic minute = { 60 * SECOND_US, 60 * SECOND_US, 0 };
+    timers.Schedule(minute.periodUs, minute.periodUs, OnPeriodic, &minute);
+    Chain chain = { RESOLUTION_US, 0 };
+    timers.Schedule(RESOLUTION_US, 0, OnChain, &chain);
+    Ring ring = { { 0, BLINK_US, 0 }, TimerWheel::INVALID_TIMER, 0 };
+    timers.Schedule(7 * 60 * SECOND_US, 4 * 3600 * SECOND_US, OnRingStart, &ring);
+
+    for (unsigned int i=0; i<sizeof(EDGE_TICKS)/sizeof(EDGE_TICKS[0]); i++)
+    {
+        AddOneShot(EDGE_TICKS[i] * RESOLUTION_US);
+    }
+    unsigned int firstRandom = oneShots.size();
+    for (unsigned int i=0; i<RANDOM_TIMERS; i++)
+    {
+        AddOneShot((1 + Random() % (SIMULATED_US / RESOLUTION_US)) * RESOLUTION_US);
+    }
+    timers.Schedule(3600 * SECOND_US, 3600 * SECOND_US, OnCanceller, reinterpret_cast<void*>(static_cast<long>(firstRandom)));
+
+    // beyond wheel range: one cancelled right away, one while still parked, one after it comes in range
+    unsigned int parked = oneShots.size();
+    AddOneShot(22 * DAY_US / 10);
+    AddOneShot(22 * DAY_US / 10 + SECOND_US);
+    AddOneShot(22 * DAY_US / 10 + 2 * SECOND_US);
+    AddOneShot(22 * DAY_US / 10 + 3 * SECOND_US);   // fires
+    Cancel(parked);
+
+    uint64_t startUs = Clock::GetTimeUs();
+    unsigned int steps = FastForward(DAY_US / 10);
+    Cancel(parked + 1);
+    steps += FastForward(DAY_US + DAY_US / 2);
+    Cancel(parked + 2);
+    steps += FastForward(SIMULATED_US);
+    uint64_t elapsedUs = Clock::GetTimeUs() - startUs;
+
+    unsigned int fired = 0, cancelled = 0;
+    for (unsigned int i=0; i<oneShots.size(); i++)
+    {
+        const OneShot &t = oneShots[i];
+        if (t.cancelled)
+        {
+            cancelled++;
+            continue;
+        }
+        if (t.fired != 1)
+            Error("one-shot timer fired more or less than once", t.dueUs, 0);
+        fired++;
+    }
+    if (keepalive.fired != SIMULATED_US / SECOND_US || minute.fired != SIMULATED_US / (60 * SECOND_US) ||
+        ring.blink.fired != ring.rings * (3600 * SECOND_US / BLINK_US))
+    {
+        printf("periodic timers fired %u, %u and %u times\n", keepalive.fired, minute.fired, ring.blink.fired);
+        errors++;
+    }
+    // left: 3 periodic, ring start, re-armed chain
+    if (timers.GetCount() != 5)
+    {
+        printf("%u timers left pending, expected 5\n", timers.GetCount());
+        errors++;
+    }
+    printf("%.1f days simulated in %u steps, %.0f ms: %u one-shot timers fired, %u cancelled, "
+        "%u periodic and %u re-armed expiries\n", SIMULATED_US / static_cast<double>(DAY_US), steps, elapsedUs / 1e3,
+        fired, cancelled, keepalive.fired + minute.fired + ring.blink.fired, chain.fired);
+    wheel = NULL;
+}
+
+void OnRecordTime(void *opaque)
+{
+    *static_cast<uint64_t*>(opaque) = wheel->GetTime();
+}
+
+/** \brief Advance() in coarse steps, as after comm thread was blocked or slept
+*/
+void TestStall(void)
+{
+    TimerWheel timers(RESOLUTION_US, 5 * SECOND_US);
+    wheel = &timers;
+
+    // blocked for 10.5 s: fires once (late), next expiry stays aligned to schedule
+    Periodic keepalive = { 15 * SECOND_US + SECOND_US / 2, SECOND_US, 0 };
+    TimerWheel::TimerId keepaliveId = timers.Schedule(SECOND_US, SECOND_US, OnPeriodic, &keepalive);
+    unsigned int fired = timers.Advance(15 * SECOND_US + SECOND_US / 2);
+    if (fired != 1 || timers.GetNextDeadline() != 16 * SECOND_US)
+    {
+        printf("stalled periodic timer: %u expiries, next at %.2f s\n", fired, timers.GetNextDeadline() / 1e6);
+        errors++;
+    }
+    keepalive.nextUs = 16 * SECOND_US;
+    timers.Advance(16 * SECOND_US);
+    timers.Cancel(keepaliveId);
+
+    // idle: wheel jumps over ticks with nothing due, timers must not move
+    const uint64_t dueUs[2] = { timers.GetTime() + DAY_US + 7 * SECOND_US, timers.GetTime() + 3 * DAY_US / 2 };
+    uint64_t firedUs[2] = { 0, 0 };
+    timers.Schedule(dueUs[0] - timers.GetTime(), 0, OnRecordTime, &firedUs[0]);
+    timers.Schedule(dueUs[1] - timers.GetTime(), 0, OnRecordTime, &firedUs[1]);
+    const uint64_t stepUs = 3600 * SECOND_US;
+    for (uint64_t t = timers.GetTime() + stepUs; t < 2 * DAY_US; t += stepUs)
+    {
+        uint64_t deadline = timers.GetNextDeadline();
+        uint64_t expectedDeadline = (firedUs[0] == 0) ? dueUs[0] : dueUs[1];
+        if (timers.GetCount() && deadline != expectedDeadline)
+        {
+            Error("deadline after idle jump", expectedDeadline, deadline);
+            break;
+        }
+        timers.Advance(t);
+        for (unsigned int i=0; i<2; i++)
+        {
+            // fired by Advance() that passed its expiry
+            bool due = (t >= dueUs[i]) && (t - stepUs < dueUs[i]);
+            if (due != (firedUs[i] == t))
+                Error("timer after idle jumps", dueUs[i], firedUs[i]);
+        }
+    }
+    if (firedUs[0] == 0 || firedUs[1] == 0 || timers.GetCount() != 0)
+    {
+        printf("timers after idle jumps not fired\n");
+        errors++;
+    }
+    wheel = NULL;
+}
+
+}   // namespace
+
+int TestTimerWheel(void)
+{
+    errors = 0;
+    TestSchedule();
+    TestStall();
+    return (errors == 0) ? 0 : 1;
+}